@@ -0,0 +1,279 @@
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include "aio.h"
+
+// reads through io_uring, see aio.h.  there is no liburing here: the
+// ring is set up and driven with the system calls themselves
+
+
+static int ioUringSetup(const unsigned entries, struct io_uring_params* p)
+{
+  return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int ioUringEnter(const int fd, const unsigned toSubmit,
+                        const unsigned minComplete, const unsigned flags)
+{
+  return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags,
+                 NULL, 0);
+}
+
+
+IoRing::IoRing(const int entries)
+  : ringFd(-1), sqMap(MAP_FAILED), sqMapLength(0), cqMap(MAP_FAILED),
+    cqMapLength(0), sqeMap(MAP_FAILED), sqeMapLength(0),
+    unsubmitted(0), inFlight(0)
+{
+  if (!setup(entries)) teardown();
+}
+
+
+IoRing::~IoRing()
+{
+  run();
+  teardown();
+}
+
+
+// the queues are mapped from the ring as io_uring_setup describes
+// them in its parameters.  false if any of it fails
+
+const bool IoRing::setup(const int entries)
+{
+  struct io_uring_params p;
+  memset(&p, 0, sizeof p);
+  ringFd = ioUringSetup(entries, &p);
+  if (ringFd < 0)
+    return false;
+
+  sqMapLength = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cqMapLength = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    {
+      if (cqMapLength > sqMapLength) sqMapLength = cqMapLength;
+      cqMapLength = 0;
+    }
+  sqMap = mmap(NULL, sqMapLength, PROT_READ | PROT_WRITE,
+               MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+  if (sqMap == MAP_FAILED)
+    return false;
+  char* cq = (char*) sqMap;
+  if (cqMapLength > 0)
+    {
+      cqMap = mmap(NULL, cqMapLength, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+      if (cqMap == MAP_FAILED)
+        return false;
+      cq = (char*) cqMap;
+    }
+  sqeMapLength = p.sq_entries * sizeof(struct io_uring_sqe);
+  sqeMap = mmap(NULL, sqeMapLength, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+  if (sqeMap == MAP_FAILED)
+    return false;
+
+  char* sq = (char*) sqMap;
+  sqHead = (unsigned*) (sq + p.sq_off.head);
+  sqTail = (unsigned*) (sq + p.sq_off.tail);
+  sqMask = *(unsigned*) (sq + p.sq_off.ring_mask);
+  sqEntries = p.sq_entries;
+  sqArray = (unsigned*) (sq + p.sq_off.array);
+  sqes = (struct io_uring_sqe*) sqeMap;
+
+  cqHead = (unsigned*) (cq + p.cq_off.head);
+  cqTail = (unsigned*) (cq + p.cq_off.tail);
+  cqMask = *(unsigned*) (cq + p.cq_off.ring_mask);
+  cqEntries = p.cq_entries;
+  cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+  return true;
+}
+
+
+void IoRing::teardown()
+{
+  if (sqeMap != MAP_FAILED) munmap(sqeMap, sqeMapLength);
+  if (cqMap != MAP_FAILED) munmap(cqMap, cqMapLength);
+  if (sqMap != MAP_FAILED) munmap(sqMap, sqMapLength);
+  sqeMap = cqMap = sqMap = MAP_FAILED;
+  if (ringFd >= 0) ::close(ringFd);
+  ringFd = -1;
+}
+
+
+void IoRing::read(const int fd, void* buf, const unsigned length,
+                  const off_t offset, IoOp* op)
+{
+  op->fd = fd;
+  op->buf = buf;
+  op->length = length;
+  op->offset = offset;
+
+  if (!isAsync())
+    {
+      ssize_t n;
+      do n = pread(fd, buf, length, offset);
+      while (n < 0 && errno == EINTR);
+      finished.push_back(make_pair(op, n < 0 ? -errno : (int) n));
+      return;
+    }
+
+  // reads in flight are kept to what the completion queue holds
+  if (!queued.empty() || unsubmitted == sqEntries
+      || unsubmitted + inFlight == cqEntries)
+    queued.push_back(op);
+  else
+    submit(op);
+}
+
+
+// only this thread moves the tail of the submission queue and the
+// head of the completion queue; the kernel moves the others
+
+void IoRing::submit(IoOp* op)
+{
+  unsigned tail = *sqTail;
+  unsigned index = tail & sqMask;
+  struct io_uring_sqe* sqe = &sqes[index];
+  memset(sqe, 0, sizeof *sqe);
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = op->fd;
+  sqe->addr = (unsigned long) op->buf;
+  sqe->len = op->length;
+  sqe->off = op->offset;
+  sqe->user_data = (unsigned long) op;
+  sqArray[index] = index;
+  __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+  unsubmitted++;
+}
+
+
+// the head is moved past each completion before it is handed on, as
+// complete may resume tasks that queue more reads.  a read that was
+// interrupted is made again
+
+const int IoRing::reap()
+{
+  int n = 0;
+  unsigned head = *cqHead;
+  while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+    {
+      struct io_uring_cqe* cqe = &cqes[head & cqMask];
+      IoOp* op = (IoOp*) cqe->user_data;
+      int res = cqe->res;
+      __atomic_store_n(cqHead, ++head, __ATOMIC_RELEASE);
+      inFlight--;
+      if (res == -EINTR || res == -EAGAIN)
+        {
+          queued.push_front(op);
+          continue;
+        }
+      reads.add();
+      op->complete(res);
+      n++;
+      head = *cqHead;
+    }
+  return n;
+}
+
+
+void IoRing::poll(const bool wait)
+{
+  if (!isAsync())
+    {
+      vector<pair<IoOp*, int> > done;
+      done.swap(finished);
+      for (size_t i = 0; i < done.size(); i++)
+        {
+          reads.add();
+          done[i].first->complete(done[i].second);
+        }
+      return;
+    }
+
+  while (!queued.empty() && unsubmitted < sqEntries
+         && unsubmitted + inFlight < cqEntries)
+    {
+      submit(queued.front());
+      queued.pop_front();
+    }
+
+  // completions already there are taken without waiting for more
+  bool ready = *cqHead != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+  unsigned minComplete = (wait && !ready && unsubmitted + inFlight > 0) ? 1 : 0;
+  if (unsubmitted > 0 || minComplete > 0)
+    {
+      int n;
+      do
+        {
+          enters.add();
+          n = ioUringEnter(ringFd, unsubmitted, minComplete,
+                           minComplete ? IORING_ENTER_GETEVENTS : 0);
+        }
+      while (n < 0 && errno == EINTR);
+
+      // a kernel short of room for completions takes nothing; the
+      // reads are handed over by the next poll, once these are reaped.
+      // any other failure fails the reads waiting to be handed over,
+      // which would otherwise be polled for ever
+      if (n > 0)
+        {
+          unsubmitted -= n;
+          inFlight += n;
+        }
+      else if (n < 0 && unsubmitted > 0
+               && !((errno == EAGAIN || errno == EBUSY) && inFlight > 0))
+        failUnsubmitted(-errno);
+    }
+  reap();
+}
+
+
+// the kernel took none of the entries, so the tail can be moved back
+// over them before their reads are completed with res
+
+void IoRing::failUnsubmitted(const int res)
+{
+  vector<IoOp*> failed;
+  unsigned tail = *sqTail;
+  for (unsigned k = tail - unsubmitted; k != tail; k++)
+    failed.push_back((IoOp*) sqes[sqArray[k & sqMask]].user_data);
+  __atomic_store_n(sqTail, tail - unsubmitted, __ATOMIC_RELEASE);
+  unsubmitted = 0;
+
+  for (size_t i = 0; i < failed.size(); i++)
+    {
+      reads.add();
+      failed[i]->complete(res);
+    }
+}
+
+
+void IoRing::run()
+{
+  while (pending() > 0) poll(true);
+}
+
+
+void IoRing::waitFor(const File* file)
+{
+  map<pair<const File*, int>, PageRead*>::iterator r;
+  while ((r = pageReads.lower_bound(make_pair(file, 0))) != pageReads.end()
+         && r->first.first == file)
+    poll(true);
+}
+
+
+const Status IoRing::wait(IoTask & task)
+{
+  task.start();
+  while (!task.done())
+    {
+      if (pending() == 0) return IOIDLE;
+      poll(true);
+    }
+  return task.status();
+}
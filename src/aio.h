@@ -0,0 +1,211 @@
+#ifndef AIO_H
+#define AIO_H
+
+#include <sys/types.h>
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <map>
+#include <vector>
+#include "error.h"
+#include "stats.h"
+using namespace std;
+
+// reads an IoRing hands to the kernel at once.  more are queued and
+// handed over as the ones in flight complete
+const int IORINGENTRIES = 256;
+
+class File;
+class PageRead;
+
+// A coroutine with a Status result.  A task does not run until it is
+// started or awaited.  It then runs until it has to wait for a read,
+// and goes on when an IoRing (see below) completes the read, on the
+// thread polling the ring.  co_await of a task in another task runs
+// it and gives its Status once it is done, and IoRing::wait does the
+// same from code that is not a coroutine.
+//
+// The parameters a task takes by reference have to outlive it, and a
+// task must not be destroyed while it waits for a read.
+class IoTask
+{
+public:
+  struct promise_type
+  {
+    Status  status = OK;
+    bool    started = false;
+    std::coroutine_handle<> waiter;    // task awaiting this one, if any
+
+    IoTask get_return_object()
+      {
+        return IoTask(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+
+    // a task that is done goes on with the one awaiting it
+    struct FinalAwait
+    {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<promise_type> h) noexcept
+        {
+          if (h.promise().waiter) return h.promise().waiter;
+          return std::noop_coroutine();
+        }
+      void await_resume() noexcept {}
+    };
+    FinalAwait final_suspend() noexcept { return {}; }
+
+    void return_value(const Status s) { status = s; }
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  IoTask(IoTask && other) noexcept : h(other.h) { other.h = nullptr; }
+  IoTask(const IoTask &) = delete;
+  IoTask & operator=(const IoTask &) = delete;
+  ~IoTask() { if (h) h.destroy(); }
+
+  // run the task until it first has to wait, if it has not run yet
+  void start()
+    {
+      if (done() || h.promise().started) return;
+      h.promise().started = true;
+      h.resume();
+    }
+  const bool done() const { return !h || h.done(); }
+  const Status status() const  // of a task that is done
+    {
+      return h ? h.promise().status : OK;
+    }
+
+  bool await_ready() const { return done(); }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> w)
+    {
+      h.promise().waiter = w;
+      if (h.promise().started) return std::noop_coroutine();
+      h.promise().started = true;
+      return h;
+    }
+  Status await_resume() const { return status(); }
+
+private:
+  std::coroutine_handle<promise_type> h;
+
+  IoTask(std::coroutine_handle<promise_type> h_) : h(h_) {}
+};
+
+// a read handed to an IoRing.  the ring calls complete on the thread
+// polling it once the read is done, with the bytes read or -errno
+class IoOp
+{
+  friend class IoRing;
+public:
+  virtual ~IoOp() {}
+
+protected:
+  virtual void complete(const int res) = 0;
+
+private:
+  int     fd;              // the read, kept until it is handed over
+  void*   buf;
+  unsigned length;
+  off_t   offset;
+};
+
+// Reads in flight through io_uring, for one thread.
+//
+// read() queues a read, and poll() hands the queued reads to the
+// kernel and calls complete for the ones that are done, which resumes
+// the tasks waiting for them.  A single thread can thus keep hundreds
+// of reads in flight for as many tasks, such as scans using
+// HeapFileScan::scanNextAsync.  The submission and completion queues
+// are shared with the kernel, so handing over any number of reads and
+// collecting their completions costs one io_uring_enter call.
+//
+// A kernel without io_uring (or one that does not let the process use
+// it) makes the ring fall back to reading synchronously in read(),
+// with complete still only called by poll().  Reads the kernel will
+// not take are completed with -errno, so the tasks waiting for them
+// fail rather than wait for ever.
+//
+// A ring must only be used by one thread at a time.  A task the ring
+// resumed may poll it again, to wait for a read of its own say, as
+// long as it does not wait for itself.
+class IoRing
+{
+  friend class BufMgr;
+  friend class PageRead;
+public:
+  IoRing(const int entries = IORINGENTRIES);
+  ~IoRing();               // waits for the reads in flight
+
+  // true if reads go through io_uring
+  const bool isAsync() const { return ringFd >= 0; }
+
+  // queue a read of length bytes at offset of unix file fd into buf.
+  // op is told when it is done and has to stay until then
+  void read(const int fd, void* buf, const unsigned length,
+            const off_t offset, IoOp* op);
+
+  // hand the queued reads to the kernel and complete the reads that
+  // are done, waiting for one if wait is true and none is done yet
+  void poll(const bool wait = true);
+
+  // poll until no reads are left
+  void run();
+
+  // poll until no page of file is being read through the ring
+  void waitFor(const File* file);
+
+  // start task if it has not started yet and poll until it is done.
+  // returns its Status, or IOIDLE if it waits for something other
+  // than a read of this ring
+  const Status wait(IoTask & task);
+
+  const int pending() const  // reads queued, in flight or done but
+  {                          // not completed yet
+    return queued.size() + unsubmitted + inFlight + finished.size();
+  }
+
+  StatCounter reads;       // reads completed
+  StatCounter enters;      // io_uring_enter calls
+
+private:
+  int       ringFd;        // the io_uring, -1 if there is none
+  void*     sqMap;         // mappings of the queues shared with the
+  size_t    sqMapLength;   // kernel
+  void*     cqMap;
+  size_t    cqMapLength;
+  void*     sqeMap;
+  size_t    sqeMapLength;
+
+  unsigned* sqHead;        // submission queue
+  unsigned* sqTail;
+  unsigned  sqMask;
+  unsigned  sqEntries;
+  unsigned* sqArray;
+  struct io_uring_sqe* sqes;
+
+  unsigned* cqHead;        // completion queue
+  unsigned* cqTail;
+  unsigned  cqMask;
+  unsigned  cqEntries;
+  struct io_uring_cqe* cqes;
+
+  deque<IoOp*> queued;     // reads waiting for room in the queues
+  unsigned  unsubmitted;   // reads in the submission queue
+  unsigned  inFlight;      // reads handed to the kernel
+  vector<pair<IoOp*, int> > finished; // reads done synchronously
+
+  // pages being read through the ring, so that a second read of a
+  // page waits for the first one rather than reading it again
+  map<pair<const File*, int>, PageRead*> pageReads;
+
+  const bool setup(const int entries);   // open the io_uring
+  void teardown();                        // and close it
+  void submit(IoOp* op);                  // put op in the submission queue
+  void failUnsubmitted(const int res);    // complete those with res
+  const int reap();                       // complete the reads that are done
+};
+
+#endif
@@ -0,0 +1,522 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include "heapfile.h"
+#include "buf.h"
+
+// Benchmarks of the buffer manager and heap files.  Every benchmark
+// runs on a fresh pool of -frames frames and prints one result line,
+// as CSV (the default) or, with -json, as one JSON object per line,
+// on standard output.  whatever the library prints goes to standard
+// error instead.
+// All random choices come from -seed, so two runs with the same
+// parameters do the same work.
+//
+//   bench [-frames n] [-recsize bytes] [-records n] [-threads n]
+//         [-ops n] [-seed n] [-only name] [-json]
+
+// globals
+DB db;
+BufMgr* bufMgr;
+
+struct Params
+{
+  int frames;           // frames in the pool
+  int recSize;          // bytes per record, at least sizeof(int)
+  int records;          // records in the heap file
+  int threads;          // threads of the benchmarks that run several
+  long ops;             // operations of the micro benchmarks
+  unsigned seed;        // seed of all random choices
+  const char* only;     // run just this benchmark, or all if NULL
+  bool json;            // print JSON rather than CSV
+};
+
+static Params params = { 1000, 100, 100000, 1, 1000000, 1, NULL, false };
+
+static const char* pageFile = "bench.pages";
+static const char* heapFile = "bench.heap";
+static const char* paxFile = "bench.pax";   // the same with the PAX layout
+
+// one line of output
+struct Result
+{
+  const char* name;
+  int threads;
+  long ops;             // operations done
+  double seconds;       // wall clock time they took
+  long hits, misses;    // of the pool, see PoolStats
+  int diskreads, diskwrites;
+};
+
+static void printHeader()
+{
+  if (!params.json)
+    printf("name,frames,recsize,records,threads,ops,seconds,ops_per_sec,"
+           "hits,misses,diskreads,diskwrites\n");
+}
+
+static void printResult(const Result & r)
+{
+  char line[512];
+  double rate = r.seconds > 0 ? r.ops / r.seconds : 0;
+  if (params.json)
+    snprintf(line, sizeof line,
+             "{\"name\": \"%s\", \"frames\": %d, \"recsize\": %d, "
+             "\"records\": %d, \"threads\": %d, \"ops\": %ld, "
+             "\"seconds\": %.6f, \"ops_per_sec\": %.1f, \"hits\": %ld, "
+             "\"misses\": %ld, \"diskreads\": %d, \"diskwrites\": %d}",
+             r.name, params.frames, params.recSize, params.records,
+             r.threads, r.ops, r.seconds, rate, r.hits, r.misses,
+             r.diskreads, r.diskwrites);
+  else
+    snprintf(line, sizeof line, "%s,%d,%d,%d,%d,%ld,%.6f,%.1f,%ld,%ld,%d,%d",
+             r.name, params.frames, params.recSize, params.records,
+             r.threads, r.ops, r.seconds, rate, r.hits, r.misses,
+             r.diskreads, r.diskwrites);
+  printf("%s\n", line);
+  fflush(stdout);
+}
+
+static bool wanted(const char* name)
+{
+  return params.only == NULL || strcmp(params.only, name) == 0;
+}
+
+static void check(const Status status, const char* what)
+{
+  if (status == OK) return;
+  Error error;
+  cerr << "bench: " << what << " failed" << endl;
+  error.print(status);
+  exit(1);
+}
+
+// empty the pool before a benchmark: files that linger after their
+// last close are really closed, so their pages leave the pool
+static void resetPool()
+{
+  db.setLingerLimit(0);
+  db.setLingerLimit(LINGERFILES);
+  bufMgr->clearBufStats();
+  bufMgr->clearPoolStats();
+}
+
+// times body, which uses threads threads and returns the number of
+// operations it did, and prints the result together with what the
+// pool did meanwhile if the benchmark was asked for
+static void run(const char* name, const int threads,
+                const std::function<long()> & body)
+{
+  bufMgr->clearBufStats();
+  bufMgr->clearPoolStats();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  long ops = body();
+  std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+  if (!wanted(name)) return;
+
+  Result r;
+  r.name = name;
+  r.threads = threads;
+  r.ops = ops;
+  r.seconds = took.count();
+  r.hits = bufMgr->getPoolStats().hits.get();
+  r.misses = bufMgr->getPoolStats().misses.get();
+  r.diskreads = bufMgr->getBufStats().diskreads;
+  r.diskwrites = bufMgr->getBufStats().diskwrites;
+  printResult(r);
+}
+
+// runs fn(t) for t = 0 .. threads-1, each on a thread of its own
+static void parallel(const int threads, const std::function<void(const int)> & fn)
+{
+  vector<std::thread> workers;
+  for (int t = 0; t < threads; t++) workers.push_back(std::thread(fn, t));
+  for (int t = 0; t < threads; t++) workers[t].join();
+}
+
+
+// readPage and unPinPage of pages that are all resident, at random
+static void benchReadHit(File* file, const vector<int> & pageNos)
+{
+  int pages = pageNos.size() < (size_t) params.frames / 2
+            ? pageNos.size() : params.frames / 2;
+  for (int i = 0; i < pages; i++)
+    {
+      Page* page;
+      check(bufMgr->readPage(file, pageNos[i], page), "readPage");
+      check(bufMgr->unPinPage(file, pageNos[i], false), "unPinPage");
+    }
+
+  long each = params.ops / params.threads;
+  run("readpage_hit", params.threads, [&]() {
+    parallel(params.threads, [&](const int t) {
+      std::mt19937 rng(params.seed + t);
+      for (long k = 0; k < each; k++)
+        {
+          int pageNo = pageNos[rng() % pages];
+          Page* page;
+          check(bufMgr->readPage(file, pageNo, page), "readPage");
+          check(bufMgr->unPinPage(file, pageNo, false), "unPinPage");
+        }
+    });
+    return each * params.threads;
+  });
+}
+
+// readPage of the pages of a file four times as large as the pool, in
+// a cycle, so that the clock finds each page evicted before it comes
+// round again
+static void benchReadMiss(File* file, const vector<int> & pageNos)
+{
+  long each = params.ops / 10 / params.threads;
+  run("readpage_miss", params.threads, [&]() {
+    parallel(params.threads, [&](const int t) {
+      size_t i = t * pageNos.size() / params.threads;
+      for (long k = 0; k < each; k++, i = (i + 1) % pageNos.size())
+        {
+          Page* page;
+          check(bufMgr->readPage(file, pageNos[i], page), "readPage");
+          check(bufMgr->unPinPage(file, pageNos[i], false), "unPinPage");
+        }
+    });
+    return each * params.threads;
+  });
+}
+
+// one task of benchReadMissAsync: readPageAsync and unPinPage of count
+// pages of the cycle, every readers-th one from entry first on
+static IoTask readCycle(IoRing& io, File* file, const vector<int> & pageNos,
+                        size_t first, const int readers, const long count)
+{
+  size_t i = first;
+  for (long k = 0; k < count; k++, i = (i + readers) % pageNos.size())
+    {
+      Page* page;
+      Status status = co_await bufMgr->readPageAsync(file, pageNos[i], page, io);
+      if (status == OK) status = bufMgr->unPinPage(file, pageNos[i], false);
+      if (status != OK) co_return status;
+    }
+  co_return OK;
+}
+
+// the same cycle as benchReadMiss, but every thread keeps up to 32
+// reads in flight through an IoRing of its own, each read by a task
+static void benchReadMissAsync(File* file, const vector<int> & pageNos)
+{
+  int readers = params.frames / 4 / params.threads;
+  if (readers > 32) readers = 32;
+  if (readers < 1) readers = 1;
+  long each = params.ops / 10 / params.threads / readers;
+  run("readpage_miss_async", params.threads, [&]() {
+    parallel(params.threads, [&](const int t) {
+      IoRing io;
+      vector<IoTask> tasks;
+      size_t first = t * pageNos.size() / params.threads;
+      for (int r = 0; r < readers; r++)
+        tasks.push_back(readCycle(io, file, pageNos, first + r, readers, each));
+      for (int r = 0; r < readers; r++) tasks[r].start();
+      io.run();
+      for (int r = 0; r < readers; r++) check(tasks[r].status(), "readPageAsync");
+    });
+    return each * readers * params.threads;
+  });
+}
+
+// lookups of BufHashTbl entries under their partition latches, and
+// removing and inserting them again.  the table holds as many entries
+// as the pool has frames
+static void benchHash(File* file)
+{
+  int entries = params.frames;
+  BufHashTbl table(entries);
+  for (int i = 0; i < entries; i++)
+    check(table.insert(file, i + 1, i), "insert");
+
+  long each = params.ops / params.threads;
+  run("hash_lookup", params.threads, [&]() {
+    parallel(params.threads, [&](const int t) {
+      std::mt19937 rng(params.seed + t);
+      for (long k = 0; k < each; k++)
+        {
+          int pageNo = rng() % entries + 1;
+          int frameNo;
+          std::lock_guard<std::mutex> guard(table.latch(file, pageNo));
+          check(table.lookup(file, pageNo, frameNo), "lookup");
+        }
+    });
+    return each * params.threads;
+  });
+
+  // each thread moves entries of its own, so that a remove is always
+  // followed by an insert of the same entry
+  run("hash_remove_insert", params.threads, [&]() {
+    parallel(params.threads, [&](const int t) {
+      std::mt19937 rng(params.seed + t);
+      for (long k = 0; k < each; k++)
+        {
+          int i = (rng() % (entries / params.threads)) * params.threads + t;
+          std::lock_guard<std::mutex> guard(table.latch(file, i + 1));
+          check(table.remove(file, i + 1), "remove");
+          check(table.insert(file, i + 1, i), "insert");
+        }
+    });
+    return 2 * each * params.threads;
+  });
+}
+
+// the micro benchmarks of the buffer manager, on a file of pages that
+// holds four times as many pages as the pool
+static void benchBufMgr()
+{
+  if (!wanted("readpage_hit") && !wanted("readpage_miss")
+      && !wanted("readpage_miss_async") && !wanted("hash_lookup") && !wanted("hash_remove_insert"))
+    return;
+
+  File* file;
+  vector<int> pageNos;
+  db.destroyFile(pageFile);
+  check(db.createFile(pageFile), "createFile");
+  check(db.openFile(pageFile, file), "openFile");
+  for (int i = 0; i < 4 * params.frames; i++)
+    {
+      int pageNo;
+      Page* page;
+      check(bufMgr->allocPage(file, pageNo, page), "allocPage");
+      page->init(pageNo, file->getPageSize());
+      check(bufMgr->unPinPage(file, pageNo, true), "unPinPage");
+      pageNos.push_back(pageNo);
+    }
+  check(bufMgr->flushFile(file), "flushFile");
+
+  resetPool();
+  if (wanted("readpage_hit")) benchReadHit(file, pageNos);
+  check(bufMgr->flushFile(file), "flushFile");
+  if (wanted("readpage_miss")) benchReadMiss(file, pageNos);
+  check(bufMgr->flushFile(file), "flushFile");
+  if (wanted("readpage_miss_async")) benchReadMissAsync(file, pageNos);
+  if (wanted("hash_lookup") || wanted("hash_remove_insert")) benchHash(file);
+
+  check(db.closeFile(file), "closeFile");
+  check(db.destroyFile(pageFile), "destroyFile");
+}
+
+
+// fills rec with record i: its key, then filler
+static void makeRecord(char* rec, const int i)
+{
+  memset(rec, 'a' + i % 26, params.recSize);
+  memcpy(rec, &i, sizeof i);
+}
+
+// the RIDs of the records of the heap file, in file order
+static void collectRids(vector<RID> & rids)
+{
+  Status status;
+  RID rid;
+  rids.clear();
+  HeapFileScan scan(heapFile, status);
+  check(status, "HeapFileScan");
+  check(scan.startScan(0, 0, STRING, NULL, EQ), "startScan");
+  while ((status = scan.scanNext(rid)) == OK) rids.push_back(rid);
+}
+
+// insertRecord of -records records into an empty heap file.  with
+// the PAX layout the key and the filler are columns of their own
+static void benchInsert(const char* name, const char* fileName,
+                        const bool pax)
+{
+  Status status;
+  vector<char> rec(params.recSize);
+  AttrRange cols[2] = { { 0, sizeof(int) },
+                        { sizeof(int), params.recSize - (int) sizeof(int) } };
+
+  destroyHeapFile(fileName);
+  check(createHeapFile(fileName, PAGESIZE, pax ? cols : NULL,
+                       !pax ? 0 : cols[1].length > 0 ? 2 : 1),
+        "createHeapFile");
+  resetPool();
+  run(name, 1, [&]() {
+    InsertFileScan insert(fileName, status);
+    check(status, "InsertFileScan");
+    for (int i = 0; i < params.records; i++)
+      {
+        Record r = { &rec[0], params.recSize };
+        RID rid;
+        makeRecord(&rec[0], i);
+        check(insert.insertRecord(r, rid), "insertRecord");
+      }
+    return (long) params.records;
+  });
+}
+
+// every thread scans the whole file, keeping the records whose key
+// passes filter (all of them if filter is NULL)
+static void benchScan(const char* name, const char* fileName,
+                      const int* filter)
+{
+  resetPool();
+  run(name, params.threads, [&]() {
+    parallel(params.threads, [&](const int t) {
+      Status status;
+      RID rid;
+      Record rec;
+      HeapFileScan scan(fileName, status);
+      check(status, "HeapFileScan");
+      if (filter)
+        check(scan.startScan(0, sizeof(int), INTEGER, (const char*) filter, GTE),
+              "startScan");
+      else
+        check(scan.startScan(0, 0, STRING, NULL, EQ), "startScan");
+      while ((status = scan.scanNext(rid)) == OK)
+        check(scan.getRecord(rec), "getRecord");
+      check(status == FILEEOF ? OK : status, "scanNext");
+    });
+    return (long) params.records * params.threads;
+  });
+}
+
+// getRecord of records picked at random from the whole file
+static void benchGetRecord()
+{
+  vector<RID> rids;
+  collectRids(rids);
+  if (rids.empty()) return;
+
+  resetPool();
+  long each = params.ops / params.threads;
+  run("getrecord_random", params.threads, [&]() {
+    parallel(params.threads, [&](const int t) {
+      Status status;
+      Record rec;
+      HeapFile file(heapFile, status);
+      check(status, "HeapFile");
+      std::mt19937 rng(params.seed + t);
+      for (long k = 0; k < each; k++)
+        check(file.getRecord(rids[rng() % rids.size()], rec), "getRecord");
+    });
+    return each * params.threads;
+  });
+}
+
+// a delete-heavy workload: rounds of deleting a random half of the
+// records through a scan and inserting as many new ones, after
+// which the file holds -records records again.  deletes and inserts
+// count as one operation each
+static void benchDelete()
+{
+  const int rounds = 4;
+  Status status;
+  vector<char> rec(params.recSize);
+  std::mt19937 rng(params.seed);
+  int next = params.records;
+
+  resetPool();
+  run("delete_insert", 1, [&]() {
+    long ops = 0;
+    for (int round = 0; round < rounds; round++)
+      {
+        int deleted = 0;
+        {
+          HeapFileScan scan(heapFile, status);
+          check(status, "HeapFileScan");
+          check(scan.startScan(0, 0, STRING, NULL, EQ), "startScan");
+          RID rid;
+          while ((status = scan.scanNext(rid)) == OK)
+            if (rng() % 2 == 0)
+              {
+                check(scan.deleteRecord(), "deleteRecord");
+                deleted++;
+              }
+        }
+        InsertFileScan insert(heapFile, status);
+        check(status, "InsertFileScan");
+        for (int i = 0; i < deleted; i++)
+          {
+            Record r = { &rec[0], params.recSize };
+            RID rid;
+            makeRecord(&rec[0], next++);
+            check(insert.insertRecord(r, rid), "insertRecord");
+          }
+        ops += 2 * deleted;
+      }
+    return ops;
+  });
+}
+
+// the benchmarks of heap files, which share one file of -records
+// records made by the insert benchmark
+static void benchHeapFile()
+{
+  int quarter = params.records - params.records / 4;
+  if (wanted("insert") || wanted("scan_full") || wanted("scan_filtered")
+      || wanted("getrecord_random") || wanted("delete_insert"))
+    {
+      // the file is needed by all of them; run() only prints the
+      // insert line if it was asked for
+      benchInsert("insert", heapFile, false);
+
+      if (wanted("scan_full")) benchScan("scan_full", heapFile, NULL);
+      if (wanted("scan_filtered"))
+        benchScan("scan_filtered", heapFile, &quarter);
+      if (wanted("getrecord_random")) benchGetRecord();
+      if (wanted("delete_insert")) benchDelete();
+
+      check(destroyHeapFile(heapFile), "destroyHeapFile");
+    }
+
+  // the filtered scan again on the PAX layout, where it only reads
+  // the key column of each page
+  if (wanted("insert_pax") || wanted("scan_filtered_pax"))
+    {
+      benchInsert("insert_pax", paxFile, true);
+      if (wanted("scan_filtered_pax"))
+        benchScan("scan_filtered_pax", paxFile, &quarter);
+      check(destroyHeapFile(paxFile), "destroyHeapFile");
+    }
+}
+
+
+static void usage()
+{
+  cerr << "usage: bench [-frames n] [-recsize bytes] [-records n]"
+       << " [-threads n] [-ops n] [-seed n] [-only name] [-json]" << endl;
+  exit(2);
+}
+
+int main(int argc, char **argv)
+{
+  for (int i = 1; i < argc; i++)
+    {
+      bool more = i + 1 < argc;
+      if (strcmp(argv[i], "-json") == 0) params.json = true;
+      else if (!more) usage();
+      else if (strcmp(argv[i], "-frames") == 0) params.frames = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-recsize") == 0) params.recSize = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-records") == 0) params.records = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-threads") == 0) params.threads = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-ops") == 0) params.ops = atol(argv[++i]);
+      else if (strcmp(argv[i], "-seed") == 0) params.seed = atoi(argv[++i]);
+      else if (strcmp(argv[i], "-only") == 0) params.only = argv[++i];
+      else usage();
+    }
+  // hash_remove_insert gives each thread entries of its own, and the
+  // hash table has an entry for each frame
+  if (params.frames < 16 || params.threads > params.frames
+      || params.recSize < (int) sizeof(int)
+      || params.recSize > (int) pageDataSize(PAGESIZE) - (int) sizeof(slot_t)
+      || params.records < 1 || params.threads < 1 || params.ops < 1)
+    usage();
+
+  cout.rdbuf(cerr.rdbuf());
+  bufMgr = new BufMgr(params.frames);
+  printHeader();
+  benchBufMgr();
+  benchHeapFile();
+  db.setLingerLimit(0);
+  delete bufMgr;
+  return 0;
+}
@@ -0,0 +1,671 @@
+#include <climits>
+#include <algorithm>
+#include "btree.h"
+#include "error.h"
+
+// B+-tree indexes on heap files, see btree.h
+
+// bounds below and above all RIDs, to find the first or the last
+// entry with a key
+static const RID MINRID = {INT_MIN, INT_MIN};
+static const RID MAXRID = {INT_MAX, INT_MAX};
+
+// largest entry of any node
+static const int MAXENTRYSIZE = MAXKEYSIZE + sizeof(RID) + sizeof(int);
+
+// name of index k of heap file heapName
+const string indexFileName(const string & heapName, const int k)
+{
+  return heapName + ".idx" + to_string(k);
+}
+
+// create an empty index: a header page and a root leaf
+const Status BTreeIndex::create(const string & name, const unsigned pageSize,
+                                const int offset, const int length,
+                                const Datatype type)
+{
+  Status  status;
+  File*   file;
+  Page*   page;
+  int     hdrPageNo, rootPageNo;
+
+  if (offset < 0 || length < 1 || length > MAXKEYSIZE ||
+      (type != STRING && length != sizeof(int))) {
+    return BADINDEXPARM;
+  }
+
+  status = db.createFile(name, pageSize);
+  if (status!=OK) {
+    return status;
+  }
+  status = db.openFile(name, file);
+  if (status!=OK) {
+    return status;
+  }
+
+  status = bufMgr->allocPage(file, hdrPageNo, page);
+  if (status!=OK) {
+    db.closeFile(file);
+    return status;
+  }
+  BTreeHdr* hdr = (BTreeHdr*) page;
+
+  status = bufMgr->allocPage(file, rootPageNo, page);
+  if (status!=OK) {
+    bufMgr->unPinPage(file, hdrPageNo, false);
+    db.closeFile(file);
+    return status;
+  }
+  BTreeNode* root = (BTreeNode*) page;
+  root->level = 0;
+  root->count = 0;
+  root->next = -1;
+  root->first = -1;
+
+  hdr->rootPageNo = rootPageNo;
+  hdr->height = 1;
+  hdr->keyOffset = offset;
+  hdr->keyLength = length;
+  hdr->keyType = type;
+  hdr->entryCnt = 0;
+
+  status = bufMgr->unPinPage(file, rootPageNo, true);
+  Status s = bufMgr->unPinPage(file, hdrPageNo, true);
+  if (status == OK) status = s;
+  s = db.closeFile(file);
+  return (status != OK) ? status : s;
+}
+
+// open the index file and pin its header
+BTreeIndex::BTreeIndex(const string & name, Status& returnStatus,
+                       const int mode)
+{
+  Page* page;
+
+  hdr = NULL;
+  hdrDirty = false;
+  cursor.leafPageNo = -1;
+  cursor.pos = 0;
+  marked = cursor;
+
+  returnStatus = db.openFile(name, file, mode);
+  if (returnStatus!=OK) {
+    file = NULL;
+    return;
+  }
+  returnStatus = file->getFirstPage(hdrPageNo);
+  if (returnStatus == OK)
+    returnStatus = bufMgr->readPage(file, hdrPageNo, page);
+  if (returnStatus!=OK) {
+    return;
+  }
+  hdr = (BTreeHdr*) page;
+
+  leafSize = hdr->keyLength + sizeof(RID);
+  innerSize = leafSize + sizeof(int);
+  leafCap = (file->getPageSize() - sizeof(BTreeNode)) / leafSize;
+  innerCap = (file->getPageSize() - sizeof(BTreeNode)) / innerSize;
+}
+
+BTreeIndex::~BTreeIndex()
+{
+  if (file == NULL) return;
+  if (hdr != NULL) {
+    Status status = bufMgr->unPinPage(file, hdrPageNo, hdrDirty);
+    if (status != OK) cerr << "error in unpin of index header page\n";
+  }
+  Status status = db.closeFile(file);
+  if (status != OK) {
+    cerr << "error in closefile call\n";
+    Error e;
+    e.print (status);
+  }
+}
+
+// copy the key of rec into key, false if rec is too short to have one
+bool BTreeIndex::keyOf(const Record & rec, char* key) const
+{
+  if (hdr->keyOffset + hdr->keyLength > rec.length) return false;
+  memcpy(key, (char*) rec.data + hdr->keyOffset, hdr->keyLength);
+  return true;
+}
+
+// an update need not touch the index if the key stays the same
+bool BTreeIndex::sameKey(const Record & a, const Record & b) const
+{
+  char keyA[MAXKEYSIZE], keyB[MAXKEYSIZE];
+  bool hasA = keyOf(a, keyA), hasB = keyOf(b, keyB);
+  if (!hasA || !hasB) return hasA == hasB;
+  return memcmp(keyA, keyB, hdr->keyLength) == 0;
+}
+
+// the keys of the records that satisfy p.  strings are compared as
+// by the predicate, up to the first null or keyLength bytes, so a
+// filter zero padded to keyLength compares the same
+void BTreeIndex::boundsOf(const Predicate & p, BTreeBounds & b) const
+{
+  b.hasLow = b.hasHigh = false;
+  b.lowIncl = b.highIncl = true;
+  if (!p.filter) return;
+
+  char key[MAXKEYSIZE];
+  if (hdr->keyType == STRING) strncpy(key, p.filter, hdr->keyLength);
+  else if (hdr->keyType == INTEGER) memcpy(key, &p.intValue, sizeof(int));
+  else memcpy(key, &p.floatValue, sizeof(float));
+
+  b.hasLow = (p.op == GT || p.op == GTE || p.op == EQ);
+  b.lowIncl = (p.op != GT);
+  b.hasHigh = (p.op == LT || p.op == LTE || p.op == EQ);
+  b.highIncl = (p.op != LT);
+  memcpy(b.low, key, hdr->keyLength);
+  memcpy(b.high, key, hdr->keyLength);
+}
+
+int BTreeIndex::compareKeys(const char* a, const char* b) const
+{
+  if (hdr->keyType == STRING) return strncmp(a, b, hdr->keyLength);
+  if (hdr->keyType == INTEGER) {
+    int x, y;
+    memcpy(&x, a, sizeof x);
+    memcpy(&y, b, sizeof y);
+    return (x > y) - (x < y);
+  }
+  float x, y;
+  memcpy(&x, a, sizeof x);
+  memcpy(&y, b, sizeof y);
+  return (x > y) - (x < y);
+}
+
+// compare (key, rid) with entry e, by key and then by RID
+int BTreeIndex::compare(const char* key, const RID & rid, const char* e) const
+{
+  int c = compareKeys(key, e);
+  if (c != 0) return c;
+  RID erid;
+  memcpy(&erid, e + hdr->keyLength, sizeof(RID));
+  if (rid.pageNo != erid.pageNo) return (rid.pageNo > erid.pageNo) ? 1 : -1;
+  return (rid.slotNo > erid.slotNo) - (rid.slotNo < erid.slotNo);
+}
+
+int BTreeIndex::lowerBound(BTreeNode* node, const char* key,
+                           const RID & rid) const
+{
+  int lo = 0, hi = node->count;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    if (compare(key, rid, entry(node, mid)) > 0) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+int BTreeIndex::childAt(BTreeNode* node, const int i) const
+{
+  if (i == 0) return node->first;
+  int child;
+  memcpy(&child, entry(node, i - 1) + leafSize, sizeof(int));
+  return child;
+}
+
+// the number of separators at or below (key, rid)
+int BTreeIndex::childPos(BTreeNode* node, const char* key,
+                         const RID & rid) const
+{
+  int i = lowerBound(node, key, rid);
+  if (i < node->count && compare(key, rid, entry(node, i)) == 0) i++;
+  return i;
+}
+
+const Status BTreeIndex::readNode(const int pageNo, BTreeNode*& node)
+{
+  Page* page;
+  Status status = bufMgr->readPage(file, pageNo, page);
+  node = (BTreeNode*) page;
+  return status;
+}
+
+// allocate an empty node, which is left pinned
+const Status BTreeIndex::newNode(const int level, int& pageNo,
+                                 BTreeNode*& node)
+{
+  Page* page;
+  Status status = bufMgr->allocPage(file, pageNo, page);
+  if (status!=OK) {
+    return status;
+  }
+  node = (BTreeNode*) page;
+  node->level = level;
+  node->count = 0;
+  node->next = -1;
+  node->first = -1;
+  return OK;
+}
+
+const Status BTreeIndex::findLeaf(const char* key, const RID & rid,
+                                  int& pageNo, BTreeNode*& node)
+{
+  Status status;
+
+  pageNo = hdr->rootPageNo;
+  while (true) {
+    status = readNode(pageNo, node);
+    if (status!=OK) {
+      return status;
+    }
+    if (node->level == 0) return OK;
+    int child = key ? childAt(node, childPos(node, key, rid)) : node->first;
+    status = bufMgr->unPinPage(file, pageNo, false);
+    if (status!=OK) {
+      return status;
+    }
+    pageNo = child;
+  }
+}
+
+// Add entry e at position pos of node.  If the node is full, its
+// entries and e are divided between it and a new right node.  The
+// first entry of a new leaf is copied up as the separator; for an
+// inner node the middle entry moves up and its child becomes the
+// first child of the new node.
+
+const Status BTreeIndex::addEntry(BTreeNode* node, const int pos,
+                                  const char* e, bool& split, char* sep)
+{
+  Status status;
+  int    size = entrySize(node);
+  int    cap = (node->level == 0) ? leafCap : innerCap;
+
+  split = false;
+  if (node->count < cap) {
+    char* at = entry(node, pos);
+    memmove(at + size, at, (node->count - pos) * size);
+    memcpy(at, e, size);
+    node->count++;
+    return OK;
+  }
+
+  int rightPageNo;
+  BTreeNode* right;
+  status = newNode(node->level, rightPageNo, right);
+  if (status!=OK) {
+    return status;
+  }
+
+  int total = node->count + 1;
+  vector<char> buf(total * size);
+  memcpy(&buf[0], entry(node, 0), pos * size);
+  memcpy(&buf[pos * size], e, size);
+  memcpy(&buf[(pos + 1) * size], entry(node, pos), (node->count - pos) * size);
+
+  int left = total / 2;
+  memcpy(entry(node, 0), &buf[0], left * size);
+  node->count = left;
+  if (node->level == 0) {
+    right->count = total - left;
+    memcpy(entry(right, 0), &buf[left * size], right->count * size);
+    right->next = node->next;
+    node->next = rightPageNo;
+    memcpy(sep, entry(right, 0), leafSize);
+  }
+  else {
+    memcpy(sep, &buf[left * size], leafSize);
+    memcpy(&right->first, &buf[left * size + leafSize], sizeof(int));
+    right->count = total - left - 1;
+    memcpy(entry(right, 0), &buf[(left + 1) * size], right->count * size);
+  }
+  memcpy(sep + leafSize, &rightPageNo, sizeof(int));
+  split = true;
+  return bufMgr->unPinPage(file, rightPageNo, true);
+}
+
+// insert (key, rid) below node pageNo
+const Status BTreeIndex::insertInto(const int pageNo, const char* key,
+                                    const RID & rid, bool& split, char* sep)
+{
+  Status     status;
+  BTreeNode* node;
+  char       e[MAXENTRYSIZE];
+  bool       changed = false;
+
+  split = false;
+  status = readNode(pageNo, node);
+  if (status!=OK) {
+    return status;
+  }
+
+  if (node->level == 0) {
+    int pos = lowerBound(node, key, rid);
+    if (pos < node->count && compare(key, rid, entry(node, pos)) == 0) {
+      status = NONUNIQUEENTRY;
+    }
+    else {
+      memcpy(e, key, hdr->keyLength);
+      memcpy(e + hdr->keyLength, &rid, sizeof(RID));
+      status = addEntry(node, pos, e, split, sep);
+      changed = (status == OK);
+    }
+  }
+  else {
+    int  pos = childPos(node, key, rid);
+    bool childSplit;
+    status = insertInto(childAt(node, pos), key, rid, childSplit, e);
+    if (status == OK && childSplit) {
+      status = addEntry(node, pos, e, split, sep);
+      changed = (status == OK);
+    }
+  }
+
+  Status s = bufMgr->unPinPage(file, pageNo, changed);
+  return (status != OK) ? status : s;
+}
+
+// add the entry of a record.  a split of the root gives the tree a
+// new root above it
+const Status BTreeIndex::insertEntry(const Record & rec, const RID & rid)
+{
+  Status status;
+  char   key[MAXKEYSIZE];
+  char   sep[MAXENTRYSIZE];
+  bool   split;
+
+  if (!keyOf(rec, key)) return OK;
+  status = insertInto(hdr->rootPageNo, key, rid, split, sep);
+  if (status!=OK) {
+    return status;
+  }
+
+  if (split) {
+    int        pageNo;
+    BTreeNode* root;
+    status = newNode(hdr->height, pageNo, root);
+    if (status!=OK) {
+      return status;
+    }
+    root->first = hdr->rootPageNo;
+    memcpy(entry(root, 0), sep, innerSize);
+    root->count = 1;
+    status = bufMgr->unPinPage(file, pageNo, true);
+    if (status!=OK) {
+      return status;
+    }
+    hdr->rootPageNo = pageNo;
+    hdr->height++;
+  }
+  hdr->entryCnt++;
+  hdrDirty = true;
+  return OK;
+}
+
+// remove the entry of a record.  a scan past it moves back with the
+// entries after it
+const Status BTreeIndex::deleteEntry(const Record & rec, const RID & rid)
+{
+  Status     status;
+  char       key[MAXKEYSIZE];
+  int        pageNo;
+  BTreeNode* node;
+
+  if (!keyOf(rec, key)) return OK;
+  status = findLeaf(key, rid, pageNo, node);
+  if (status!=OK) {
+    return status;
+  }
+
+  int pos = lowerBound(node, key, rid);
+  if (pos == node->count || compare(key, rid, entry(node, pos)) != 0) {
+    bufMgr->unPinPage(file, pageNo, false);
+    return RECNOTFOUND;
+  }
+  char* at = entry(node, pos);
+  memmove(at, at + leafSize, (node->count - pos - 1) * leafSize);
+  node->count--;
+  if (cursor.leafPageNo == pageNo && pos < cursor.pos) cursor.pos--;
+
+  hdr->entryCnt--;
+  hdrDirty = true;
+  return bufMgr->unPinPage(file, pageNo, true);
+}
+
+// Build the tree bottom up from the sorted entries of the records:
+// leaves are filled to BULKFILL percent in key order and linked, then
+// each level of inner nodes is built over the one below it until a
+// level has a single node, which becomes the root.
+
+const Status BTreeIndex::bulkLoad(const string & heapName)
+{
+  Status status;
+
+  if (hdr->entryCnt != 0) return BADINDEXPARM;
+
+  // gather the entries
+  vector<char> entries;
+  int cnt = 0;
+  {
+    HeapFileScan scan(heapName, status);
+    if (status!=OK) {
+      return status;
+    }
+    status = scan.startScan(NULL, 0);
+    if (status!=OK) {
+      return status;
+    }
+    RID    rid;
+    Record rec;
+    char   key[MAXKEYSIZE];
+    while ((status = scan.scanNext(rid)) == OK) {
+      status = scan.getRecord(rec);
+      if (status!=OK) {
+        return status;
+      }
+      if (!keyOf(rec, key)) continue;
+      entries.insert(entries.end(), key, key + hdr->keyLength);
+      entries.insert(entries.end(), (char*) &rid, (char*) &rid + sizeof(RID));
+      cnt++;
+    }
+    if (status != FILEEOF) return status;
+  }
+
+  vector<int> order(cnt);
+  for (int k = 0; k < cnt; k++) order[k] = k;
+  std::sort(order.begin(), order.end(), [&](const int a, const int b) {
+    const char* ea = &entries[a * leafSize];
+    RID rid;
+    memcpy(&rid, ea + hdr->keyLength, sizeof(RID));
+    return compare(ea, rid, &entries[b * leafSize]) < 0;
+  });
+
+  // the leaves, starting with the empty root.  pages are the nodes
+  // of the level being built and lows the lowest entry below each
+  vector<int>  pages;
+  vector<char> lows;
+  int          pageNo = hdr->rootPageNo;
+  BTreeNode*   node;
+  int          fill = std::max(1, leafCap * BULKFILL / 100);
+  status = readNode(pageNo, node);
+  if (status!=OK) {
+    return status;
+  }
+  for (int k = 0; k < cnt; k++) {
+    if (node->count == fill) {
+      int        nextNo;
+      BTreeNode* next;
+      status = newNode(0, nextNo, next);
+      if (status!=OK) {
+        bufMgr->unPinPage(file, pageNo, true);
+        return status;
+      }
+      node->next = nextNo;
+      status = bufMgr->unPinPage(file, pageNo, true);
+      if (status!=OK) {
+        return status;
+      }
+      pageNo = nextNo;
+      node = next;
+    }
+    const char* e = &entries[order[k] * leafSize];
+    if (node->count == 0) {
+      pages.push_back(pageNo);
+      lows.insert(lows.end(), e, e + leafSize);
+    }
+    memcpy(entry(node, node->count++), e, leafSize);
+  }
+  status = bufMgr->unPinPage(file, pageNo, cnt > 0);
+  if (status!=OK || cnt == 0) {
+    return status;
+  }
+
+  int level = 0;
+  fill = std::max(2, innerCap * BULKFILL / 100);
+  while (pages.size() > 1) {
+    level++;
+    vector<int>  upPages;
+    vector<char> upLows;
+    for (size_t j = 0; j < pages.size(); ) {
+      status = newNode(level, pageNo, node);
+      if (status!=OK) {
+        return status;
+      }
+      upPages.push_back(pageNo);
+      upLows.insert(upLows.end(), &lows[j * leafSize],
+                    &lows[j * leafSize] + leafSize);
+      node->first = pages[j++];
+      for (; j < pages.size() && node->count < fill; j++) {
+        char* e = entry(node, node->count++);
+        memcpy(e, &lows[j * leafSize], leafSize);
+        memcpy(e + leafSize, &pages[j], sizeof(int));
+      }
+      status = bufMgr->unPinPage(file, pageNo, true);
+      if (status!=OK) {
+        return status;
+      }
+    }
+    pages.swap(upPages);
+    lows.swap(upLows);
+  }
+
+  hdr->rootPageNo = pages[0];
+  hdr->height = level + 1;
+  hdr->entryCnt = cnt;
+  hdrDirty = true;
+  return OK;
+}
+
+// Each node on the way down to (key, rid) narrows down where it is:
+// the entries below child i of a node with n children are taken to
+// be the i-th n-th of the entries below the node.
+const Status BTreeIndex::rank(const char* key, const RID & rid, double & r)
+{
+  Status     status;
+  BTreeNode* node;
+  int        pageNo = hdr->rootPageNo;
+  double     width = 1.0;
+
+  r = 0;
+  while (true) {
+    status = readNode(pageNo, node);
+    if (status!=OK) {
+      return status;
+    }
+    int child = -1;
+    if (node->level == 0) {
+      if (node->count > 0)
+        r += width * lowerBound(node, key, rid) / node->count;
+    }
+    else {
+      int i = childPos(node, key, rid);
+      r += width * i / (node->count + 1);
+      width /= node->count + 1;
+      child = childAt(node, i);
+    }
+    status = bufMgr->unPinPage(file, pageNo, false);
+    if (status!=OK || child == -1) {
+      return status;
+    }
+    pageNo = child;
+  }
+}
+
+const Status BTreeIndex::estimate(const Predicate & p, double & fraction)
+{
+  Status      status;
+  BTreeBounds b;
+  double      low = 0, high = 1;
+
+  fraction = 0;
+  if (hdr->entryCnt == 0) return OK;
+  boundsOf(p, b);
+  if (b.hasLow &&
+      (status = rank(b.low, b.lowIncl ? MINRID : MAXRID, low)) != OK) {
+    return status;
+  }
+  if (b.hasHigh &&
+      (status = rank(b.high, b.highIncl ? MAXRID : MINRID, high)) != OK) {
+    return status;
+  }
+  fraction = (high > low) ? high - low : 0;
+  return OK;
+}
+
+// find the first entry of the scan
+const Status BTreeIndex::startScan(const Predicate & p)
+{
+  Status     status;
+  int        pageNo;
+  BTreeNode* node;
+
+  if (p.filter && p.op == NE) return BADSCANPARM;
+  boundsOf(p, bounds);
+
+  const RID& rid = bounds.lowIncl ? MINRID : MAXRID;
+  status = findLeaf(bounds.hasLow ? bounds.low : NULL, rid, pageNo, node);
+  if (status!=OK) {
+    cursor.leafPageNo = -1;
+    return status;
+  }
+  cursor.leafPageNo = pageNo;
+  cursor.pos = bounds.hasLow ? lowerBound(node, bounds.low, rid) : 0;
+  return bufMgr->unPinPage(file, pageNo, false);
+}
+
+// return the next RID of the scan, going on through the leaves until
+// a key is past the high bound
+const Status BTreeIndex::scanNext(RID & rid)
+{
+  Status     status;
+  BTreeNode* node;
+
+  while (cursor.leafPageNo != -1) {
+    int pageNo = cursor.leafPageNo;
+    status = readNode(pageNo, node);
+    if (status!=OK) {
+      return status;
+    }
+    if (cursor.pos >= node->count) {
+      cursor.leafPageNo = node->next;
+      cursor.pos = 0;
+    }
+    else {
+      const char* e = entry(node, cursor.pos);
+      int c = bounds.hasHigh ? compareKeys(e, bounds.high) : -1;
+      if (c > 0 || (c == 0 && !bounds.highIncl)) {
+        cursor.leafPageNo = -1;
+      }
+      else {
+        memcpy(&rid, e + hdr->keyLength, sizeof(RID));
+        cursor.pos++;
+        return bufMgr->unPinPage(file, pageNo, false);
+      }
+    }
+    status = bufMgr->unPinPage(file, pageNo, false);
+    if (status!=OK) {
+      return status;
+    }
+  }
+  return FILEEOF;
+}
+
+const Status BTreeIndex::endScan()
+{
+  cursor.leafPageNo = -1;
+  return OK;
+}
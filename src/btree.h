@@ -0,0 +1,165 @@
+#ifndef BTREE_H
+#define BTREE_H
+
+#include "heapfile.h"
+
+const int MAXKEYSIZE = 200;       // longest key an index can have
+const int BULKFILL = 90;          // percent of a node filled by a bulk load
+const double INDEXSELECTIVITY = 0.1; // most of a file a range scan may
+                                  // select and still go through the index
+
+// A B+-tree index on one attribute (offset, length, type) of the
+// records of a heap file, mapping attribute values to RIDs.  The index
+// is a file of its own, on the same File and BufMgr page layer as heap
+// files.  Its first page is a BTreeHdr; all other pages are nodes.
+//
+// Entries are ordered by key and then by RID, so every entry is
+// unique even when keys are not, and an entry can be removed exactly.
+// Leaves hold entries and are linked left to right.  An inner node
+// holds separators: child first covers the entries below separator 0
+// and the child of separator i those from separator i on.  Deletes
+// do not merge nodes, so nodes can become underfull or empty.
+//
+// An index is not safe for use by several threads at once.
+
+struct BTreeHdr
+{
+  int   rootPageNo;        // page number of the root node
+  int   height;            // levels of nodes, 1 if the root is a leaf
+  int   keyOffset;         // the attribute indexed
+  int   keyLength;
+  Datatype keyType;
+  int   entryCnt;          // number of entries
+};
+
+struct BTreeNode
+{
+  int   level;             // 0 for leaves, counting up to the root
+  int   count;             // number of entries
+  int   next;              // right sibling of a leaf, -1 if none
+  int   first;             // leftmost child of an inner node
+  // followed by count entries: key bytes, RID, and for inner nodes
+  // the page number of a child
+};
+
+// position of an index scan
+struct BTreeCursor
+{
+  int   leafPageNo;        // leaf the scan is in, -1 when done
+  int   pos;               // next entry of the leaf
+};
+
+// the keys a predicate selects, as bounds that may be left out and
+// may or may not be included
+struct BTreeBounds
+{
+  char  low[MAXKEYSIZE];
+  char  high[MAXKEYSIZE];
+  bool  hasLow, lowIncl;
+  bool  hasHigh, highIncl;
+};
+
+class BTreeIndex
+{
+public:
+  // open an index file
+  BTreeIndex(const string & name, Status& returnStatus, const int mode = 0);
+  ~BTreeIndex();
+
+  // create an empty index on the attribute of records of a heap file
+  // whose pages are pageSize bytes
+  static const Status create(const string & name, const unsigned pageSize,
+                             const int offset, const int length,
+                             const Datatype type);
+
+  // fill an empty index with the records of heap file heapName
+  const Status bulkLoad(const string & heapName);
+
+  // true if the index is on this attribute
+  bool covers(const int offset, const int length, const Datatype type) const
+  {
+    return offset == hdr->keyOffset && length == hdr->keyLength
+        && type == hdr->keyType;
+  }
+
+  // add or remove the entry of record rec, whose RID is rid.  records
+  // too short to have the attribute are not in the index
+  const Status insertEntry(const Record & rec, const RID & rid);
+  const Status deleteEntry(const Record & rec, const RID & rid);
+
+  // true if records a and b have the same entry in the index, or
+  // neither has one
+  bool sameKey(const Record & a, const Record & b) const;
+
+  // estimate the part of the entries whose records satisfy predicate
+  // p, which is on the attribute of the index, from the positions of
+  // the bounds of p in the nodes on the way down to them
+  const Status estimate(const Predicate & p, double & fraction);
+
+  // scan for the RIDs whose records satisfy p, in key order.  p must
+  // be on the attribute of the index and not use NE.  the position of
+  // the scan is kept right across deletes made through this object,
+  // but not across inserts
+  const Status startScan(const Predicate & p);
+  const Status scanNext(RID & rid);   // FILEEOF when there are no more
+  const Status endScan();
+
+  // save and restore the position of the scan
+  void markScan() { marked = cursor; }
+  void resetScan() { cursor = marked; }
+
+private:
+  File*       file;        // the index file
+  int         hdrPageNo;   // page number of the header
+  BTreeHdr*   hdr;         // the header, pinned while the index is open
+  bool        hdrDirty;    // true if the header has been updated
+  int         leafSize;    // bytes of a leaf entry
+  int         innerSize;   // bytes of an inner entry
+  int         leafCap;     // most entries of a leaf
+  int         innerCap;    // most entries of an inner node
+
+  BTreeCursor cursor;      // position of the scan
+  BTreeCursor marked;      // position saved by markScan
+  BTreeBounds bounds;      // and the keys it returns
+
+  const int entrySize(const BTreeNode* node) const
+    { return node->level == 0 ? leafSize : innerSize; }
+  char* entry(BTreeNode* node, const int i) const
+    { return (char*) (node + 1) + i * entrySize(node); }
+
+  bool keyOf(const Record & rec, char* key) const;
+  void boundsOf(const Predicate & p, BTreeBounds & b) const;
+  int compareKeys(const char* a, const char* b) const;
+  int compare(const char* key, const RID & rid, const char* e) const;
+
+  // first entry of node not below (key, rid)
+  int lowerBound(BTreeNode* node, const char* key, const RID & rid) const;
+  // child i of an inner node, 0 being first, and the one whose
+  // entries (key, rid) belongs with
+  int childAt(BTreeNode* node, const int i) const;
+  int childPos(BTreeNode* node, const char* key, const RID & rid) const;
+
+  const Status readNode(const int pageNo, BTreeNode*& node);
+  const Status newNode(const int level, int& pageNo, BTreeNode*& node);
+
+  // find the leaf (key, rid) belongs in, the leftmost leaf if key is
+  // NULL, and leave it pinned
+  const Status findLeaf(const char* key, const RID & rid, int& pageNo,
+                        BTreeNode*& node);
+
+  // part of the entries that are below (key, rid), estimated
+  const Status rank(const char* key, const RID & rid, double & r);
+
+  // add entry e at position pos of node, which is pinned.  a node
+  // that is full is split and the separator for the new right node
+  // returned in sep, with split set
+  const Status addEntry(BTreeNode* node, const int pos, const char* e,
+                        bool& split, char* sep);
+  const Status insertInto(const int pageNo, const char* key, const RID & rid,
+                          bool& split, char* sep);
+};
+
+// name of index k of heap file heapName
+const string indexFileName(const string & heapName, const int k);
+
+#endif
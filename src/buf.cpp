@@ -3,10 +3,17 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <iostream>
 #include <stdio.h>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <vector>
 #include "page.h"
 #include "buf.h"
+#include "log.h"
 
 #define ASSERT(c)  { if (!(c)) { \
 		       cerr << "At line " << __LINE__ << ":" << endl << "  "; \
@@ -15,34 +22,167 @@
 		     } \
                    }
 
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+
+// Set bit n of mask for every NUMA node the system has online, as
+// listed in sysfs ("0-3,6").  returns the highest node plus one, 0 if
+// the list cannot be read.
+
+static int onlineNodes(unsigned long* mask, const int maxNodes)
+{
+    FILE* f = fopen("/sys/devices/system/node/online", "r");
+    if (!f) return 0;
+    int nodes = 0, first, last;
+    char sep;
+    while (fscanf(f, "%d", &first) == 1)
+    {
+        last = first;
+        if (fscanf(f, "%c", &sep) == 1 && sep == '-')
+        {
+            if (fscanf(f, "%d", &last) != 1) break;
+            if (fscanf(f, "%c", &sep) != 1) sep = '\n';
+        }
+        for (int n = first; n <= last && n < maxNodes; n++)
+        {
+            mask[n / (8 * sizeof(long))] |= 1UL << (n % (8 * sizeof(long)));
+            if (n + 1 > nodes) nodes = n + 1;
+        }
+        if (sep != ',') break;
+    }
+    fclose(f);
+    return nodes;
+}
+
+// Map bytes of anonymous memory for the frames of a pool, in huge
+// pages if flags ask for them and the system has them reserved, and
+// otherwise in normal pages that the kernel may back with transparent
+// huge pages.  The memory policy is set before any frame is touched,
+// so that an interleaved pool really is spread over the nodes.
+
+static char* mapPool(size_t& bytes, const int flags)
+{
+    void* pool = MAP_FAILED;
+    const int base = MAP_PRIVATE | MAP_ANONYMOUS;
+
+#ifdef MAP_HUGETLB
+    if (flags & (POOLHUGE1G | POOLHUGE2M))
+    {
+        int shift = (flags & POOLHUGE1G) ? 30 : 21;
+        size_t huge = (size_t) 1 << shift;
+        size_t len = (bytes + huge - 1) & ~(huge - 1);
+        pool = mmap(NULL, len, PROT_READ | PROT_WRITE, base | MAP_HUGETLB
+                    | (shift << MAP_HUGE_SHIFT), -1, 0);
+        if (pool != MAP_FAILED) bytes = len;
+    }
+#endif
+    if (pool == MAP_FAILED)
+    {
+        pool = mmap(NULL, bytes, PROT_READ | PROT_WRITE, base, -1, 0);
+        if (pool == MAP_FAILED) return NULL;
+#ifdef MADV_HUGEPAGE
+        if (flags & (POOLHUGE1G | POOLHUGE2M))
+            madvise(pool, bytes, MADV_HUGEPAGE);
+#endif
+    }
+
+#ifdef SYS_mbind
+    if (flags & POOLINTERLEAVE)
+    {
+        const int maxNodes = 1024;
+        unsigned long mask[maxNodes / (8 * sizeof(long))] = { 0 };
+        int nodes = onlineNodes(mask, maxNodes);
+        // a hint only; a pool that cannot be spread still works
+        if (nodes > 1)
+            syscall(SYS_mbind, pool, bytes, MPOL_INTERLEAVE, mask,
+                    (unsigned long) nodes + 1, 0);
+    }
+#endif
+    return (char*) pool;
+}
+
+
 //----------------------------------------
 // Constructor of the class BufMgr
 //----------------------------------------
 
-BufMgr::BufMgr(const int bufs)
+BufMgr::BufMgr(const int bufs, const unsigned frameSize_,
+               const int lowDirty_, const int highDirty_,
+               const Replacement replacement, const int poolFlags)
 {
     numBufs = bufs;
+    frameSize = frameSize_;
 
     bufTable = new BufDesc[bufs];
-    memset(bufTable, 0, bufs * sizeof(BufDesc));
     for (int i = 0; i < bufs; i++) 
     {
         bufTable[i].frameNo = i;
         bufTable[i].valid = false;
     }
 
-    bufPool = new Page[bufs];
-    memset(bufPool, 0, bufs * sizeof(Page));
+    // the mapping starts out zeroed
+    poolBytes = (size_t) bufs * frameSize;
+    bufPool = mapPool(poolBytes, poolFlags);
+    if (!bufPool)
+    {
+        cerr << "unable to map a buffer pool of " << poolBytes
+             << " bytes" << endl;
+        exit(1);
+    }
 
-    int htsize = ((((int) (bufs * 1.2))*2)/2)+1;
-    hashTable = new BufHashTbl (htsize);  // allocate the buffer hash table
+    hashTable = new BufHashTbl (bufs);  // allocate the buffer hash table
 
     clockHand = bufs - 1;
+    if (replacement == TWOQREPL) policy = new TwoQPolicy(bufs);
+    else policy = new ClockPolicy(bufs);
+
+    // start the page cleaner if asked to
+    numDirty = 0;
+    highDirty = highDirty_;
+    lowDirty = lowDirty_ < 0 ? 0 : lowDirty_;
+    if (lowDirty > highDirty) lowDirty = highDirty;
+    stopCleaner = false;
+    cleaner = NULL;
+    log = NULL;
+    unloggedBytes = 0;
+    unloggedFrames = 0;
+    if (highDirty > 0)
+        cleaner = new std::thread(&BufMgr::runCleaner, this);
+}
+
+
+// size a pool by the memory of the machine
+int BufMgr::framesForMemory(const double fraction, const unsigned frameSize)
+{
+    double memory = (double) sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+    double frames = memory * fraction / frameSize;
+    if (frames < 1) return 1;
+    if (frames > 1 << 30) return 1 << 30;
+    return (int) frames;
 }
 
 
 BufMgr::~BufMgr() {
 
+    // commit what the log has not seen yet
+    if (log) setLog(NULL);
+
+    // stop the page cleaner
+    if (cleaner)
+    {
+        {
+            std::lock_guard<std::mutex> guard(cleanerLatch);
+            stopCleaner = true;
+        }
+        cleanerCond.notify_one();
+        cleaner->join();
+        delete cleaner;
+    }
+
     // flush out all unwritten pages
     for (int i = 0; i < numBufs; i++) 
     {
@@ -54,12 +194,177 @@ BufMgr::~BufMgr() {
                  << " from frame " << i << endl;
 #endif
 
-            tmpbuf->file->writePage(tmpbuf->pageNo, &(bufPool[i]));
+            tmpbuf->file.load()->writePage(tmpbuf->pageNo, framePage(i));
         }
     }
 delete hashTable;
+    delete policy;
     delete [] bufTable;
-    delete [] bufPool;
+    munmap(bufPool, poolBytes);
+
+    // files that are still open, lingering ones among them, are now
+    // closed without the pool
+    if (bufMgr == this) bufMgr = NULL;
+}
+
+
+// try to claim frame for the calling thread.  succeeds only if no
+// one has the frame pinned or claimed.
+const bool BufMgr::claimBuf(int frame)
+{
+    int expected = 0;
+    return bufTable[frame].pinCnt.compare_exchange_strong(expected, CLAIMPIN);
+}
+
+
+// the dirty flag of a frame is only changed through these two so
+// that numDirty stays accurate
+void BufMgr::setDirty(BufDesc* buf)
+{
+    if (!buf->dirty.exchange(true)) numDirty++;
+}
+
+
+const bool BufMgr::setClean(BufDesc* buf)
+{
+    bool wasDirty = buf->dirty.exchange(false);
+    if (wasDirty) numDirty--;
+    return wasDirty;
+}
+
+
+// empty a frame the caller has claimed, writing the page it holds if
+// it is dirty.  returns true with the frame pinned once and not in
+// the hash table, or false with the claim dropped if the page was
+// pinned or dirtied again meanwhile or could not be written (status
+// is set in that case).
+
+const bool BufMgr::evictBuf(const int frame, Status& status)
+{
+    BufDesc* buf = &bufTable[frame];
+    status = OK;
+
+    // if invalid, use frame
+    if (!buf->valid)
+    {
+        buf->pinCnt = 1;
+        return true;
+    }
+
+    // flush any existing changes to disk if necessary.  the page
+    // stays in the hash table meanwhile, so a thread that wants
+    // it finds this frame rather than reading a stale copy
+    File* file = buf->file;
+    int pageNo = buf->pageNo;
+    if (buf->dirty && !logSafe(buf))
+    {
+        buf->pinCnt -= CLAIMPIN;
+        return false;
+    }
+    if (setClean(buf))
+    {
+        bufStats.diskwrites++;
+        poolStats.writebacks.add();
+        file->stats.writebacks.add();
+
+        status = file->writePage(pageNo, framePage(frame));
+        if (status != OK)
+        {
+            setDirty(buf);
+            buf->pinCnt -= CLAIMPIN;
+            return false;
+        }
+        noteFile(file);
+    }
+
+    // remove previous entry from hash table unless the page was
+    // pinned or dirtied again while it was being written
+    {
+        std::lock_guard<std::mutex> guard(hashTable->latch(file, pageNo));
+        if (buf->pinCnt == CLAIMPIN && !buf->dirty)
+        {
+            hashTable->remove(file, pageNo);
+            unlinkFrame(file, frame);
+            buf->valid = false;
+            buf->file = NULL;
+            buf->pageNo = -1;
+            buf->pinCnt = 1;
+            poolStats.evictions.add();
+            file->stats.evictions.add();
+            return true;
+        }
+    }
+    buf->pinCnt -= CLAIMPIN;
+    return false;
+}
+
+
+// allocate a frame for a page read through ring.  the oldest frame
+// of a full ring is reused if it is unpinned and nobody has
+// referenced its page since the scan read it; otherwise a frame is
+// taken from the pool and replaces it in the ring.
+
+const Status BufMgr::allocRingBuf(BufRing* ring, int & frame)
+{
+    Status status;
+    if (ring->count == ring->size)
+    {
+        int old = ring->frames[ring->next];
+        BufDesc* buf = &bufTable[old];
+        if (buf->pinCnt == 0 && (!buf->valid || policy->cold(old))
+            && claimBuf(old))
+        {
+            if (evictBuf(old, status))
+            {
+                ring->next = (ring->next + 1) % ring->size;
+                frame = old;
+                return OK;
+            }
+            if (status != OK) return status;
+        }
+    }
+
+    status = allocBuf(frame);
+    if (status != OK) return status;
+    if (ring->count < ring->size) ring->frames[ring->count++] = frame;
+    else
+    {
+        ring->frames[ring->next] = frame;
+        ring->next = (ring->next + 1) % ring->size;
+    }
+    return OK;
+}
+
+
+// add frame to the list of frames of file
+void BufMgr::linkFrame(const File* file, const int frame)
+{
+    std::lock_guard<std::mutex> guard(file->frameLatch);
+    bufTable[frame].prevFrame = -1;
+    bufTable[frame].nextFrame = file->firstFrame;
+    if (file->firstFrame != -1)
+        bufTable[file->firstFrame].prevFrame = frame;
+    file->firstFrame = frame;
+}
+
+
+// remove frame from the list of frames of file
+void BufMgr::unlinkFrame(const File* file, const int frame)
+{
+    std::lock_guard<std::mutex> guard(file->frameLatch);
+    BufDesc* buf = &bufTable[frame];
+    if (buf->prevFrame != -1) bufTable[buf->prevFrame].nextFrame = buf->nextFrame;
+    else file->firstFrame = buf->nextFrame;
+    if (buf->nextFrame != -1) bufTable[buf->nextFrame].prevFrame = buf->prevFrame;
+    buf->nextFrame = buf->prevFrame = -1;
+}
+
+
+// wait for whoever has frame claimed to finish with it
+void BufMgr::waitUnclaimed(int frame)
+{
+    while (bufTable[frame].pinCnt >= CLAIMPIN)
+        std::this_thread::yield();
 }
 
 
@@ -67,101 +372,286 @@ const Status BufMgr::allocBuf(int & frame)
 {
     // perform first part of clock algorithm to search for 
     // open buffer frame
-    // Assumes non-concurrent access to buffer manager
+    // Other threads may pin, unpin and evict pages while the sweep
+    // runs, so a candidate frame is claimed before it is examined and
+    // is only taken once it is found unpinned and clean under the
+    // latch of the page it holds.  The frame is returned pinned once
+    // and not in the hash table.
     Status status = OK;
     int numScanned = 0;
-    bool found = 0;
-    while (numScanned < 2*numBufs)
+    bool committed = false;
+    while (numScanned < policy->sweeps()*numBufs)
     {
         // advance the clock
-        advanceClock();
+        int hand = advanceClock();
+        BufDesc* buf = &bufTable[hand];
         numScanned++;
 
-        // if invalid, use frame
-        if (! bufTable[clockHand].valid)
-        {
-            break;
-        }
+        // someone has it pinned
+        if (buf->pinCnt != 0) continue;
+
+        // is valid, ask the policy whether it has been used recently
+        if (buf->valid && !policy->victim(hand)) continue;
 
-        // is valid, check referenced bit
-        if (! bufTable[clockHand].refbit)
+        // hasn't been referenced and is not pinned, try to use it
+        if (!claimBuf(hand)) continue;
+        if (evictBuf(hand, status))
         {
-            // check to see if someone has it pinned
-            if (bufTable[clockHand].pinCnt == 0)
-            {
-                // hasn't been referenced and is not pinned, use it
-
-                // remove previous entry from hash table
-                status = hashTable->remove(bufTable[clockHand].file, 
-                                           bufTable[clockHand].pageNo);
-                found = true;
-                //if (status != OK) return status;
-                break;
-            }
+            // return new frame number
+            frame = hand;
+            poolStats.sweepSteps.add(numScanned);
+            return OK;
         }
-        else
+        if (status != OK) break;
+
+        // the frames may only be dirty ones the log has not seen.
+        // after a commit they can be written back
+        if (numScanned == policy->sweeps()*numBufs && log && !committed
+            && !LogMgr::inChange())
         {
-            // has been referenced, clear the bit
-            bufStats.accesses++;
-            bufTable[clockHand].refbit = false;
+            committed = true;
+            if ((status = log->commit()) != OK) break;
+            numScanned = 0;
         }
     }
+    poolStats.sweepSteps.add(numScanned);
+    if (status != OK) return status;
     
-    // check for full buffer pool
-    if (!found && numScanned >= 2*numBufs)
+    // buffer pool is full
+    return BUFFEREXCEEDED;
+} // end allocBuf
+
+	
+const Status BufMgr::pinResident(const File* file, const int pageNo,
+                                 int& frameNo, const bool scan)
+{
+    std::lock_guard<std::mutex> guard(hashTable->latch(file, pageNo));
+    Status status = hashTable->lookup(file, pageNo, frameNo);
+    if (status == OK)
     {
-        return BUFFEREXCEEDED;
+        // tell the policy about the reference
+        bufTable[frameNo].pinCnt++;
+        if (!scan) policy->referenced(frameNo);
     }
-    
-    // flush any existing changes to disk if necessary
-    if (bufTable[clockHand].dirty)
-    {
-        bufStats.diskwrites++;
+    return status;
+}
 
-        status = bufTable[clockHand].file->writePage(bufTable[clockHand].pageNo,
-                                                     &bufPool[clockHand]);
-        if (status != OK) return status;
-    }
 
-    // return new frame number
-    frame = clockHand;
+const int BufMgr::installBuf(File* file, const int pageNo, const int frameNo,
+                             const bool scan)
+{
+    int otherFrameNo = 0;
+    std::lock_guard<std::mutex> guard(hashTable->latch(file, pageNo));
+    if (hashTable->lookup(file, pageNo, otherFrameNo) == OK)
+    {
+        // lost the race to load the page, use the other copy
+        bufTable[otherFrameNo].pinCnt++;
+        if (!scan) policy->referenced(otherFrameNo);
+        bufTable[frameNo].Clear();
+        return otherFrameNo;
+    }
 
-    return OK;
-} // end allocBuf
+    // set up the entry properly and insert in the hash table
+    bufTable[frameNo].Set(file, pageNo);
+    policy->loaded(frameNo, scan);
+    hashTable->insert(file, pageNo, frameNo);
+    linkFrame(file, frameNo);
+    return frameNo;
+}
 
 	
-const Status BufMgr::readPage(File* file, const int PageNo, Page*& page)
+const Status BufMgr::readPage(File* file, const int PageNo, Page*& page,
+                              BufRing* ring)
 {
+    // the pages of a read-only file are used where they are mapped
+    if (file->isReadOnly())
+    {
+        bufStats.accesses++;
+        page = file->mappedPage(PageNo);
+        if (!page) return BADPAGENO;
+        poolStats.hits.add();
+        file->stats.hits.add();
+        return OK;
+    }
+
     // check to see if it is already in the buffer pool
     // cout << "readPage called on file.page " << file << "." << PageNo << endl;
     int frameNo = 0;
-    Status status = hashTable->lookup(file, PageNo, frameNo);
+    bufStats.accesses++;
+    Status status = pinResident(file, PageNo, frameNo, ring != NULL);
     if (status == OK)
     {
-        // set the referenced bit
-        bufTable[frameNo].refbit = true;
-        bufTable[frameNo].pinCnt++;
-        page = &bufPool[frameNo];
+        page = framePage(frameNo);
+        poolStats.hits.add();
+        file->stats.hits.add();
     }
     else // not in the buffer pool, must allocate a new page
     {
+        // make sure the page fits in a frame
+        if (file->getPageSize() > frameSize) return BADPAGESIZE;
+        poolStats.misses.add();
+        file->stats.misses.add();
+        StatTimer timer;
+
         // alloc a new frame
-        status = allocBuf(frameNo);
+        if (ring) status = allocRingBuf(ring, frameNo);
+        else status = allocBuf(frameNo);
         if (status != OK) return status;
 
         // read the page into the new frame
         bufStats.diskreads++;
-        status = file->readPage(PageNo, &bufPool[frameNo]);
-        if (status != OK) return status;
+        status = file->readPage(PageNo, framePage(frameNo));
+        if (status != OK)
+        {
+            bufTable[frameNo].Clear();
+            return status;
+        }
+
+        // make it visible to other threads
+        frameNo = installBuf(file, PageNo, frameNo, ring != NULL);
+        page = framePage(frameNo);
+        timer.stop(poolStats.missTime);
+    }
+
+    return OK;
+}
+
+
+// Bring up to count pages starting at startPageNo into the buffer pool
+// without pinning them.  Pages that are already resident are skipped and
+// every run of consecutive missing pages is read with a single vectored
+// read.  This is a hint: running out of frames or reaching the end of
+// the file just ends the prefetch early.  At most a quarter of the pool
+// is used by one call so that a prefetch cannot flush the whole pool.
+// A scan passes its ring, so that the pages are read into ring frames.
+
+const Status BufMgr::prefetchPages(File* file, const int startPageNo,
+                                   const int count, BufRing* ring)
+{
+    Status status;
+    int numPages;
+    int lastPageNo;
+    int runStart = -1;
+    int runLen = 0;
+    int runFrames[MAXIOVPAGES];
+    Page* runPages[MAXIOVPAGES];
+
+    if (startPageNo < 1) return BADPAGENO;
+    if (file->isReadOnly()) return file->advisePages(startPageNo, count);
+    if (file->getPageSize() > frameSize) return BADPAGESIZE;
+
+    status = file->getNumPages(numPages);
+    if (status != OK) return status;
+
+    lastPageNo = startPageNo + (count < numBufs / 4 ? count : numBufs / 4);
+    if (lastPageNo > numPages) lastPageNo = numPages;
 
-        // set up the entry properly
-        bufTable[frameNo].Set(file, PageNo);
-        page = &bufPool[frameNo];
+    for (int pageNo = startPageNo; pageNo <= lastPageNo; pageNo++)
+    {
+        int frameNo = 0;
+        bool resident = false;
+        if (pageNo < lastPageNo)
+        {
+            std::lock_guard<std::mutex> guard(hashTable->latch(file, pageNo));
+            resident = (hashTable->lookup(file, pageNo, frameNo) == OK);
+        }
 
-        // insert in the hash table
-        status = hashTable->insert(file, PageNo, frameNo);
-        if (status != OK) { return status; }
+        // read the pending run when it is broken by a resident page,
+        // when it is full, or when there are no more pages
+        if (runLen > 0 && (resident || pageNo == lastPageNo ||
+                           runLen == MAXIOVPAGES))
+        {
+            bufStats.diskreads += runLen;
+            poolStats.prefetches.add(runLen);
+            file->stats.prefetches.add(runLen);
+            status = file->readPages(runStart, runLen, runPages);
+            for (int i = 0; i < runLen; i++)
+            {
+                if (status == OK)
+                {
+                    frameNo = installBuf(file, runStart + i, runFrames[i],
+                                         ring != NULL);
+                    bufTable[frameNo].pinCnt--;
+                }
+                else bufTable[runFrames[i]].Clear();
+            }
+            if (status != OK) return status;
+            runLen = 0;
+        }
 
+        if (resident || pageNo == lastPageNo) continue;
+
+        // get a frame for the page; it is not visible to other
+        // threads until it has been read
+        if (ring) status = allocRingBuf(ring, frameNo);
+        else status = allocBuf(frameNo);
+        if (status != OK) lastPageNo = pageNo + 1;
+        else
+        {
+            if (runLen == 0) runStart = pageNo;
+            runFrames[runLen] = frameNo;
+            runPages[runLen] = framePage(frameNo);
+            runLen++;
+        }
+    }
+
+    return OK;
+}
+
+
+PageRead BufMgr::readPageAsync(File* file, const int pageNo, Page*& page,
+                               IoRing& io, BufRing* ring)
+{
+    return PageRead(this, file, pageNo, &page, &io, ring, false);
+}
+
+
+// Like prefetchPages, but every missing page is queued on io as a read
+// of its own, which the ring hands to the kernel together with the
+// others.  The reads are left to complete while the caller goes on,
+// so the frames they hold are counted over all calls: no more than a
+// quarter of the pool is being read through one ring at once.
+
+const Status BufMgr::prefetchPagesAsync(File* file, const int startPageNo,
+                                        const int count, IoRing& io,
+                                        BufRing* ring)
+{
+    Status status;
+    int numPages;
+    int lastPageNo;
+
+    if (startPageNo < 1) return BADPAGENO;
+    if (file->isReadOnly()) return file->advisePages(startPageNo, count);
+    if (file->getPageSize() > frameSize) return BADPAGESIZE;
+
+    status = file->getNumPages(numPages);
+    if (status != OK) return status;
+
+    lastPageNo = startPageNo + (count < numBufs / 4 ? count : numBufs / 4);
+    if (lastPageNo > numPages) lastPageNo = numPages;
+
+    for (int pageNo = startPageNo; pageNo < lastPageNo; pageNo++)
+    {
+        int frameNo = 0;
+        {
+            std::lock_guard<std::mutex> guard(hashTable->latch(file, pageNo));
+            if (hashTable->lookup(file, pageNo, frameNo) == OK) continue;
+        }
+        if (io.pageReads.count(make_pair((const File*) file, pageNo)))
+            continue;
+        if ((int) io.pageReads.size() >= numBufs / 4) break;
+
+        // running out of frames ends the prefetch early
+        PageRead* read = new PageRead(this, file, pageNo, NULL, &io, ring,
+                                      true);
+        read->started = true;
+        if (read->read() != OK)
+        {
+            delete read;
+            break;
+        }
+        poolStats.prefetches.add();
+        file->stats.prefetches.add();
     }
 
     return OK;
@@ -174,6 +664,8 @@ const Status BufMgr::unPinPage(File* file, const int PageNo,
     // lookup in hashtable
     Status status = OK;
     int frameNo = 0;
+    if (file->isReadOnly()) return dirty ? FILEREADONLY : OK;
+    std::lock_guard<std::mutex> guard(hashTable->latch(file, PageNo));
     status = hashTable->lookup(file, PageNo, frameNo);
     if (status != OK) return status;
     /*
@@ -182,52 +674,179 @@ const Status BufMgr::unPinPage(File* file, const int PageNo,
     cout << "\t page is in frame " << frameNo << " pinCnt is " << bufTable[frameNo].pinCnt  << endl;
     */
 
-    if (dirty == true) bufTable[frameNo].dirty = dirty;
-
     // make sure the page is actually pinned
-    if (bufTable[frameNo].pinCnt == 0)
+    if (bufTable[frameNo].userPins() == 0)
     {
         return PAGENOTPINNED;
     }
-    else bufTable[frameNo].pinCnt--;
+
+    if (dirty == true)
+    {
+        setDirty(&bufTable[frameNo]);
+        if (cleaner && numDirty > highDirty) cleanerCond.notify_one();
+
+        // the first change since the latest image counts towards the
+        // next commit
+        BufDesc* buf = &bufTable[frameNo];
+        if (log && buf->changes.fetch_add(1) == buf->imaged)
+        {
+            unloggedFrames++;
+            if ((unloggedBytes += file->getPageSize()) > log->commitBytes)
+                log->wake();
+        }
+    }
+    bufTable[frameNo].pinCnt--;
     return OK;
 }
 
+// Write out the dirty pages of file and drop all its pages from the
+// pool.  Only the frames on the file's own list are looked at, in
+// pageNo order, and adjacent dirty pages are written with one
+// vectored write.  Frames are claimed a run at a time; the pending
+// run is written before waiting for a frame someone else has
+// claimed, so two threads claiming frames never wait for each other.
+
+struct flushItem
+{
+    int pageNo;
+    int frameNo;
+};
+
+static bool flushOrder(const flushItem& a, const flushItem& b)
+{
+  return a.pageNo < b.pageNo;
+}
+
 const Status BufMgr::flushFile(const File* file) 
 {
   Status status;
+  std::vector<flushItem> items;
+  int run[MAXIOVPAGES];
+  int runLen = 0;
+
+  // with a log the changes of the file are committed first, and no
+  // checkpoint may empty the log before they are written.  no change
+  // may be in progress, as it can cover other files too; changeLatch
+  // goes before ckptLatch, as in a checkpoint.  a thread closing a
+  // file in a change of its own would wait for itself (see LogChange)
+  std::unique_lock<std::shared_mutex> quiet;
+  std::unique_lock<std::mutex> ckpt;
+  if (log) {
+    if (!LogMgr::inChange())
+      quiet = std::unique_lock<std::shared_mutex>(log->changeLatch);
+    ckpt = std::unique_lock<std::mutex>(log->ckptLatch);
+    if ((status = log->commitChanges(file)) != OK)
+      return status;
+  }
 
-  for (int i = 0; i < numBufs; i++) {
+  // take a snapshot of the frames of the file
+  {
+    std::lock_guard<std::mutex> guard(file->frameLatch);
+    for (int i = file->firstFrame; i != -1; i = bufTable[i].nextFrame) {
+      flushItem item = { bufTable[i].pageNo, i };
+      items.push_back(item);
+    }
+  }
+  std::sort(items.begin(), items.end(), flushOrder);
+
+  for (size_t k = 0; k < items.size(); k++) {
+    int i = items[k].frameNo;
     BufDesc* tmpbuf = &(bufTable[i]);
-    if (tmpbuf->valid == true && tmpbuf->file == file) {
+    if (tmpbuf->file != file || tmpbuf->pageNo != items[k].pageNo) continue;
 
-      if (tmpbuf->pinCnt > 0)
-	  return PAGEPINNED;
+    // claim the frame.  if another thread has it claimed it is
+    // in the middle of evicting it, so wait and look again
+    bool claimed = claimBuf(i);
+    if (!claimed) {
+      if ((status = flushRun(file, run, runLen)) != OK)
+	return status;
+      runLen = 0;
+    }
+    while (tmpbuf->file == file && !claimed) {
+      if (tmpbuf->userPins() > 0)
+	return PAGEPINNED;
+      claimed = claimBuf(i);
+      if (!claimed) std::this_thread::yield();
+    }
+    if (!claimed) continue;
 
-      if (tmpbuf->dirty == true) {
-#ifdef DEBUGBUF
-	cout << "flushing page " << tmpbuf->pageNo
-             << " from frame " << i << endl;
-#endif
-	if ((status = tmpbuf->file->writePage(tmpbuf->pageNo,
-					      &(bufPool[i]))) != OK)
-	  return status;
+    if (tmpbuf->valid == false && tmpbuf->file == file) {
+      tmpbuf->pinCnt -= CLAIMPIN;
+      flushRun(file, run, runLen);
+      return BADBUFFER;
+    }
+    if (tmpbuf->valid == false || tmpbuf->file != file
+        || tmpbuf->pageNo != items[k].pageNo) {
+      tmpbuf->pinCnt -= CLAIMPIN;
+      continue;
+    }
+
+    // start a new run unless the page follows the last one
+    if (runLen > 0 && (runLen == MAXIOVPAGES ||
+                       bufTable[run[runLen - 1]].pageNo + 1 != tmpbuf->pageNo)) {
+      if ((status = flushRun(file, run, runLen)) != OK)
+	return status;
+      runLen = 0;
+    }
+    run[runLen++] = i;
+  }
+
+  return flushRun(file, run, runLen);
+}
 
-	tmpbuf->dirty = false;
-      }
 
-      hashTable->remove(file,tmpbuf->pageNo);
+// write the dirty ones among count claimed frames holding adjacent
+// pages of file, then drop all of them from the pool.  if a write
+// fails the claims are released and the pages stay in the pool.
+
+const Status BufMgr::flushRun(const File* file, const int* frames,
+                              const int count)
+{
+  Status status = OK;
+  Page* pages[MAXIOVPAGES];
 
-      tmpbuf->file = NULL;
-      tmpbuf->pageNo = -1;
-      tmpbuf->valid = false;
+  for (int k = 0; k < count && status == OK; ) {
+    // find the next run of dirty pages
+    if (!bufTable[frames[k]].dirty) { k++; continue; }
+    int len = 0;
+    while (k + len < count && bufTable[frames[k + len]].dirty) {
+      pages[len] = framePage(frames[k + len]);
+      len++;
+    }
+#ifdef DEBUGBUF
+    cout << "flushing pages " << bufTable[frames[k]].pageNo << " to "
+         << bufTable[frames[k]].pageNo + len - 1 << endl;
+#endif
+    bufStats.diskwrites += len;
+    poolStats.writebacks.add(len);
+    file->stats.writebacks.add(len);
+    status = bufTable[frames[k]].file.load()->writePages(
+               bufTable[frames[k]].pageNo, len, pages);
+    if (status == OK) {
+      for (int d = 0; d < len; d++) setClean(&bufTable[frames[k + d]]);
+      noteFile(bufTable[frames[k]].file);
     }
+    k += len;
+  }
 
-    else if (tmpbuf->valid == false && tmpbuf->file == file)
-      return BADBUFFER;
+  for (int k = 0; k < count; k++) {
+    BufDesc* tmpbuf = &(bufTable[frames[k]]);
+    if (status != OK) {
+      tmpbuf->pinCnt -= CLAIMPIN;
+      continue;
+    }
+    {
+      std::lock_guard<std::mutex> guard(hashTable->latch(file, tmpbuf->pageNo));
+      hashTable->remove(file, tmpbuf->pageNo);
+      unlinkFrame(file, frames[k]);
+    }
+
+    tmpbuf->file = NULL;
+    tmpbuf->pageNo = -1;
+    tmpbuf->valid = false;
+    tmpbuf->pinCnt = 0;
   }
-  
-  return OK;
+  return status;
 }
 
 
@@ -237,13 +856,50 @@ const Status BufMgr::disposePage(File* file, const int pageNo)
     // see if it is in the buffer pool
     Status status = OK;
     int frameNo = 0;
-    status = hashTable->lookup(file, pageNo, frameNo);
-    if (status == OK)
+    bool claimed = false;
     {
-        // clear the page
-        bufTable[frameNo].Clear();
+        std::lock_guard<std::mutex> guard(hashTable->latch(file, pageNo));
+        status = hashTable->lookup(file, pageNo, frameNo);
+        if (status == OK)
+        {
+            hashTable->remove(file, pageNo);
+            unlinkFrame(file, frameNo);
+
+            // clear the page.  if the frame is being evicted only
+            // make sure its contents are not written back
+            setClean(&bufTable[frameNo]);
+            if (bufTable[frameNo].pinCnt < CLAIMPIN)
+                bufTable[frameNo].Clear();
+            else
+            {
+                bufTable[frameNo].valid = false;
+                claimed = true;
+            }
+        }
+    }
+
+    // an eviction that was already writing the page must finish
+    // before the page goes on the free list
+    if (claimed) waitUnclaimed(frameNo);
+
+    // the file writes the page itself, so with a log the new link of
+    // the free list is committed first.  the page must no longer be
+    // used by any page the log has committed
+    if (log && pageNo > 0)
+    {
+        DBPage away, header;
+        memset(&away, 0, sizeof away);
+        {
+            std::lock_guard<std::mutex> guard(file->hdrLatch);
+            header = file->header;
+        }
+        away.nextFree = header.nextFree;
+        header.nextFree = pageNo;
+        if (header.firstPage != pageNo && pageNo < header.numPages
+            && !file->isReadOnly()
+            && (status = log->logDispose(file, pageNo, away, header)) != OK)
+            return status;
     }
-    status = hashTable->remove(file, pageNo);
 
     // deallocate it in the file
     return file->disposePage(pageNo);
@@ -254,6 +910,10 @@ const Status BufMgr::allocPage(File* file, int& pageNo, Page*& page)
 {
     int frameNo;
 
+    // make sure the page fits in a frame
+    if (file->getPageSize() > frameSize) return BADPAGESIZE;
+    bufStats.accesses++;
+
     // allocate a new page in the file
     Status status = file->allocatePage(pageNo);
     if (status != OK)  return status; 
@@ -264,30 +924,483 @@ const Status BufMgr::allocPage(File* file, int& pageNo, Page*& page)
 
      // set up the entry properly
      bufTable[frameNo].Set(file, pageNo);
-     page = &bufPool[frameNo];
+     policy->loaded(frameNo, false);
+     page = framePage(frameNo);
 
      // insert in thehash table
-     status = hashTable->insert(file, pageNo, frameNo);
+     {
+         std::lock_guard<std::mutex> guard(hashTable->latch(file, pageNo));
+         status = hashTable->insert(file, pageNo, frameNo);
+         if (status == OK) linkFrame(file, frameNo);
+     }
      if (status != OK) { return status; }
      // cout << "allocated page " << pageNo <<  " to file " << file << "frame is: " << frameNo  << endl;
     return OK;
 }
 
 
+// Page cleaner thread.  Sleeps until it is woken because there are
+// more than highDirty dirty frames (or for CLEANERWAKEUP ms) and then
+// writes back batches of dirty frames until at most lowDirty remain
+// or no unpinned dirty frame is left.
+
+void BufMgr::runCleaner()
+{
+    std::unique_lock<std::mutex> guard(cleanerLatch);
+    while (!stopCleaner)
+    {
+        cleanerCond.wait_for(guard, std::chrono::milliseconds(CLEANERWAKEUP));
+        if (stopCleaner || numDirty <= highDirty) continue;
+
+        guard.unlock();
+        while (numDirty > lowDirty && cleanBatch() > 0) ;
+        guard.lock();
+    }
+}
+
+
+// one batch of the page cleaner.  collects up to CLEANBATCH unpinned
+// dirty frames starting just ahead of the clock hand, claiming each
+// so that it cannot be evicted or flushed meanwhile, then writes them
+// in (file, pageNo) order, one vectored write per run of adjacent
+// pages.  returns the number of frames written.
+
+struct cleanItem
+{
+    File* file;
+    int   pageNo;
+    int   frameNo;
+};
+
+static bool cleanOrder(const cleanItem& a, const cleanItem& b)
+{
+    if (a.file != b.file) return a.file < b.file;
+    return a.pageNo < b.pageNo;
+}
+
+const int BufMgr::cleanBatch()
+{
+    cleanItem items[CLEANBATCH];
+    Page* pages[CLEANBATCH];
+    int n = 0;
+    int want = numDirty - lowDirty;
+    if (want > CLEANBATCH) want = CLEANBATCH;
+
+    unsigned int start = clockHand + 1;
+    for (int k = 0; k < numBufs && n < want; k++)
+    {
+        int frameNo = (start + k) % numBufs;
+        BufDesc* buf = &bufTable[frameNo];
+        if (buf->pinCnt != 0 || !buf->dirty || !logSafe(buf)) continue;
+        if (!claimBuf(frameNo)) continue;
+        if (!buf->valid || !buf->dirty)
+        {
+            buf->pinCnt -= CLAIMPIN;
+            continue;
+        }
+        items[n].file = buf->file;
+        items[n].pageNo = buf->pageNo;
+        items[n].frameNo = frameNo;
+        n++;
+    }
+
+    std::sort(items, items + n, cleanOrder);
+
+    for (int i = 0; i < n; )
+    {
+        // find the run of adjacent pages of one file starting at i
+        int len = 1;
+        while (i + len < n && len < MAXIOVPAGES
+               && items[i + len].file == items[i].file
+               && items[i + len].pageNo == items[i].pageNo + len)
+            len++;
+
+        for (int k = 0; k < len; k++)
+        {
+            setClean(&bufTable[items[i + k].frameNo]);
+            pages[k] = framePage(items[i + k].frameNo);
+        }
+
+        bufStats.diskwrites += len;
+        poolStats.writebacks.add(len);
+        items[i].file->stats.writebacks.add(len);
+        Status status = items[i].file->writePages(items[i].pageNo, len, pages);
+
+        for (int k = 0; k < len; k++)
+        {
+            BufDesc* buf = &bufTable[items[i + k].frameNo];
+            if (status != OK) setDirty(buf);
+            buf->pinCnt -= CLAIMPIN;
+        }
+        if (status == OK) noteFile(items[i].file);
+        i += len;
+    }
+
+    return n;
+}
+
+
+// a dirty frame may be written back once the log has its latest
+// image, and that image is durable
+const bool BufMgr::logSafe(const BufDesc* buf) const
+{
+    return !log || (buf->changes == buf->imaged
+                    && buf->lsn <= log->durableLSN());
+}
+
+
+void BufMgr::noteFile(File* file)
+{
+    if (!log) return;
+    std::lock_guard<std::mutex> guard(fileLatch);
+    if (std::find(logFiles.begin(), logFiles.end(), file) == logFiles.end())
+        logFiles.push_back(file);
+}
+
+
+// frames that are dirty when a log is attached have not been logged,
+// so they count as changed.  a log that is detached gets a last
+// commit first
+
+void BufMgr::setLog(LogMgr* newLog)
+{
+    if (log)
+    {
+        log->commitChanges();
+        {
+            std::lock_guard<std::mutex> guard(log->latch);
+            log->pool = NULL;
+        }
+        log = NULL;
+        std::lock_guard<std::mutex> guard(fileLatch);
+        logFiles.clear();
+    }
+    if (!newLog) return;
+
+    if (newLog->pool) newLog->pool->setLog(NULL);
+    unloggedBytes = unloggedFrames = 0;
+    for (int i = 0; i < numBufs; i++) 
+    {
+        BufDesc* buf = &bufTable[i];
+        if (buf->valid && buf->dirty && buf->changes == buf->imaged)
+        {
+            buf->changes++;
+            unloggedFrames++;
+            unloggedBytes += frameSize;
+        }
+    }
+    std::lock_guard<std::mutex> guard(newLog->latch);
+    newLog->pool = this;
+    log = newLog;
+}
+
+
+// Take the images of a commit.  A frame is imaged if it was unpinned
+// dirty since its latest image, or if it is pinned by someone who may
+// have changed it without unpinning it yet (the header page of an
+// open heap file, say) and it no longer matches its latest image.
+// The frames are pinned while they are imaged, and the header of
+// each file imaged is logged after its pages.
+
+void BufMgr::logChanges(LogMgr* log, const File* only)
+{
+    vector<File*> files;
+    for (int i = 0; i < numBufs; i++) 
+    {
+        BufDesc* buf = &bufTable[i];
+        if (!buf->valid) continue;
+        File* file = buf->file;
+        int pageNo = buf->pageNo;
+        if (!file || (only && file != only)) continue;
+        if (!(buf->dirty && buf->changes != buf->imaged)
+            && buf->userPins() == 0) continue;
+
+        int frameNo;
+        if (pinResident(file, pageNo, frameNo, true) != OK) continue;
+        buf = &bufTable[frameNo];
+        const Page* page = framePage(frameNo);
+        unsigned c = buf->changes;
+        unsigned long sum = logChecksum(page, file->pageSize);
+        if ((buf->dirty && c != buf->imaged)
+            || (buf->userPins() > 1 && sum != buf->imageSum))
+        {
+            buf->lsn = log->append(LOGPAGE, file->fileName,
+                                   (long long) pageNo * file->pageSize,
+                                   page, file->pageSize);
+            buf->imaged = c;
+            buf->imageSum = sum;
+            log->images.add();
+            if (std::find(files.begin(), files.end(), file) == files.end())
+                files.push_back(file);
+        }
+        buf->pinCnt--;
+    }
+
+    for (size_t k = 0; k < files.size(); k++)
+    {
+        DBPage header;
+        {
+            std::lock_guard<std::mutex> guard(files[k]->hdrLatch);
+            header = files[k]->header;
+        }
+        log->append(LOGPAGE, files[k]->fileName, 0, &header, sizeof header);
+        noteFile(files[k]);
+    }
+    if (!only) unloggedBytes = unloggedFrames = 0;
+}
+
+
+// Write back every dirty frame, and every pinned one since it may
+// have been changed without being marked dirty yet, then write the
+// headers and sync every file logged or written since the last
+// checkpoint.  The log holds off changes meanwhile.
+
+const Status BufMgr::writeBack()
+{
+    Status status = OK;
+    for (int i = 0; i < numBufs && status == OK; i++)
+    {
+        BufDesc* buf = &bufTable[i];
+        if (!buf->valid || (!buf->dirty && buf->userPins() == 0)) continue;
+        File* file = buf->file;
+        int pageNo = buf->pageNo;
+        int frameNo;
+        if (!file || pinResident(file, pageNo, frameNo, true) != OK) continue;
+
+        buf = &bufTable[frameNo];
+        bool wasDirty = setClean(buf);
+        if (wasDirty || buf->userPins() > 1)
+        {
+            bufStats.diskwrites++;
+            poolStats.writebacks.add();
+            file->stats.writebacks.add();
+            status = file->writePage(pageNo, framePage(frameNo));
+            if (status != OK && wasDirty) setDirty(buf);
+            if (status == OK) noteFile(file);
+        }
+        buf->pinCnt--;
+    }
+    if (status != OK) return status;
+
+    std::lock_guard<std::mutex> guard(fileLatch);
+    for (size_t k = 0; k < logFiles.size(); k++)
+    {
+        if ((status = logFiles[k]->flushHeader()) != OK) return status;
+        if (fdatasync(logFiles[k]->unixFile) < 0) return UNIXERR;
+    }
+    logFiles.clear();
+    return OK;
+}
+
+
+const Status BufMgr::fileDestroyed(const string & name)
+{
+    return log ? log->logDestroy(name) : OK;
+}
+
+
+const Status BufMgr::forgetFile(File* file)
+{
+    std::lock_guard<std::mutex> guard(fileLatch);
+    vector<File*>::iterator f = std::find(logFiles.begin(), logFiles.end(),
+                                          file);
+    if (f == logFiles.end()) return OK;
+    logFiles.erase(f);
+    return fdatasync(file->unixFile) < 0 ? UNIXERR : OK;
+}
+
+
+void BufMgr::snapshot(PoolSnapshot & pool, vector<FrameState>* frames) const
+{
+    pool.frames = numBufs;
+    pool.valid = pool.pinned = pool.dirty = pool.pins = 0;
+    if (frames) frames->resize(numBufs);
+
+    for (int i = 0; i < numBufs; i++) 
+    {
+        const BufDesc* buf = &bufTable[i];
+        FrameState state;
+        state.file = buf->valid ? buf->file.load() : NULL;
+        state.pageNo = state.file ? buf->pageNo.load() : -1;
+        state.pinCnt = buf->userPins();
+        state.dirty = state.file && buf->dirty;
+
+        if (state.file) pool.valid++;
+        if (state.pinCnt > 0) pool.pinned++;
+        if (state.dirty) pool.dirty++;
+        pool.pins += state.pinCnt;
+        if (frames) (*frames)[i] = state;
+    }
+}
+
+
 void BufMgr::printSelf(void) 
 {
-    BufDesc* tmpbuf;
-  
+    PoolSnapshot pool;
+    vector<FrameState> frames;
+    snapshot(pool, &frames);
+
     cout << endl << "Print buffer...\n";
-    for (int i=0; i<numBufs; i++) {
-        tmpbuf = &(bufTable[i]);
-        cout << i << "\t" << (char*)(&bufPool[i]) 
-             << "\tpinCnt: " << tmpbuf->pinCnt;
-    
-        if (tmpbuf->valid == true)
-            cout << "\tvalid\n";
+    for (int i = 0; i < numBufs; i++) 
+    {
+        if (!frames[i].file && frames[i].pinCnt == 0) continue;
+        cout << i << "\t";
+        if (frames[i].file)
+            cout << frames[i].file->fileName << "." << frames[i].pageNo;
+        cout << "\tpinCnt: " << frames[i].pinCnt;
+        if (frames[i].dirty) cout << "\tdirty";
         cout << endl;
-    };
+    }
+    cout << pool.valid << " of " << pool.frames << " frames valid, "
+         << pool.pinned << " pinned (" << pool.pins << " pins), "
+         << pool.dirty << " dirty" << endl;
+
+    cout << poolStats.hits.get() << " hits, " << poolStats.misses.get()
+         << " misses, " << poolStats.prefetches.get() << " prefetched, "
+         << poolStats.evictions.get() << " evictions, "
+         << poolStats.writebacks.get() << " write-backs, "
+         << poolStats.sweepSteps.get() << " clock steps" << endl;
+    cout << "miss time: mean " << poolStats.missTime.mean()
+         << " ns, 99% below " << poolStats.missTime.percentile(0.99)
+         << " ns" << endl;
 }
 
 
+
+
+PageRead::PageRead(BufMgr* pool_, File* file_, const int pageNo_,
+                   Page** page_, IoRing* io_, BufRing* ring_,
+                   const bool prefetch_)
+  : pool(pool_), file(file_), pageNo(pageNo_),
+    page(page_ ? page_ : &prefetched), io(io_), ring(ring_),
+    prefetch(prefetch_), started(false), finished(false), status(OK),
+    frameNo(-1), prefetched(NULL), joiners(NULL), nextJoiner(NULL)
+{
+}
+
+
+// the same as readPage up to the read itself, which is queued on the
+// ring unless the page is already being read through it
+
+void PageRead::start()
+{
+    if (started) return;
+    started = true;
+    timer = StatTimer();
+    pool->bufStats.accesses++;
+
+    if (file->isReadOnly())
+    {
+        *page = file->mappedPage(pageNo);
+        status = *page ? OK : BADPAGENO;
+        if (status == OK)
+        {
+            pool->poolStats.hits.add();
+            file->stats.hits.add();
+        }
+        finished = true;
+        return;
+    }
+
+    int frame = 0;
+    if (pool->pinResident(file, pageNo, frame, ring != NULL) == OK)
+    {
+        *page = pool->framePage(frame);
+        pool->poolStats.hits.add();
+        file->stats.hits.add();
+        finished = true;
+        return;
+    }
+
+    if (file->getPageSize() > pool->frameSize)
+    {
+        status = BADPAGESIZE;
+        finished = true;
+        return;
+    }
+    pool->poolStats.misses.add();
+    file->stats.misses.add();
+
+    map<pair<const File*, int>, PageRead*>::iterator other
+        = io->pageReads.find(make_pair((const File*) file, pageNo));
+    if (other != io->pageReads.end())
+    {
+        nextJoiner = other->second->joiners;
+        other->second->joiners = this;
+        return;
+    }
+
+    status = read();
+    if (status != OK) finished = true;
+}
+
+
+const Status PageRead::read()
+{
+    Status s = ring ? pool->allocRingBuf(ring, frameNo)
+                    : pool->allocBuf(frameNo);
+    if (s != OK) return s;
+
+    pool->bufStats.diskreads++;
+    s = file->readPageAsync(pageNo, pool->framePage(frameNo), *io, this);
+    if (s != OK)
+    {
+        pool->bufTable[frameNo].Clear();
+        return s;
+    }
+    io->pageReads[make_pair((const File*) file, pageNo)] = this;
+    return OK;
+}
+
+
+const Status PageRead::wait()
+{
+    start();
+    while (!finished) io->poll(true);
+    return status;
+}
+
+
+// the page is installed as readPage installs it, then pinned again for
+// each read that joined this one.  the tasks waiting are resumed last,
+// as they may go on to destroy their PageReads, this one among them
+
+void PageRead::complete(const int res)
+{
+    Status s = OK;
+    io->pageReads.erase(make_pair((const File*) file, pageNo));
+    if (res != (int) file->getPageSize())
+    {
+        pool->bufTable[frameNo].Clear();
+        s = UNIXERR;
+    }
+    else
+    {
+        frameNo = pool->installBuf(file, pageNo, frameNo, ring != NULL);
+        *page = pool->framePage(frameNo);
+        timer.stop(file->stats.readTime);
+        if (!prefetch) timer.stop(pool->poolStats.missTime);
+    }
+
+    for (PageRead* r = joiners; r != NULL; )
+    {
+        PageRead* next = r->nextJoiner;
+        int frame = 0;
+        r->status = s;
+        if (s == OK)
+            r->status = pool->pinResident(file, pageNo, frame, r->ring != NULL);
+        if (r->status == OK) *r->page = pool->framePage(frame);
+        r->finished = true;
+        if (r->waiter) r->waiter.resume();
+        r = next;
+    }
+
+    status = s;
+    finished = true;
+    if (prefetch)
+    {
+        if (s == OK) pool->bufTable[frameNo].pinCnt--;
+        delete this;
+    }
+    else if (waiter) waiter.resume();
+}
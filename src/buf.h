@@ -1,31 +1,72 @@
 #ifndef BUF_H
 #define BUF_H
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
 #include "db.h"
+#include "aio.h"
 // define if debug output wanted
 //#define DEBUGBUF
 
-// declarations for buffer pool hash table
-struct hashBucket
+// number of independently latched partitions of the buffer hash table
+const int PARTITIONBITS = 6;
+const int NUMPARTITIONS = 1 << PARTITIONBITS;
+
+// most frames the page cleaner writes back in one pass, and how
+// often (in milliseconds) it looks at the pool without being woken
+const int CLEANBATCH = 64;
+const int CLEANERWAKEUP = 100;
+
+// declarations for buffer pool hash table.  an entry with a NULL
+// file is empty.
+struct hashEntry
 {
-	File*	file;    // pointer a file object (more on this below)
+	const File*	file;    // pointer a file object (more on this below)
 	int	pageNo;  // page number within a file
 	int	frameNo; // frame number of page in the buffer pool
-	hashBucket* 	next;	 // next node in the hash table
+};
+
+// one independently latched part of the hash table.  each partition
+// is an open addressing (linear probing) table of its own; partitions
+// are cache line aligned so that latching one does not slow down
+// threads working in its neighbours.
+struct alignas(64) hashPartition
+{
+	std::mutex	latch;   // protects slots
+	hashEntry*	slots;   // capacity entries, cache line aligned
+	unsigned	mask;    // capacity - 1, capacity is a power of two
 };
 
 
 // hash table to keep track of pages in the buffer pool
+//
+// The table never allocates after it is constructed: every page in
+// the pool has at most one entry, so it is sized from the number of
+// frames and entries are stored inline in fixed arrays.  The hash of
+// (file,pageNo) picks both the partition (high bits) and the home
+// slot inside it (low bits).
+//
+// insert, lookup and remove do not latch anything themselves: the
+// caller must hold the latch of the partition of (file,pageNo),
+// obtained from latch(), around every call so that it can combine a
+// lookup with pinning the frame it finds.
 class BufHashTbl
 {
 private:
-    int HTSIZE;
-    hashBucket**  ht; // actual hash table
-    int	 hash(const File* file, const int pageNo); // returns value between 0 and HTSIZE-1
+    hashPartition*  parts; // NUMPARTITIONS partitions
+    unsigned long hash(const File* file, const int pageNo) const; // mixes file and pageNo
+    hashPartition& partition(const unsigned long h) const
+      { return parts[h >> (64 - PARTITIONBITS)]; }
 
 public:
-    BufHashTbl(const int htSize);  // constructor
+    BufHashTbl(const int numEntries);  // constructor, at most numEntries pages
     ~BufHashTbl(); // destructor
+
+    // returns the latch of the partition holding (file,pageNo)
+  std::mutex& latch(const File* file, const int pageNo);
 	
     // insert entry into hash table mapping (file,pageNo) to frameNo;
     // returns 0 if OK, HASHTBLERROR if an error occurred
@@ -42,19 +83,150 @@ public:
 };
 
 
+// replacement policies a buffer pool can be created with
+enum Replacement { CLOCKREPL, TWOQREPL };
+
+// how the frames of a buffer pool are allocated, or'ed together.  the
+// pool is always mapped at an address aligned to the memory page
+// size, so frames of 4 KB and up are aligned for direct I/O.  huge
+// pages that cannot be had fall back to normal pages
+const int POOLHUGE2M = 1;       // back the pool with 2 MB huge pages
+const int POOLHUGE1G = 2;       // back the pool with 1 GB huge pages
+const int POOLINTERLEAVE = 4;   // spread the pool over all NUMA nodes
+
+// Replacement policy of a buffer pool.  The buffer manager tells the
+// policy when a frame is loaded with a page and when a resident page
+// is referenced again, and asks it whether an unpinned frame the
+// clock hand has reached may be evicted.  Policies keep their state
+// per frame in atomics since any thread may call them.
+class ReplPolicy
+{
+public:
+  virtual ~ReplPolicy() {}
+
+  // frame has been loaded with a page.  scan is true if the page was
+  // brought in by a sequential scan rather than by a random access
+  virtual void loaded(const int frameNo, const bool scan) = 0;
+
+  // a resident page has been pinned again
+  virtual void referenced(const int frameNo) = 0;
+
+  // the clock hand reached unpinned frame.  returns true if it may
+  // be evicted, otherwise ages the frame and returns false
+  virtual const bool victim(const int frameNo) = 0;
+
+  // true if frame has not been referenced since it was loaded
+  virtual const bool cold(const int frameNo) const = 0;
+
+  // turns of the clock after which any unpinned frame is a victim
+  virtual const int sweeps() const = 0;
+};
+
+// the classic second chance clock with one reference bit per frame
+class ClockPolicy : public ReplPolicy
+{
+private:
+  std::atomic<bool>* refbit; // has this buffer frame been reference recently
+
+public:
+  ClockPolicy(const int bufs);
+  ~ClockPolicy();
+
+  void loaded(const int frameNo, const bool scan);
+  void referenced(const int frameNo);
+  const bool victim(const int frameNo);
+  const bool cold(const int frameNo) const;
+  const int sweeps() const { return 2; }
+};
+
+// 2Q on a clock.  Pages enter on probation (the A1 queue of 2Q) and
+// are evicted the first time the hand reaches them unless they are
+// referenced again in the meantime, which promotes them to the main
+// set (Am).  Main pages lose their reference bit on one turn of the
+// hand and go back on probation on the next, so a large scan only
+// ever replaces pages on probation and the pages that are used over
+// and over stay resident.  Unlike full 2Q no history of evicted
+// pages is kept.
+class TwoQPolicy : public ReplPolicy
+{
+private:
+  enum { PROBATION, MAIN, MAINREF };
+  std::atomic<char>* state;  // one of the above per frame
+
+public:
+  TwoQPolicy(const int bufs);
+  ~TwoQPolicy();
+
+  void loaded(const int frameNo, const bool scan);
+  void referenced(const int frameNo);
+  const bool victim(const int frameNo);
+  const bool cold(const int frameNo) const;
+  const int sweeps() const { return 3; }
+};
+
+
+// A ring of frames private to one sequential scan.  Once the ring is
+// full each page the scan reads replaces the oldest page in the ring
+// (if nobody else has started using it) instead of one chosen by the
+// replacement policy, so a scan of a large file cycles through a few
+// frames rather than flushing the whole pool.  A ring must only be
+// used by one thread at a time.
+class BufRing
+{
+  friend class BufMgr;
+private:
+  int   size;    // number of frames in the ring
+  int   count;   // frames in the ring so far
+  int   next;    // oldest frame once the ring is full
+  int*  frames;  // frame numbers
+
+public:
+  BufRing(const int size);
+  ~BufRing();
+};
+
+
 class BufMgr;  //forward declaration of BufMgr class 
+class LogMgr;
+
+// added to the pin count of a frame by the thread that is trying to
+// take it over (to evict or flush it).  users pin and unpin a claimed
+// frame as usual, the claim only tells other threads that the frame
+// is busy for a short while rather than pinned by a user.
+const int CLAIMPIN = 1 << 30;
 
 // class for maintaining information about buffer pool frames
+//
+// pinCnt and dirty are changed by any thread holding the partition
+// latch of the page.
+// file, pageNo and valid change only while the frame is claimed or
+// pinned by the thread that is (re)loading it.
+//
+// every frame that is in the hash table is also on the list of frames
+// of its file, which is threaded through nextFrame and prevFrame and
+// protected by File::frameLatch.  a frame joins and leaves the list
+// under the partition latch of its page, which is always taken before
+// the latch of the list.
+//
+// with a log attached (see BufMgr::setLog) changes counts the times
+// the frame was unpinned dirty and imaged the count as of its latest
+// image in the log, at lsn.  imageSum is the checksum of that image.
 class BufDesc {
     friend class BufMgr;
+    friend class PageRead;
 private:
-  File* file;   // pointer to file object
-  int   pageNo; // page within file
+  std::atomic<File*> file;   // pointer to file object
+  std::atomic<int>   pageNo; // page within file
   int	frameNo;  // frame # of frame
-  int   pinCnt; // number of times this page has been pinned
-  bool 	dirty;	  // true if dirty;  false otherwise
-  bool 	valid;   // true if page is valid
-  bool  refbit;	 // has this buffer frame been reference recently
+  std::atomic<int>   pinCnt; // number of times this page has been pinned
+  std::atomic<bool>  dirty;	  // true if dirty;  false otherwise
+  std::atomic<bool>  valid;   // true if page is valid
+  int   nextFrame;  // next frame of the same file, -1 if last
+  int   prevFrame;  // previous frame of the same file, -1 if first
+  std::atomic<unsigned> changes;  // dirty unpins, see above
+  std::atomic<unsigned> imaged;   // changes as of the latest image
+  std::atomic<long long> lsn;     // LSN just past the latest image
+  unsigned long imageSum;         // checksum of the latest image
 
   void Clear() {  // initialize buffer frame for a new user
     	pinCnt = 0;
@@ -62,6 +234,9 @@ private:
 	pageNo = -1;
     	dirty = false;
 	valid = false;
+	changes = imaged = 0;
+	lsn = 0;
+	imageSum = 0;
   };
 
   void Set(File* filePtr, int pageNum) { 
@@ -70,10 +245,18 @@ private:
       pinCnt = 1;
       dirty = false;
       valid = true;
-      refbit = true;
+      changes = imaged = 0;
+      lsn = 0;
+      imageSum = 0;
+  }
+
+  const int userPins() const { // pins held by users, ignoring any claim
+      return pinCnt & (CLAIMPIN - 1);
   }
 
   BufDesc() {
+      frameNo = 0;
+      nextFrame = prevFrame = -1;
       Clear();
   }
 };
@@ -81,9 +264,9 @@ private:
 
 struct BufStats
 {
-  int accesses;    // Total number of accesses to buffer pool
-  int diskreads;   // Number of pages read from disk (including allocs)
-  int diskwrites;  // Number of pages written back to disk
+  std::atomic<int> accesses;    // Calls of readPage and allocPage
+  std::atomic<int> diskreads;   // Number of pages read from disk (including allocs)
+  std::atomic<int> diskwrites;  // Number of pages written back to disk
 
   void clear()
     {
@@ -97,36 +280,204 @@ struct BufStats
 };
 
 
+// the state of one buffer frame, see BufMgr::snapshot
+struct FrameState
+{
+  const File* file;   // file of the page in the frame, NULL if none
+  int   pageNo;       // the page, -1 if none
+  int   pinCnt;       // pins held by users
+  bool  dirty;        // true if the page has to be written back
+};
+
+// counts over all frames of a pool
+struct PoolSnapshot
+{
+  int   frames;       // frames in the pool
+  int   valid;        // frames holding a page
+  int   pinned;       // frames pinned by a user
+  int   dirty;        // frames holding a dirty page
+  int   pins;         // pins held by users over all frames
+};
+
+
+// The buffer manager may be used by several threads at once.  A page
+// is found and pinned under the latch of its hash partition, and a
+// frame is only taken over for another page once it has been claimed
+// (see CLAIMPIN) and found unpinned and clean under that same latch.
+// The clock hand is advanced atomically so that the sweep never takes
+// a latch until it has found a candidate frame.
+//
+// If a high dirty watermark is given, a page cleaner thread keeps the
+// number of dirty frames in check: once more than highDirty frames
+// are dirty it writes unpinned dirty frames ahead of the clock hand,
+// sorted and coalesced into runs of adjacent pages, until no more
+// than lowDirty are left.  The clock then normally finds clean
+// victims and a miss does not have to write someone else's page.
+//
+// With a log attached (see log.h) a dirty page is only written back
+// once its latest image is durable in the log.  Evictions and the
+// page cleaner skip dirty frames that are not, and a pool that runs
+// out of frames asks the log for a commit before giving up.
 class BufMgr 
 {
+  friend class LogMgr;
+  friend class LogChange;
+  friend class PageRead;
+
 private:
-  unsigned int 	 clockHand;
+  std::atomic<unsigned int> clockHand;
   int   	 numBufs;    	// Number of pages in buffer pool
+  unsigned	 frameSize;	// size of each buffer frame in bytes
   BufHashTbl*    hashTable;  	// hash table mapping (File, page) to frame
   BufDesc*	 bufTable;  	// vector of status info, 1 per page
   BufStats	 bufStats;	// buffer pool statistics
+  PoolStats	 poolStats;	// finer statistics, see stats.h
+  ReplPolicy*	 policy;	// decides which frames the clock evicts
+
+  int		 lowDirty;	// cleaner stops at this many dirty frames
+  int		 highDirty;	// cleaner starts above this many dirty frames
+  std::atomic<int> numDirty;	// number of dirty frames
+  std::thread*	 cleaner;	// page cleaner thread, NULL if none
+  std::mutex	 cleanerLatch;	// protects stopCleaner
+  std::condition_variable cleanerCond; // wakes up the page cleaner
+  bool		 stopCleaner;	// tells the page cleaner to exit
+
+  LogMgr*	 log;		// log of the pool, NULL if none
+  std::atomic<long> unloggedBytes; // changed since the last commit
+  std::atomic<int> unloggedFrames;
+  std::mutex	 fileLatch;	// protects logFiles
+  vector<File*>	 logFiles;	// files logged or written since the
+				// last checkpoint, synced by the next
 
   const Status allocBuf(int & frame);   // allocate a free frame.  
+  const Status allocRingBuf(BufRing* ring, int & frame); // allocate a frame of ring
+  const bool evictBuf(const int frame, Status& status); // empty a claimed frame
   const void releaseBuf(int frame); // return unused frame to end of list
-  void advanceClock()
+  const bool claimBuf(int frame);   // try to claim an unpinned frame
+  void setDirty(BufDesc* buf);      // mark a frame dirty
+  const bool setClean(BufDesc* buf); // mark a frame clean, true if it was dirty
+  void runCleaner();                // body of the page cleaner thread
+  const int cleanBatch();           // write back one batch of dirty frames
+  void waitUnclaimed(int frame);    // wait until no one has frame claimed
+  void linkFrame(const File* file, const int frame);   // add frame to list of file
+  void unlinkFrame(const File* file, const int frame); // remove frame from list of file
+  const Status flushRun(const File* file, const int* frames,
+                        const int count);  // write and drop claimed frames
+
+  // true if frame may be written back as far as the log goes
+  const bool logSafe(const BufDesc* buf) const;
+  void noteFile(File* file);        // file is to be synced by a checkpoint
+
+  // called by the log, with its latch held.  append an image of
+  // every changed frame (of file only, if it is not NULL) and the
+  // headers of their files
+  void logChanges(LogMgr* log, const File* file);
+  // write back every changed frame and sync the files, for a
+  // checkpoint of the log
+  const Status writeBack();
+  // true if so many frames changed since the last commit that
+  // changes should wait for one
+  const bool logBacklog() const
   {
-	clockHand = (clockHand + 1) % numBufs;
+	return unloggedFrames > numBufs / 2;
+  }
+  unsigned int advanceClock()
+  {
+	return (clockHand.fetch_add(1) + 1) % numBufs;
   }
 
+  Page* framePage(const int frameNo) const // address of a buffer frame
+  {
+	return (Page*)(bufPool + (size_t) frameNo * frameSize);
+  }
+
+  // pin (file,pageNo) if it is resident and return its frame,
+  // otherwise return HASHNOTFOUND.  scan pins do not count as a
+  // reference for the replacement policy
+  const Status pinResident(const File* file, const int pageNo, int& frameNo,
+                           const bool scan);
+
+  // make a frame returned by allocBuf hold (file,pageNo), whose
+  // contents have been read into it.  if another thread loaded the
+  // same page in the meantime that frame is pinned and returned and
+  // the new frame is released.
+  const int installBuf(File* file, const int pageNo, const int frameNo,
+                       const bool scan);
+
 
 public:
-  Page*	         bufPool;   // actual buffer pool
+  char*	         bufPool;   // actual buffer pool, frameSize bytes per frame
+  size_t         poolBytes; // length of the mapping of bufPool
 
-  BufMgr(const int bufs);
+  // a buffer pool can hold pages of any file whose page size
+  // does not exceed frameSize.  the page cleaner runs only if
+  // highDirty is greater than zero.  poolFlags are POOL values
+  BufMgr(const int bufs, const unsigned frameSize = PAGESIZE,
+         const int lowDirty = 0, const int highDirty = 0,
+         const Replacement replacement = CLOCKREPL,
+         const int poolFlags = 0);
   ~BufMgr();
 
-  const Status readPage(File* file, const int PageNo, Page*& page);
+  // number of frames of frameSize bytes that take up fraction of the
+  // memory of the machine.  with files opened OPENDIRECT the pool is
+  // the only cache of their pages and should be sized this way
+  static int framesForMemory(const double fraction, const unsigned frameSize);
+
+  // read and pin a page.  a sequential scan passes its ring so that
+  // the page is read into one of the ring's frames.  pages of a file
+  // opened read-only come straight from its mapping and are not
+  // really pinned
+  const Status readPage(File* file, const int PageNo, Page*& page,
+                        BufRing* ring = NULL);
   const Status unPinPage(File* file, const int PageNo, const bool dirty);
   const Status allocPage(File* file, int& PageNo, Page*& page); 
                         // allocates a new, empty page 
+  const Status prefetchPages(File* file, const int startPageNo,
+                             const int count,
+                             BufRing* ring = NULL); // read a run of pages ahead of use
+
+  // readPage through the IoRing io, without blocking the thread: see
+  // PageRead.  the read starts once the PageRead is awaited, waited
+  // for or started
+  PageRead readPageAsync(File* file, const int pageNo, Page*& page,
+                         IoRing& io, BufRing* ring = NULL);
+  // prefetchPages through io.  the pages missing from the pool are
+  // only queued, and come in as io completes their reads; a page
+  // already being read through io is not read again
+  const Status prefetchPagesAsync(File* file, const int startPageNo,
+                                  const int count, IoRing& io,
+                                  BufRing* ring = NULL);
   const Status flushFile(const File* file); // writing out all dirty pages of the file
   const Status disposePage(File* file, const int PageNo); // dispose of page in file
-  void  printSelf();
+  // the state of every frame, and counts over them.  frames, if not
+  // NULL, is filled with one entry per frame.  frames are looked at
+  // one by one without stopping other threads, so while the pool is
+  // in use this is not an exact picture of any one moment
+  void snapshot(PoolSnapshot & pool, vector<FrameState>* frames = NULL) const;
+  void  printSelf(); // print the snapshot
+
+  // attach the pool to log, or detach it if log is NULL.  the
+  // changes made so far are committed to a log that is detached
+  void setLog(LogMgr* log);
+  LogMgr* getLog() const
+  {
+	return log;
+  }
+
+  // called by DB: file name is about to be destroyed, or file is
+  // being closed and is synced if a checkpoint would have synced it
+  const Status fileDestroyed(const string & name);
+  const Status forgetFile(File* file);
+
+  const int getNumBufs() const // number of frames in the pool
+  {
+	return numBufs;
+  }
+
+  const unsigned getFrameSize() const // largest page size the pool can hold
+  {
+	return frameSize;
+  }
 
   const BufStats & getBufStats() const // get buffer pool usage
   {
@@ -136,7 +487,65 @@ public:
   {
 	bufStats.clear();
   }
+
+  const PoolStats & getPoolStats() const // counters and latencies
+  {
+	return poolStats;
+  }
+  void clearPoolStats()
+  {
+	poolStats.clear();
+  }
 };
 
-#endif
 
+// A read of a page started by BufMgr::readPageAsync, to be awaited in
+// an IoTask.  co_await gives the Status of the read, with the page
+// pinned in page as readPage would leave it.  A page that is resident
+// is pinned at once, and one that is already being read through the
+// same IoRing is waited for rather than read again.  Outside a task
+// wait() polls the ring until the page is in.  A PageRead cannot be
+// copied or moved, and has to stay until it is done.
+class PageRead : public IoOp
+{
+  friend class BufMgr;
+public:
+  PageRead(const PageRead &) = delete;
+  PageRead & operator=(const PageRead &) = delete;
+
+  void start();            // start the read if it has not started yet
+  const Status wait();     // start it and poll until it is done
+  const bool done() const { return finished; }
+
+  bool await_ready() { start(); return finished; }
+  void await_suspend(std::coroutine_handle<> h) { waiter = h; }
+  Status await_resume() const { return status; }
+
+protected:
+  void complete(const int res);
+
+private:
+  BufMgr*   pool;
+  File*     file;
+  int       pageNo;
+  Page**    page;          // where the page goes
+  IoRing*   io;
+  BufRing*  ring;          // ring of the scan reading the page, or NULL
+  bool      prefetch;      // started by prefetchPagesAsync, which
+                           // leaves the page unpinned and this deleted
+  bool      started;
+  bool      finished;
+  Status    status;
+  int       frameNo;       // frame the page is read into
+  Page*     prefetched;    // page of a prefetch
+  StatTimer timer;
+  std::coroutine_handle<> waiter;  // task awaiting the read
+  PageRead* joiners;       // reads of the same page waiting for this
+  PageRead* nextJoiner;    // one, chained through nextJoiner
+
+  PageRead(BufMgr* pool, File* file, const int pageNo, Page** page,
+           IoRing* io, BufRing* ring, const bool prefetch);
+  const Status read();     // take a frame and queue the read into it
+};
+
+#endif
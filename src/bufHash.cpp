@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <stdint.h>
 #include <iostream>
 #include <stdio.h>
 #include "page.h"
@@ -10,36 +11,63 @@
 
 // buffer pool hash table implementation
 
-int BufHashTbl::hash(const File* file, const int pageNo)
+// mix the address of the file object and the page number into 64
+// well distributed bits, so that adjacent pages of different files
+// do not collide (the finalizer of MurmurHash3).
+
+unsigned long BufHashTbl::hash(const File* file, const int pageNo) const
 {
-  int tmp, value;
-  tmp = (long)file;  // cast of pointer to the file object to an integer
-  value = (tmp + pageNo) % HTSIZE;
-  return value;
+  uint64_t h = (uint64_t) (uintptr_t) file;
+  h ^= (uint64_t) (unsigned) pageNo * 0x9E3779B97F4A7C15ULL;
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDULL;
+  h ^= h >> 33;
+  h *= 0xC4CEB9FE1A85EC53ULL;
+  h ^= h >> 33;
+  return h;
 }
 
 
-BufHashTbl::BufHashTbl(int htSize)
+BufHashTbl::BufHashTbl(int numEntries)
 {
-  HTSIZE = htSize;
-  // allocate an array of pointers to hashBuckets
-  ht = new hashBucket* [htSize];
-  for(int i=0; i < HTSIZE; i++)
-    ht[i] = NULL;
+  // give every partition room for twice its share of the entries
+  // plus some slack, so that partitions stay at most half full even
+  // when the entries are not spread evenly
+  unsigned capacity = 16;
+  while (capacity < (unsigned) (2 * (numEntries / NUMPARTITIONS) + 32))
+    capacity *= 2;
+
+  parts = new hashPartition [NUMPARTITIONS];
+  for (int i = 0; i < NUMPARTITIONS; i++) {
+    void* mem;
+    if (posix_memalign(&mem, 64, capacity * sizeof(hashEntry)) != 0) {
+      cerr << "unable to allocate the buffer hash table" << endl;
+      exit(1);
+    }
+    parts[i].slots = (hashEntry*) mem;
+    parts[i].mask = capacity - 1;
+    for (unsigned j = 0; j < capacity; j++)
+      parts[i].slots[j].file = NULL;
+  }
 }
 
 
 BufHashTbl::~BufHashTbl()
 {
-  for(int i = 0; i < HTSIZE; i++) {
-    hashBucket* tmpBuf = ht[i];
-    while (ht[i]) {
-      tmpBuf = ht[i];
-      ht[i] = ht[i]->next;
-      delete tmpBuf;
-    }
-  }
-  delete [] ht;
+  for (int i = 0; i < NUMPARTITIONS; i++)
+    free(parts[i].slots);
+  delete [] parts;
+}
+
+
+//---------------------------------------------------------------
+// returns the latch protecting the partition that (file,pageNo)
+// hashes to
+//---------------------------------------------------------------
+
+std::mutex& BufHashTbl::latch(const File* file, const int pageNo)
+{
+  return partition(hash(file, pageNo)).latch;
 }
 
 
@@ -50,25 +78,24 @@ BufHashTbl::~BufHashTbl()
 
 Status BufHashTbl::insert(const File* file, const int pageNo, const int frameNo) {
 
-  int index = hash(file, pageNo);
+  unsigned long h = hash(file, pageNo);
+  hashPartition& part = partition(h);
+  unsigned i = h & part.mask;
 
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
+  for (unsigned n = 0; n <= part.mask; n++, i = (i + 1) & part.mask) {
+    hashEntry* tmpEnt = &part.slots[i];
+    if (tmpEnt->file == NULL) {
+      tmpEnt->file = file;
+      tmpEnt->pageNo = pageNo;
+      tmpEnt->frameNo = frameNo;
+      return OK;
+    }
+    if (tmpEnt->file == file && tmpEnt->pageNo == pageNo)
       return HASHTBLERROR;
-    tmpBuc = tmpBuc->next;
   }
 
-  tmpBuc = new hashBucket;
-  if (!tmpBuc)
-    return HASHTBLERROR;
-  tmpBuc->file = (File*) file;
-  tmpBuc->pageNo = pageNo;
-  tmpBuc->frameNo = frameNo;
-  tmpBuc->next = ht[index];
-  ht[index] = tmpBuc;
-
-  return OK;
+  // partition is full
+  return HASHTBLERROR;
 }
 
 
@@ -80,15 +107,19 @@ Status BufHashTbl::insert(const File* file, const int pageNo, const int frameNo)
 
 Status BufHashTbl::lookup(const File* file, const int pageNo, int& frameNo) 
   {
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo)
+  unsigned long h = hash(file, pageNo);
+  hashPartition& part = partition(h);
+  unsigned i = h & part.mask;
+
+  for (unsigned n = 0; n <= part.mask; n++, i = (i + 1) & part.mask) {
+    hashEntry* tmpEnt = &part.slots[i];
+    if (tmpEnt->file == NULL)
+      break;
+    if (tmpEnt->file == file && tmpEnt->pageNo == pageNo)
     {
-      frameNo = tmpBuc->frameNo; // return frameNo by reference
+      frameNo = tmpEnt->frameNo; // return frameNo by reference
       return OK;
     }
-    tmpBuc = tmpBuc->next;
   }
   return HASHNOTFOUND;
 }
@@ -97,27 +128,45 @@ Status BufHashTbl::lookup(const File* file, const int pageNo, int& frameNo)
 //-------------------------------------------------------------------
 // delete entry (file,pageNo) from hash table. REturn OK if page was
 // found.  Else return HASHTBLERROR
+//
+// entries after the removed one are shifted back into the hole when
+// that is still on their probe path, so no tombstones are needed and
+// lookups stop at the first empty slot.
 //-------------------------------------------------------------------
 
 Status BufHashTbl::remove(const File* file, const int pageNo) {
 
-  int index = hash(file, pageNo);
-  hashBucket* tmpBuc = ht[index];
-  hashBucket* prevBuc = ht[index];
-
-  while (tmpBuc) {
-    if (tmpBuc->file == file && tmpBuc->pageNo == pageNo) {
-      if (tmpBuc == ht[index]) 
-	ht[index] = tmpBuc->next;
-      else
-	prevBuc->next = tmpBuc->next;
-      delete tmpBuc;
-      return OK;
-    } else {
-      prevBuc = tmpBuc;
-      tmpBuc = tmpBuc->next;
+  unsigned long h = hash(file, pageNo);
+  hashPartition& part = partition(h);
+  unsigned i = h & part.mask;
+  unsigned n;
+
+  for (n = 0; n <= part.mask; n++, i = (i + 1) & part.mask) {
+    hashEntry* tmpEnt = &part.slots[i];
+    if (tmpEnt->file == NULL)
+      return HASHTBLERROR;
+    if (tmpEnt->file == file && tmpEnt->pageNo == pageNo)
+      break;
+  }
+  if (n > part.mask)
+    return HASHTBLERROR;
+
+  unsigned j = i;
+  while (true) {
+    j = (j + 1) & part.mask;
+    hashEntry* tmpEnt = &part.slots[j];
+    if (tmpEnt->file == NULL)
+      break;
+
+    // move the entry at j into the hole at i unless its home slot
+    // lies after the hole, in which case it is reachable already
+    unsigned home = hash(tmpEnt->file, tmpEnt->pageNo) & part.mask;
+    if (((j - home) & part.mask) >= ((j - i) & part.mask)) {
+      part.slots[i] = *tmpEnt;
+      i = j;
     }
   }
+  part.slots[i].file = NULL;
 
-  return HASHTBLERROR;
+  return OK;
 }
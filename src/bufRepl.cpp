@@ -0,0 +1,105 @@
+#include "page.h"
+#include "buf.h"
+
+// buffer replacement policies and scan rings
+
+
+ClockPolicy::ClockPolicy(const int bufs)
+{
+    refbit = new std::atomic<bool>[bufs];
+    for (int i = 0; i < bufs; i++) refbit[i] = false;
+}
+
+
+ClockPolicy::~ClockPolicy()
+{
+    delete [] refbit;
+}
+
+
+// a page read by a scan starts without its reference bit, so the
+// hand takes it on its next visit
+void ClockPolicy::loaded(const int frameNo, const bool scan)
+{
+    refbit[frameNo] = !scan;
+}
+
+
+void ClockPolicy::referenced(const int frameNo)
+{
+    refbit[frameNo] = true;
+}
+
+
+// has been referenced, clear the bit and give it a second chance
+const bool ClockPolicy::victim(const int frameNo)
+{
+    return !refbit[frameNo].exchange(false);
+}
+
+
+const bool ClockPolicy::cold(const int frameNo) const
+{
+    return !refbit[frameNo];
+}
+
+
+TwoQPolicy::TwoQPolicy(const int bufs)
+{
+    state = new std::atomic<char>[bufs];
+    for (int i = 0; i < bufs; i++) state[i] = PROBATION;
+}
+
+
+TwoQPolicy::~TwoQPolicy()
+{
+    delete [] state;
+}
+
+
+// every page starts on probation, whoever reads it
+void TwoQPolicy::loaded(const int frameNo, const bool scan)
+{
+    state[frameNo] = PROBATION;
+}
+
+
+// a second reference promotes the page to the main set
+void TwoQPolicy::referenced(const int frameNo)
+{
+    state[frameNo] = MAINREF;
+}
+
+
+// pages on probation go first, main pages are aged one step
+const bool TwoQPolicy::victim(const int frameNo)
+{
+    char s = state[frameNo];
+    while (s != PROBATION)
+    {
+        char aged = (s == MAINREF) ? MAIN : PROBATION;
+        if (state[frameNo].compare_exchange_weak(s, aged)) return false;
+    }
+    return true;
+}
+
+
+const bool TwoQPolicy::cold(const int frameNo) const
+{
+    return state[frameNo] == PROBATION;
+}
+
+
+BufRing::BufRing(const int size_)
+{
+    size = size_ > 0 ? size_ : 1;
+    count = 0;
+    next = 0;
+    frames = new int[size];
+}
+
+
+BufRing::~BufRing()
+{
+    delete [] frames;
+}
@@ -3,6 +3,9 @@
 #include <errno.h>
 #include <stdlib.h>
 #include <fcntl.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include <iostream>
 #include <math.h>
 #include <stdio.h>
@@ -131,6 +134,16 @@ File::File(const string & fname)
   fileName = fname;
   openCnt = 0;
   unixFile = -1;
+  pageSize = 0;
+  hdrDirty = false;
+  diskPages = 0;
+  firstFrame = -1;
+  mapBase = NULL;
+  mapLength = 0;
+  direct = false;
+  bounce = NULL;
+  openMode = 0;
+  lingering = false;
 }
 
 // Deallocate a file object
@@ -152,9 +165,13 @@ File::~File()
     }
 }
 
-Status const File::create(const string & fileName)
+Status const File::create(const string & fileName,
+                          const unsigned pageSize)
 {
   int file;
+  if (!validPageSize(pageSize))
+    return BADPAGESIZE;
+
   if ((file = ::open(fileName.c_str(), O_CREAT | O_EXCL | O_WRONLY, 0666)) < 0)
     {
       if (errno == EEXIST)
@@ -170,7 +187,8 @@ Status const File::create(const string & fileName)
   DBP(header).nextFree = -1;
   DBP(header).firstPage = -1;
   DBP(header).numPages = 1;
-  if (write(file, (char*)&header, sizeof header) != sizeof header)
+  DBP(header).pageSize = pageSize;
+  if (write(file, (char*)&header, pageSize) != (int) pageSize)
     return UNIXERR;
 
   if (::close(file) < 0)
@@ -190,19 +208,109 @@ const Status File::destroy(const string & fileName)
   return OK;
 }
 
-const Status File::open()
+// A file opened OPENREADONLY is mapped into memory as a whole and its
+// pages are handed out by the buffer manager as pointers into the
+// mapping, with no frame and no copy.  Nothing can be written to it
+// until it is closed; later openers that want to write get
+// FILEREADONLY.
+//
+// A file opened OPENDIRECT is read and written with O_DIRECT, so its
+// pages are only cached in the buffer pool.  Its pages must be at
+// least DIRECTALIGN bytes, and so must the frames of the buffer pool,
+// which then are aligned to DIRECTALIGN (see BufMgr).  On a file
+// system without O_DIRECT the file is opened for ordinary I/O, and
+// isDirect() is false.
+//
+// The mode only matters to the first opener; later ones share the
+// open file as it is.
+
+const Status File::open(const int mode)
 {
+  const bool readOnly = (mode & OPENREADONLY) != 0;
+
   // Open file -- it will be closed in closeFile().
 
   if (openCnt == 0)
     {
-      if ((unixFile = ::open(fileName.c_str(), O_RDWR)) < 0)
+      if ((unixFile = ::open(fileName.c_str(),
+                             readOnly ? O_RDONLY : O_RDWR)) < 0)
 	return UNIXERR;
 
+      // The page size of the file is kept in the DB header page
+      // and has to be known before any page can be read.  The header
+      // stays in memory until the file is closed.
+
+      struct stat st;
+      if (pread(unixFile, (char*)&header, sizeof header, 0) != sizeof header
+	  || fstat(unixFile, &st) < 0)
+	{
+	  ::close(unixFile);
+	  return UNIXERR;
+	}
+      if (!validPageSize(header.pageSize))
+	{
+	  ::close(unixFile);
+	  return BADPAGESIZE;
+	}
+      pageSize = header.pageSize;
+      hdrDirty = false;
+      diskPages = st.st_size / pageSize;
+      if (posix_memalign((void**) &bounce, DIRECTALIGN, pageSize) != 0)
+	{
+	  ::close(unixFile);
+	  return UNIXERR;
+	}
+
+      // direct I/O is only turned on once the header has been read,
+      // with ordinary I/O into an unaligned buffer
+      direct = false;
+      if ((mode & OPENDIRECT) && !readOnly)
+	{
+	  if (pageSize < DIRECTALIGN)
+	    {
+	      ::close(unixFile);
+	      free(bounce);
+	      bounce = NULL;
+	      return BADPAGESIZE;
+	    }
+#ifdef O_DIRECT
+	  // a file system without O_DIRECT refuses it with EINVAL; the
+	  // file is then read and written through the OS cache
+	  int flags = fcntl(unixFile, F_GETFL);
+	  if (flags >= 0 && fcntl(unixFile, F_SETFL, flags | O_DIRECT) == 0)
+	    direct = true;
+	  else if (flags < 0 || errno != EINVAL)
+	    {
+	      ::close(unixFile);
+	      free(bounce);
+	      bounce = NULL;
+	      return UNIXERR;
+	    }
+#endif
+	}
+
+      if (readOnly)
+	{
+	  mapLength = (size_t) diskPages * pageSize;
+	  void* base = mmap(NULL, mapLength, PROT_READ, MAP_SHARED,
+			    unixFile, 0);
+	  if (base == MAP_FAILED)
+	    {
+	      ::close(unixFile);
+	      free(bounce);
+	      bounce = NULL;
+	      return UNIXERR;
+	    }
+	  mapBase = (char*) base;
+	}
+
       // Store file info in open files table.
 
+      openMode = mode;
       openCnt = 1;
     }
+  else if (!readOnly && isReadOnly())
+    return FILEREADONLY;
   else
     openCnt++;
 
@@ -223,7 +331,17 @@ const Status File::close()
     if (bufMgr)
       bufMgr->flushFile(this);
 
-    if (::close(unixFile) < 0)
+    Status status = flushHeader();
+    if (bufMgr && status == OK)
+      status = bufMgr->forgetFile(this);
+    if (mapBase)
+      {
+	munmap(mapBase, mapLength);
+	mapBase = NULL;
+      }
+    free(bounce);
+    bounce = NULL;
+    if (::close(unixFile) < 0 || status != OK)
       return UNIXERR;
   }
 
@@ -233,49 +351,52 @@ const Status File::close()
 
 // Allocate a page either from a free list (list of pages which
 // were previously disposed of), or extend file if no free pages
-// are available.
+// are available.  Only the cached header is updated; it is written
+// back when the file is closed or flushHeader() is called.  The file
+// is grown EXTENTPAGES at a time, and the new pages read as zeros
+// without being written.
 
 Status File::allocatePage(int& pageNo)
 {
-  Page header;
   Status status;
-
-  if ((status = intread(0, &header)) != OK)
-    return status;
+  std::lock_guard<std::mutex> guard(hdrLatch);
+  if (isReadOnly())
+    return FILEREADONLY;
 
   // If free list has pages on it, take one from there
   // and adjust free list accordingly.
 
-  if (DBP(header).nextFree != -1) {     // free list exists?
+  if (header.nextFree != -1) {          // free list exists?
 
     // Return first page on free list to the caller,
     // adjust free list accordingly.
 
-    pageNo = DBP(header).nextFree;
-    Page firstFree;
-    if ((status = intread(pageNo, &firstFree)) != OK)
+    pageNo = header.nextFree;
+    DBPage firstFree;
+    if ((status = intsmall(pageNo, &firstFree, sizeof firstFree,
+                           false)) != OK)
       return status;
-    DBP(header).nextFree = DBP(firstFree).nextFree;
+    header.nextFree = firstFree.nextFree;
 
   } else {                              // no free list, have to extend file
 
     // Extend file -- the current number of pages will be
     // the page number of the page to be returned.
 
-    pageNo = DBP(header).numPages;
-    Page newPage;
-    memset(&newPage, 0, sizeof newPage);
-    if ((status = intwrite(pageNo, &newPage)) != OK)
-      return status;
+    pageNo = header.numPages;
+    if (pageNo >= diskPages) {
+      int newPages = pageNo + EXTENTPAGES;
+      if ((status = extend(newPages)) != OK)
+        return status;
+      diskPages = newPages;
+    } 
 
-    DBP(header).numPages++;
+    header.numPages++;
 
-    if (DBP(header).firstPage == -1)    // first user page in file?
-      DBP(header).firstPage = pageNo;
+    if (header.firstPage == -1)         // first user page in file?
+      header.firstPage = pageNo;
   }
-
-  if ((status = intwrite(0, &header)) != OK)
-    return status;
+  hdrDirty = true;
   
 #ifdef DEBUGFREE
   listFree();
@@ -285,41 +406,68 @@ Status File::allocatePage(int& pageNo)
 }
 
 
+// Return the address of page pageNo in the mapping of a read-only
+// file, or NULL if the page is not in the file.
+
+Page* File::mappedPage(const int pageNo) const
+{
+  if (pageNo < 1 || (size_t) (pageNo + 1) * pageSize > mapLength)
+    return NULL;
+  return (Page*) (mapBase + (size_t) pageNo * pageSize);
+}
+
+
+// Make the file numPages pages long.  fallocate() reserves the space
+// without writing it where the file system supports that, otherwise
+// the file is just made longer; either way the new pages read as zeros.
+
+const Status File::extend(const int numPages)
+{
+  off_t length = (off_t) numPages * pageSize;
+
+#ifdef __linux__
+  if (fallocate(unixFile, 0, 0, length) == 0)
+    return OK;
+#endif
+
+  if (ftruncate(unixFile, length) < 0)
+    return UNIXERR;
+
+  return OK;
+}
+
+
 // Deallocate a page from file. The page will be put on a free
 // list and returned back to the caller upon a subsequent
 // allocPage() call.
 
 const Status File::disposePage(const int pageNo)
 {
+  if (isReadOnly())
+    return FILEREADONLY;
   if (pageNo < 1)
     return BADPAGENO;
 
-  Page header;
   Status status;
-
-  if ((status = intread(0, &header)) != OK)
-    return status;
+  std::lock_guard<std::mutex> guard(hdrLatch);
 
   // The first user-allocated page in the file cannot be
   // disposed of. The File layer has no knowledge of what
   // is the next page in the file and hence would not be
   // able to adjust the firstPage field in file header.
 
-  if (DBP(header).firstPage == pageNo || pageNo >= DBP(header).numPages)
+  if (header.firstPage == pageNo || pageNo >= header.numPages)
     return BADPAGENO;
 
   // Deallocate page by attaching it to the free list.
 
-  Page away;
-  if ((status = intread(pageNo, &away)) != OK)
-    return status;
+  DBPage away;
   memset(&away, 0, sizeof away);
-  DBP(away).nextFree = DBP(header).nextFree;
-  DBP(header).nextFree = pageNo;
+  away.nextFree = header.nextFree;
+  header.nextFree = pageNo;
+  hdrDirty = true;
 
-  if ((status = intwrite(pageNo, &away)) != OK)
-    return status;
-  if ((status = intwrite(0, &header)) != OK)
+  if ((status = intsmall(pageNo, &away, sizeof away, true)) != OK)
     return status;
 
 #ifdef DEBUGFREE
@@ -330,26 +478,46 @@ const Status File::disposePage(const int pageNo)
 }
 
 
+// Write the cached header back to page 0 if it has changed.  Called
+// when the file is closed; may be called at any time to checkpoint
+// the allocation state of an open file.
+
+const Status File::flushHeader()
+{
+  std::lock_guard<std::mutex> guard(hdrLatch);
+  if (!hdrDirty)
+    return OK;
+
+  Status status = intsmall(0, &header, sizeof header, true);
+  if (status != OK)
+    return status;
+  hdrDirty = false;
+
+  return OK;
+}
+
+
 // Read a page from file and store page contents at the page address
-// provided by the caller.
+// provided by the caller.  pread() is used so that the file offset
+// is never shared state and a single read is issued per page.
 
 const Status File::intread(int pageNo, Page* pagePtr) const
 {
-  if (lseek(unixFile, pageNo * sizeof(Page), SEEK_SET) == -1)
-    return UNIXERR;
-
-  int nbytes = read(unixFile, (char*)pagePtr, sizeof(Page));
+  StatTimer timer;
+  int nbytes = pread(unixFile, (char*)pagePtr, pageSize,
+                     (off_t) pageNo * pageSize);
+  timer.stop(stats.readTime);
 
 #ifdef DEBUGIO
-  cerr << "%%  File " << (int)this << ": read bytes ";
-  cerr << pageNo * sizeof(Page) << ":+" << nbytes << endl;
+  cerr << "%%  File " << (void*)this << ": read bytes ";
+  cerr << pageNo * pageSize << ":+" << nbytes << endl;
   cerr << "%%  ";
   for(int i = 0; i < 10; i++)
     cerr << *((int*)pagePtr + i) << " ";
   cerr << endl;
 #endif
 
-  if (nbytes != sizeof(Page))
+  if (nbytes != (int) pageSize)
     return UNIXERR;
 
   return OK;
@@ -361,27 +529,122 @@ const Status File::intread(int pageNo, Page* pagePtr) const
 
 const Status File::intwrite(const int pageNo, const Page* pagePtr)
 {
-  if (lseek(unixFile, pageNo * sizeof(Page), SEEK_SET) == -1)
-    return UNIXERR;
-
-  int nbytes = write(unixFile, (char*)pagePtr, sizeof(Page));
+  StatTimer timer;
+  int nbytes = pwrite(unixFile, (const char*)pagePtr, pageSize,
+                      (off_t) pageNo * pageSize);
+  timer.stop(stats.writeTime);
 
 #ifdef DEBUGIO
-  cerr << "%%  File " << (int)this << ": wrote bytes ";
-  cerr << pageNo * sizeof(Page) << ":+" << nbytes << endl;
+  cerr << "%%  File " << (void*)this << ": wrote bytes ";
+  cerr << pageNo * pageSize << ":+" << nbytes << endl;
   cerr << "%%  ";
   for(int i = 0; i < 10; i++)
     cerr << *((int*)pagePtr + i) << " ";
   cerr << endl;
 #endif
 
-  if (nbytes != sizeof(Page))
+  if (nbytes != (int) pageSize)
     return UNIXERR;
 
   return OK;
 }
 
 
+// Read or write the first length bytes of page pageNo, through the
+// aligned bounce page so that this works with direct I/O too.  The
+// rest of a page that is written is zeroed.  The caller holds
+// hdrLatch, or is opening or closing the file.
+
+const Status File::intsmall(const int pageNo, void* data,
+                            const size_t length, const bool writing)
+{
+  off_t offset = (off_t) pageNo * pageSize;
+  ssize_t nbytes;
+
+  if (writing)
+    {
+      memset(bounce, 0, pageSize);
+      memcpy(bounce, data, length);
+      nbytes = pwrite(unixFile, bounce, pageSize, offset);
+    } 
+  else
+    {
+      nbytes = pread(unixFile, bounce, pageSize, offset);
+      if (nbytes == (ssize_t) pageSize)
+        memcpy(data, bounce, length);
+    } 
+
+  if (nbytes != (ssize_t) pageSize)
+    return UNIXERR;
+
+  return OK;
+}
+
+
+// Read or write count consecutive pages starting at startPageNo with
+// as few preadv()/pwritev() calls as possible.  The pages live at
+// arbitrary addresses (typically buffer frames), one iovec per page.
+// Short transfers are resumed where they stopped; reading past the
+// end of the file is an error.
+
+const Status File::intvector(const int startPageNo, const int count,
+                             Page* const* pages, const bool writing) const
+{
+  struct iovec iov[MAXIOVPAGES];
+  int done = 0;
+  StatTimer timer;
+
+  while (done < count) {
+    int n = count - done;
+    if (n > MAXIOVPAGES) n = MAXIOVPAGES;
+
+    for (int i = 0; i < n; i++) {
+      iov[i].iov_base = (char*) pages[done + i];
+      iov[i].iov_len = pageSize;
+    } 
+
+    off_t offset = (off_t) (startPageNo + done) * pageSize;
+    size_t left = (size_t) n * pageSize;
+    struct iovec* cur = iov;
+    int curCnt = n;
+
+    while (left > 0) {
+      ssize_t nbytes = writing ? pwritev(unixFile, cur, curCnt, offset)
+                               : preadv(unixFile, cur, curCnt, offset);
+      if (nbytes < 0 && errno == EINTR)
+        continue;
+      if (nbytes <= 0)
+        return UNIXERR;
+
+#ifdef DEBUGIO
+      cerr << "%%  File " << (void*)this
+           << (writing ? ": wrote bytes " : ": read bytes ");
+      cerr << offset << ":+" << nbytes << endl;
+#endif
+
+      offset += nbytes;
+      left -= nbytes;
+
+      // skip the iovecs that were completely transferred and
+      // trim the one that was transferred in part
+      while (curCnt > 0 && (size_t) nbytes >= cur->iov_len) {
+        nbytes -= cur->iov_len;
+        cur++;
+        curCnt--;
+      }
+      if (curCnt > 0) {
+        cur->iov_base = (char*) cur->iov_base + nbytes;
+        cur->iov_len -= nbytes;
+      }
+    } 
+    done += n;
+  }
+  timer.stop(writing ? stats.runWriteTime : stats.runReadTime);
+
+  return OK;
+}
+
+
 // Read a page from file, check parameters for validity.
 
 const Status File::readPage(const int pageNo, Page* pagePtr) const
@@ -395,10 +658,28 @@ const Status File::readPage(const int pageNo, Page* pagePtr) const
 }
 
 
+// Queue a read of a page on ring, check parameters for validity.  op
+// is told once the page is in pagePtr, see IoRing::read.
+
+const Status File::readPageAsync(const int pageNo, Page* pagePtr,
+                                 IoRing& ring, IoOp* op) const
+{
+  if (!pagePtr)
+    return BADPAGEPTR;
+  if (pageNo < 1)
+    return BADPAGENO;
+
+  ring.read(unixFile, pagePtr, pageSize, (off_t) pageNo * pageSize, op);
+  return OK;
+}
+
+
 // Write a page to file, check parameters for validity.
 
 const Status File::writePage(const int pageNo, const Page *pagePtr)
 {
+  if (isReadOnly())
+    return FILEREADONLY;
   if (!pagePtr)
     return BADPAGEPTR;
   if (pageNo < 1)
@@ -408,18 +689,103 @@ const Status File::writePage(const int pageNo, const Page *pagePtr)
 }
 
 
+// Read count pages starting at startPageNo into pages[0..count-1]
+// using vectored I/O, check parameters for validity.
+
+const Status File::readPages(const int startPageNo, const int count,
+                             Page** pages) const
+{
+  if (!pages)
+    return BADPAGEPTR;
+  if (startPageNo < 1 || count < 1)
+    return BADPAGENO;
+  for (int i = 0; i < count; i++)
+    if (!pages[i])
+      return BADPAGEPTR;
+
+  return intvector(startPageNo, count, pages, false);
+}
+
+
+// Write pages[0..count-1] to count pages starting at startPageNo
+// using vectored I/O, check parameters for validity.
+
+const Status File::writePages(const int startPageNo, const int count,
+                              const Page* const* pages)
+{
+  if (isReadOnly())
+    return FILEREADONLY;
+  if (!pages)
+    return BADPAGEPTR;
+  if (startPageNo < 1 || count < 1)
+    return BADPAGENO;
+  for (int i = 0; i < count; i++)
+    if (!pages[i])
+      return BADPAGEPTR;
+
+  return intvector(startPageNo, count, (Page* const*) pages, true);
+}
+
+
 // Return the number of the first page in file. It is stored
 // on the file's header page (field firstPage).
 
 const Status File::getFirstPage(int& pageNo) const
 {
-  Page header;
-  Status status;
+  std::lock_guard<std::mutex> guard(hdrLatch);
+  pageNo = header.firstPage;
 
-  if ((status = intread(0, &header)) != OK)
-    return status;
+  return OK;
+}
+
+
+// Return the number of pages in file, including the DB header page.
+// Pages the file has been grown by but that are not allocated yet do
+// not count.
+
+const Status File::getNumPages(int& numPages) const
+{
+  std::lock_guard<std::mutex> guard(hdrLatch);
+  numPages = header.numPages;
+
+  return OK;
+}
+
+
+// Tell the kernel that count pages starting at startPageNo will be
+// read soon.  The kernel starts reading them in the background; the
+// call itself does not wait for any I/O.
+
+const Status File::advisePages(const int startPageNo, const int count) const
+{
+  if (startPageNo < 1 || count < 1)
+    return BADPAGENO;
+
+  // the OS cache is not used for a direct file
+  if (direct)
+    return OK;
+
+  // for a mapped file the pages have to be brought into the mapping,
+  // whose advice works on whole pages of memory
+  if (mapBase)
+    {
+      size_t osPage = sysconf(_SC_PAGESIZE);
+      size_t start = (size_t) startPageNo * pageSize;
+      size_t end = (size_t) (startPageNo + count) * pageSize;
+      if (end > mapLength)
+        end = mapLength;
+      start -= start % osPage;
+      if (start < end
+          && madvise(mapBase + start, end - start, MADV_WILLNEED) != 0)
+        return UNIXERR;
+      return OK;
+    } 
 
-  pageNo = DBP(header).firstPage;
+#ifdef POSIX_FADV_WILLNEED
+  if (posix_fadvise(unixFile, (off_t) startPageNo * pageSize,
+                    (off_t) count * pageSize, POSIX_FADV_WILLNEED) != 0)
+    return UNIXERR;
+#endif
 
   return OK;
 }
@@ -431,16 +797,16 @@ const Status File::getFirstPage(int& pageNo) const
 
 void File::listFree()
 {
-  cerr << "%%  File " << (int)this << " free pages:";
-  int pageNo = 0;
+  cerr << "%%  File " << (void*)this << " free pages:";
+  int pageNo = header.nextFree;
   for(int i = 0; i < 10; i++) {
+    cerr << " " << pageNo;
+    if (pageNo == -1)
+      break;
     Page page;
     if (intread(pageNo, &page) != OK)
       break;
     pageNo = DBP(page).nextFree;
-    cerr << " " << pageNo;
-    if (pageNo == -1)
-      break;
   }
   cerr << endl;
 }
@@ -449,14 +815,25 @@ void File::listFree()
 
 // Construct a DB object which keeps track of creating, opening, and
 // closing files.
+//
+// When the last user of a file closes it, the file lingers: it stays
+// open, with its header in memory and its pages in the buffer pool
+// (dirty ones are written back as the pool needs frames or by the
+// page cleaner), so that opening it again right away costs nothing.
+// Only the header is written, as a close would.  A lingering file is
+// really closed when more than lingerLimit files linger, oldest
+// first, when it is opened again with another mode, and before it is
+// destroyed.
 
 DB::DB()
 {
-  // Check that DB header page data fits on a regular data page.
+  lingerLimit = LINGERFILES;
 
-  if (sizeof(DBPage) >= sizeof(Page)) {
-    cerr << "sizeof(DBPage) cannot exceed sizeof(Page): "
-         << sizeof(DBPage) << " " << sizeof(Page) << endl;
+  // Check that DB header page data fits on the smallest data page.
+
+  if (sizeof(DBPage) >= MINPAGESIZE) {
+    cerr << "sizeof(DBPage) cannot exceed MINPAGESIZE: "
+         << sizeof(DBPage) << " " << MINPAGESIZE << endl;
     exit(1);
   }
 }
@@ -468,15 +845,47 @@ DB::~DB()
 {
   // this could leave some open files open.
   // need to fix this by iterating through the hash table deleting each open file
+  setLingerLimit(0);
+}
+
+
+// close a lingering file for real.  the caller holds latch
+const Status DB::closeLingering(File* file)
+{
+  lingering.remove(file);
+  file->lingering = false;
+  file->openCnt = 1;
+  Status status = file->close();
+  if (openFiles.erase(file->fileName) != OK && status == OK)
+    status = BADFILEPTR;
+  delete file;
+  return status;
+}
+
+
+const Status DB::setLingerLimit(const int files)
+{
+  Status status = OK;
+  std::lock_guard<std::mutex> guard(latch);
+
+  if (files < 0) return BADFILE;
+  lingerLimit = files;
+  while ((int) lingering.size() > lingerLimit) {
+    Status s = closeLingering(lingering.back());
+    if (status == OK) status = s;
+  }
+  return status;
 }
 
 
   
 // Create a database file.
 
-const Status DB::createFile(const string &fileName) 
+const Status DB::createFile(const string &fileName,
+                            const unsigned pageSize)
 {
   File*  file;
+  std::lock_guard<std::mutex> guard(latch);
   if (fileName.empty())
     return BADFILE;
 
@@ -484,7 +893,7 @@ const Status DB::createFile(const string &fileName)
   if (openFiles.find(fileName, file) == OK) return FILEEXISTS;
 
   // Do the actual work
-  return File::create(fileName);
+  return File::create(fileName, pageSize);
 }
 
 
@@ -493,12 +902,24 @@ const Status DB::createFile(const string &fileName)
 const Status DB::destroyFile(const string & fileName) 
 {
   File* file;
+  std::lock_guard<std::mutex> guard(latch);
 
   if (fileName.empty()) return BADFILE;
 
-  // Make sure file is not open currently.
-  if (openFiles.find(fileName, file) == OK) return FILEOPEN;
+  // Make sure file is not open currently.  a lingering file is only
+  // closed now, its pages leaving the pool
+  if (openFiles.find(fileName, file) == OK) {
+    if (!file->lingering) return FILEOPEN;
+    Status status = closeLingering(file);
+    if (status != OK) return status;
+  }
   
+  // a log must not bring back pages of the file once it is gone
+  if (bufMgr) {
+    Status status = bufMgr->fileDestroyed(fileName);
+    if (status != OK) return status;
+  }
+
   // Do the actual work
   return File::destroy(fileName);
 }
@@ -508,19 +929,36 @@ const Status DB::destroyFile(const string & fileName)
 // otherwise find a vacant slot in the open files table and store
 // file info there.
 
-const Status DB::openFile(const string & fileName, File*& filePtr)
+const Status DB::openFile(const string & fileName, File*& filePtr,
+                          const int mode)
 {
   Status status;
   File* file;
+  std::lock_guard<std::mutex> guard(latch);
 
   if (fileName.empty()) return BADFILE;
 
+  // a lingering file is taken up again if it was opened the same way
+  if (openFiles.find(fileName, file) == OK && file->lingering)
+  {
+      if (file->openMode == mode)
+	{
+	  lingering.remove(file);
+	  file->lingering = false;
+	  file->openCnt = 1;
+	  filePtr = file;
+	  return OK;
+	}
+      status = closeLingering(file);
+      if (status != OK) return status;
+  }
+
   // Check if file already open. 
   if (openFiles.find(fileName, file) == OK) 
   {
       // file is already open, call open again on the file object
       // to increment it's open count.
-      status = file->open();
+      status = file->open(mode);
       filePtr = file;
   }
   else
@@ -528,7 +966,7 @@ const Status DB::openFile(const string & fileName, File*& filePtr)
       // file is not already open
       // Otherwise create a new file object and open it
       filePtr = new File(fileName);
-      status = filePtr->open();
+      status = filePtr->open(mode);
 
       if (status != OK)
 	{
@@ -548,8 +986,22 @@ const Status DB::openFile(const string & fileName, File*& filePtr)
 
 const Status DB::closeFile(File* file)
 {
+  std::lock_guard<std::mutex> guard(latch);
   if (!file) return BADFILEPTR;
 
+  // the last user going keeps the file open, for a while
+  if (file->openCnt == 1 && lingerLimit > 0)
+    {
+      Status status = file->flushHeader();
+      file->openCnt = 0;
+      file->lingering = true;
+      lingering.push_front(file);
+      while ((int) lingering.size() > lingerLimit) {
+	Status s = closeLingering(lingering.back());
+	if (status == OK) status = s;
+      }
+      return status;
+    } 
 
   // Close the file
   file->close();
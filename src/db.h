@@ -3,7 +3,11 @@
 
 #include <sys/types.h>
 #include <functional>
+#include <list>
+#include <mutex>
 #include "error.h"
+#include "page.h"
+#include "stats.h"
 #include <string.h>
 using namespace std;
 
@@ -12,13 +16,44 @@ using namespace std;
 //#define DEBUGIO
 //#define DEBUGFREE
 
+// largest number of pages moved by one vectored I/O call
+const int MAXIOVPAGES = 64;
+
+// number of pages a file is grown by when it runs out of room
+const int EXTENTPAGES = 64;
+
+// ways a file can be opened, or'ed together (see File::open)
+const int OPENREADONLY = 1;     // map the file; nothing can be changed
+const int OPENDIRECT = 2;       // bypass the OS cache with O_DIRECT
+
+// smallest page size and alignment of I/O to a file opened OPENDIRECT
+const unsigned DIRECTALIGN = 4096;
+
+// closed files DB keeps open, with their pages in the buffer pool,
+// unless told otherwise (see DB::setLingerLimit)
+const int LINGERFILES = 16;
+
+// structure of DB (header) page
+
+typedef struct {
+  int nextFree;                         // page # of next page on free list
+  int firstPage;                        // page # of first page in file
+  int numPages;                         // total # of pages in file
+  int pageSize;                         // size of every page in file
+} DBPage;
+
 // forward class definition for db
 class DB;
+class IoRing;
+class IoOp;
 
 // class definition for open files
 class File {
   friend class DB;
   friend class OpenFileHashTbl;
+  friend class BufMgr;
+  friend class LogMgr;
+  friend class PageRead;
 
  public:
 
@@ -28,7 +63,37 @@ class File {
 		  Page* pagePtr) const;       // read page from file
   const Status writePage(const int pageNo,
 		   const Page* pagePtr);      // write page to file
+  const Status readPages(const int startPageNo, const int count,
+		  Page** pages) const;        // read a run of pages
+  const Status readPageAsync(const int pageNo, Page* pagePtr,
+		  IoRing& ring, IoOp* op) const; // queue a read of a page on ring
+  const Status writePages(const int startPageNo, const int count,
+		   const Page* const* pages); // write a run of pages
   const Status getFirstPage(int& pageNo) const;     // returns pageNo of first page
+  const Status getNumPages(int& numPages) const;    // returns # of pages in file
+  const Status advisePages(const int startPageNo,
+		   const int count) const;    // hint pages will be read soon
+  const Status flushHeader();           // write the header back to disk
+  const bool isReadOnly() const         // true if opened read-only
+    {
+      return mapBase != NULL;
+    }
+  const bool isDirect() const           // true if opened for direct I/O
+    {
+      return direct;
+    }
+  const unsigned getPageSize() const                // returns size of pages in file
+    {
+      return pageSize;
+    }
+  const FileStats & getStats() const    // I/O and buffer pool statistics
+    {                                   // since the file was opened
+      return stats;
+    }
+  void clearStats()
+    {
+      stats.clear();
+    }
 
   bool operator == (const File & other) const
     {
@@ -40,16 +105,26 @@ class File {
   File(const string &fname);                   // initialize
   ~File();                  // deallocate file object
 
-  static const Status create(const string &fileName);
+  static const Status create(const string &fileName,
+                             const unsigned pageSize);
   static const Status destroy(const string &fileName);
 
-  const Status open();
+  const Status open(const int mode);
   const Status close();
+  const Status extend(const int numPages);  // make file numPages long
+  Page* mappedPage(const int pageNo) const;  // page in the mapping, or NULL
 
   const Status intread(const int pageNo,
 		 Page* pagePtr) const;        // internal file read
   const Status intwrite(const int pageNo,
 		  const Page* pagePtr);       // internal file write
+  const Status intvector(const int startPageNo, const int count,
+		  Page* const* pages,
+		  const bool writing) const;  // internal vectored read/write
+  const Status intsmall(const int pageNo, void* data,
+		  const size_t length,
+		  const bool writing);        // internal read/write of the
+                                      // start of a page, see bounce
 
 #ifdef DEBUGFREE
   void listFree();                      // list free pages
@@ -58,6 +133,22 @@ class File {
   string fileName;                    // The name of the file
   int openCnt;                        // # times file has been opened
   int unixFile;                       // unix file stream for file
+  unsigned pageSize;                  // size of a page, read from header
+  DBPage header;                      // header page, kept while file is open
+  bool hdrDirty;                      // true if header has to be written
+  int diskPages;                      // pages the file has room for on disk
+  mutable std::mutex hdrLatch;        // protects header and diskPages
+  mutable int firstFrame;             // first buffer frame holding a page
+                                      // of the file, -1 if none
+  mutable std::mutex frameLatch;      // protects the list of frames
+  char* mapBase;                      // mapping of a read-only file, or NULL
+  size_t mapLength;                   // its length in bytes
+  bool direct;                        // true if opened with O_DIRECT
+  char* bounce;                       // aligned page for I/O that is not to
+                                      // a frame, under hdrLatch
+  int openMode;                       // mode of the first opener
+  bool lingering;                     // closed, but kept open by DB
+  mutable FileStats stats;            // kept up by the file and BufMgr
 };
 
 class BufMgr;
@@ -103,23 +194,27 @@ class DB {
   DB();                                 // initialize open file table
   ~DB();                                // clean up any remaining open files
 
-  const Status createFile(const string & fileName) ;  // create a new file
+  const Status createFile(const string & fileName,
+                          const unsigned pageSize = PAGESIZE) ;  // create a new file
   const Status destroyFile(const string & fileName) ; // destroy a file, 
                                                            // release all space
-  const Status openFile(const string & fileName, File* & file);  // open a file
+  const Status openFile(const string & fileName, File* & file,
+                        const int mode = 0);  // open a file, mode is OPEN values
   const Status closeFile(File* file);         // close a file
 
+  // keep up to files closed files open, closing the ones used least
+  // recently past that.  0 closes files when they are closed
+  const Status setLingerLimit(const int files);
+
  private:
   OpenFileHashTbl   openFiles;    // list of open files
-};
-
+  std::mutex        latch;        // protects openFiles, open counts
+                                  // and lingering
+  list<File*>       lingering;    // files closed but kept open, most
+                                  // recently closed first
+  int               lingerLimit;  // most files in lingering
 
-// structure of DB (header) page
-
-typedef struct {
-  int nextFree;                         // page # of next page on free list
-  int firstPage;                        // page # of first page in file
-  int numPages;                         // total # of pages in file
-} DBPage;
+  const Status closeLingering(File* file);  // really close a lingering file
+};
 
 #endif
@@ -25,6 +25,8 @@ void Error::print(Status status)
     case BADPAGEPTR:   cerr << "bad page pointer"; break;
     case BADPAGENO:    cerr << "bad page number"; break;
     case FILEEXISTS:   cerr << "file exists already"; break;
+    case BADPAGESIZE:  cerr << "bad page size"; break;
+    case FILEREADONLY: cerr << "file is open read-only"; break;
 
     // BufMgr and HashTable errors
 
@@ -34,6 +36,8 @@ void Error::print(Status status)
     case PAGENOTPINNED: cerr << "page not pinned"; break;
     case BADBUFFER: cerr << "buffer pool corrupted"; break;
     case PAGEPINNED: cerr << "page still pinned"; break;
+    case LOGBUSY: cerr << "log commit asked for during a change"; break;
+    case IOIDLE: cerr << "task waits but no read is in flight"; break;
 
     // Page class errors
 
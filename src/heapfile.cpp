@@ -1,8 +1,384 @@
+#include <algorithm>
+#include <cfloat>
+#include <climits>
 #include "heapfile.h"
+#include "btree.h"
+#include "log.h"
 #include "error.h"
 
-// routine to create a heapfile
-const Status createHeapFile(const string fileName)
+// free-space map routines, see FileHdrPage.  hdr is the pinned header
+// page of file; the caller marks it dirty.
+
+// value kept in the map for a page with freeSpace bytes free
+static int fsmValue(File* file, const int freeSpace)
+{
+  return freeSpace / (int) (file->getPageSize() >> 8);
+}
+
+static const Status fsmSet(File* file, FileHdrPage* hdr, const int pageNo,
+                           const int freeSpace)
+{
+  Status status;
+  Page*  page;
+  int    perPage = file->getPageSize();
+  
+  // extend the map until it covers pageNo.  pages past the last map
+  // page a header can hold are never reused
+  while (pageNo >= hdr->fsmCnt * perPage) {
+    if (hdr->fsmCnt == MAXFSMPAGES) return OK;
+    int fsmPageNo;
+    status = bufMgr->allocPage(file, fsmPageNo, page);
+    if (status!=OK) {
+      return status;
+    }
+    memset(page, 0, perPage);
+    status = bufMgr->unPinPage(file, fsmPageNo, true);
+    if (status!=OK) {
+      return status;
+    }
+    hdr->fsmPages[hdr->fsmCnt++] = fsmPageNo;
+  }
+  
+  int mapPageNo = hdr->fsmPages[pageNo / perPage];
+  status = bufMgr->readPage(file, mapPageNo, page);
+  if (status!=OK) {
+    return status;
+  }
+  unsigned char* map = (unsigned char*) page;
+  int oldVal = map[pageNo % perPage];
+  int newVal = fsmValue(file, freeSpace);
+  if (oldVal != newVal) {
+    map[pageNo % perPage] = newVal;
+    int oldClass = oldVal * FSMCLASSES / 256;
+    int newClass = newVal * FSMCLASSES / 256;
+    if (oldClass != 0) hdr->classCnt[oldClass]--;
+    if (newClass != 0) hdr->classCnt[newClass]++;
+  }
+  return bufMgr->unPinPage(file, mapPageNo, oldVal != newVal);
+}
+
+static const Status fsmFind(File* file, FileHdrPage* hdr, const int length,
+                            int& pageNo)
+{
+  Status status;
+  Page*  page;
+  int    perPage = file->getPageSize();
+  int    unit = perPage >> 8;
+  int    needed = (length + sizeof(slot_t) + unit - 1) / unit;
+  
+  // every page in a class at or above minClass has room.  class 0
+  // also holds the pages that are not data pages, so it is not
+  // counted and never searched
+  pageNo = -1;
+  int minClass = (needed * FSMCLASSES + 255) / 256;
+  if (minClass == 0) minClass = 1;
+  int candidates = 0;
+  for (int c = minClass; c < FSMCLASSES; c++) candidates += hdr->classCnt[c];
+  if (candidates == 0) return OK;
+  
+  // look for one, starting where the last search ended
+  int total = hdr->fsmCnt * perPage;
+  int p = (hdr->fsmCursor < total) ? hdr->fsmCursor : 0;
+  for (int scanned = 0; scanned < total; ) {
+    int m = p / perPage;
+    status = bufMgr->readPage(file, hdr->fsmPages[m], page);
+    if (status!=OK) {
+      return status;
+    }
+    unsigned char* map = (unsigned char*) page;
+    int first = m * perPage, end = first + perPage;
+    for (; p < end && scanned < total; p++, scanned++) {
+      if (map[p - first] >= needed) {
+        pageNo = p;
+        break;
+      }
+    }
+    status = bufMgr->unPinPage(file, hdr->fsmPages[m], false);
+    if (status!=OK) {
+      return status;
+    }
+    if (pageNo != -1) {
+      hdr->fsmCursor = pageNo;
+      return OK;
+    }
+    if (p == total) p = 0;
+  }
+  return OK;
+}
+
+// page directory routines, see FileHdrPage.  hdr is the pinned header
+// page of file; the caller marks it dirty.
+
+// true if the directory has no room for another data page
+static bool dirFull(File* file, const FileHdrPage* hdr)
+{
+  long perPage = file->getPageSize() / sizeof(int);
+  return hdr->pageCnt >= MAXDIRROOTS * perPage * perPage;
+}
+
+// make pageNo directory entry hdr->pageCnt, adding a leaf page and a
+// root page when the entry starts one.  the caller counts the entry
+static const Status dirAppend(File* file, FileHdrPage* hdr, const int pageNo)
+{
+  Status status;
+  Page*  page;
+  int    perPage = file->getPageSize() / sizeof(int);
+  int    k = hdr->pageCnt;
+  int    leaf = k / perPage;
+  int    root = leaf / perPage;
+  
+  if (dirFull(file, hdr)) return FILEHDRFULL;
+  
+  if (k % perPage == 0 && leaf % perPage == 0) {
+    status = bufMgr->allocPage(file, hdr->dirRoots[root], page);
+    if (status!=OK) {
+      return status;
+    }
+    memset(page, 0, file->getPageSize());
+    status = bufMgr->unPinPage(file, hdr->dirRoots[root], true);
+    if (status!=OK) {
+      return status;
+    }
+  }
+  
+  status = bufMgr->readPage(file, hdr->dirRoots[root], page);
+  if (status!=OK) {
+    return status;
+  }
+  int* leaves = (int*) page;
+  if (k % perPage == 0) {
+    Page* leafPage;
+    status = bufMgr->allocPage(file, leaves[leaf % perPage], leafPage);
+    if (status == OK) {
+      memset(leafPage, 0, file->getPageSize());
+      status = bufMgr->unPinPage(file, leaves[leaf % perPage], true);
+    }
+    if (status!=OK) {
+      bufMgr->unPinPage(file, hdr->dirRoots[root], true);
+      return status;
+    }
+  }
+  int leafPageNo = leaves[leaf % perPage];
+  status = bufMgr->unPinPage(file, hdr->dirRoots[root], k % perPage == 0);
+  if (status!=OK) {
+    return status;
+  }
+  
+  status = bufMgr->readPage(file, leafPageNo, page);
+  if (status!=OK) {
+    return status;
+  }
+  ((int*) page)[k % perPage] = pageNo;
+  return bufMgr->unPinPage(file, leafPageNo, true);
+}
+
+// copy up to max entries starting at entry first, stopping at the end
+// of the leaf page that holds it
+static const Status dirRead(File* file, const FileHdrPage* hdr,
+                            const int first, const int max, int* pageNos,
+                            int& n)
+{
+  Status status;
+  Page*  page;
+  int    perPage = file->getPageSize() / sizeof(int);
+  int    leaf = first / perPage;
+  int    root = leaf / perPage;
+  
+  n = 0;
+  if (first < 0 || first >= hdr->pageCnt) return OK;
+  
+  status = bufMgr->readPage(file, hdr->dirRoots[root], page);
+  if (status!=OK) {
+    return status;
+  }
+  int leafPageNo = ((int*) page)[leaf % perPage];
+  status = bufMgr->unPinPage(file, hdr->dirRoots[root], false);
+  if (status!=OK) {
+    return status;
+  }
+  
+  status = bufMgr->readPage(file, leafPageNo, page);
+  if (status!=OK) {
+    return status;
+  }
+  int cnt = hdr->pageCnt - first;
+  if (cnt > max) cnt = max;
+  if (cnt > perPage - first % perPage) cnt = perPage - first % perPage;
+  memcpy(pageNos, (int*) page + first % perPage, cnt * sizeof(int));
+  n = cnt;
+  return bufMgr->unPinPage(file, leafPageNo, false);
+}
+
+// zone map routines, see FileHdrPage
+
+// page numbers summarized by a leaf page, and leaves of a root page
+static int zonePerLeaf(File* file)
+{
+  return file->getPageSize() / (2 * sizeof(int));
+}
+
+static int zoneLeaves(File* file)
+{
+  return file->getPageSize() / sizeof(int);
+}
+
+// make entry e the zone of a page without values
+static void zoneClear(const Datatype type, char* e)
+{
+  if (type == INTEGER) {
+    int lo = INT_MAX, hi = INT_MIN;
+    memcpy(e, &lo, sizeof(int));
+    memcpy(e + sizeof(int), &hi, sizeof(int));
+  }
+  else {
+    float lo = FLT_MAX, hi = -FLT_MAX;
+    memcpy(e, &lo, sizeof(float));
+    memcpy(e + sizeof(float), &hi, sizeof(float));
+  }
+}
+
+template<class T>
+static bool zoneWidenAs(char* e, const char* value)
+{
+  T lo, hi, v;
+  memcpy(&lo, e, sizeof(T));
+  memcpy(&hi, e + sizeof(T), sizeof(T));
+  memcpy(&v, value, sizeof(T));
+  bool changed = false;
+  if (v < lo) { memcpy(e, &v, sizeof(T)); changed = true; }
+  if (v > hi) { memcpy(e + sizeof(T), &v, sizeof(T)); changed = true; }
+  return changed;
+}
+
+// widen entry e to include value, true if it changed
+static bool zoneWiden(const Datatype type, char* e, const char* value)
+{
+  if (type == INTEGER) return zoneWidenAs<int>(e, value);
+  return zoneWidenAs<float>(e, value);
+}
+
+// true if no value in [lo, hi] satisfies v op
+template<class T>
+static bool zoneExcludesAs(const char* e, const T v, const Operator op)
+{
+  T lo, hi;
+  memcpy(&lo, e, sizeof(T));
+  memcpy(&hi, e + sizeof(T), sizeof(T));
+  if (lo > hi) return true;
+  switch (op) {
+    case LT:  return lo >= v;
+    case LTE: return lo > v;
+    case EQ:  return v < lo || v > hi;
+    case GTE: return hi < v;
+    case GT:  return hi <= v;
+    case NE:  return lo == v && hi == v;
+  }
+  return false;
+}
+
+static bool zoneExcludes(const Predicate& p, const char* e)
+{
+  if (p.type == INTEGER) return zoneExcludesAs<int>(e, p.intValue, p.op);
+  return zoneExcludesAs<float>(e, p.floatValue, p.op);
+}
+
+// page number of leaf k of zone map z, -1 if there is none.  a
+// missing leaf is allocated, with every zone empty, if create is set
+static const Status zoneLeafPage(File* file, const ZoneMapHdr& z, const int k,
+                                 const bool create, int& leafPageNo)
+{
+  Status status;
+  Page*  page;
+  
+  leafPageNo = -1;
+  if (k >= zoneLeaves(file)) return OK;
+  status = bufMgr->readPage(file, z.rootPageNo, page);
+  if (status!=OK) {
+    return status;
+  }
+  int* root = (int*) page;
+  if (root[k] == -1 && create) {
+    Page* leaf;
+    int   newPageNo;
+    status = bufMgr->allocPage(file, newPageNo, leaf);
+    if (status!=OK) {
+      bufMgr->unPinPage(file, z.rootPageNo, false);
+      return status;
+    }
+    for (int i = 0; i < zonePerLeaf(file); i++)
+      zoneClear(z.type, (char*) leaf + i * 2 * sizeof(int));
+    root[k] = newPageNo;
+    status = bufMgr->unPinPage(file, newPageNo, true);
+    if (status!=OK) {
+      bufMgr->unPinPage(file, z.rootPageNo, true);
+      return status;
+    }
+    leafPageNo = newPageNo;
+    return bufMgr->unPinPage(file, z.rootPageNo, true);
+  }
+  leafPageNo = root[k];
+  return bufMgr->unPinPage(file, z.rootPageNo, false);
+}
+
+// the record with RID rid of a data page.  a record of a PAX page is
+// put together in buf, which has room for it
+static const Status pageRecord(Page* page, const RID & rid, Record & rec,
+                               char* buf)
+{
+  if (page->isPax()) return page->gatherRecord(rid, buf, rec);
+  return page->getRecord(rid, rec);
+}
+
+// compute the zone of data page pageNo in zone map z from its records
+static const Status zoneSummarize(File* file, const ZoneMapHdr& z,
+                                  const int pageNo, const Page* page)
+{
+  Status status;
+  Page*  leaf;
+  int    leafPageNo;
+  
+  status = zoneLeafPage(file, z, pageNo / zonePerLeaf(file), true, leafPageNo);
+  if (status!=OK || leafPageNo == -1) {
+    return status;
+  }
+  status = bufMgr->readPage(file, leafPageNo, leaf);
+  if (status!=OK) {
+    return status;
+  }
+  char* e = (char*) leaf + (pageNo % zonePerLeaf(file)) * 2 * sizeof(int);
+  zoneClear(z.type, e);
+  
+  // a record that moved counts for its home, where scans find it
+  Page*  p = (Page*) page;
+  int    max = Page::maxRecords(file->getPageSize());
+  vector<Record> recs(max);
+  vector<RID>    rids(max);
+  vector<char>   buf(file->getPageSize());
+  int n = p->getAllRecords(recs.data(), rids.data(), max);
+  for (int k = 0; k < n && status == OK; k++) {
+    Record rec = recs[k];
+    RID    to;
+    Page*  q;
+    if (p->isPax()) status = p->gatherRecord(rids[k], buf.data(), rec);
+    else if (rec.length == -1) {
+      status = p->getForward(rids[k], to);
+      if (status == OK) status = bufMgr->readPage(file, to.pageNo, q);
+      if (status == OK) {
+        status = q->gatherRecord(to, buf.data(), rec);
+        Status s = bufMgr->unPinPage(file, to.pageNo, false);
+        if (status == OK) status = s;
+      }
+    }
+    if (status == OK && z.offset + (int) sizeof(int) <= rec.length)
+      zoneWiden(z.type, e, (char*) rec.data + z.offset);
+  }
+  Status s = bufMgr->unPinPage(file, leafPageNo, true);
+  return (status != OK) ? status : s;
+}
+
+// routine to create a heapfile whose pages are pageSize bytes
+const Status createHeapFile(const string fileName, const unsigned pageSize,
+                            const AttrRange* columns, const int colCnt)
 {
   File*         file;
   Status        status;
@@ -16,13 +392,36 @@ const Status createHeapFile(const string fileName)
     return BADFILE;
   }
   
+  // make sure the pages of the file will fit in the buffer pool
+  if (!validPageSize(pageSize) || pageSize > bufMgr->getFrameSize()) {
+    return BADPAGESIZE;
+  }
+  
+  // the columns of a PAX file follow each other, and a page has to
+  // have room for at least one record
+  int colLengths[MAXPAXCOLUMNS];
+  int recLength = 0;
+  if (colCnt < 0 || colCnt > MAXPAXCOLUMNS || (colCnt > 0 && !columns)) {
+    return BADSCANPARM;
+  }
+  for (int c = 0; c < colCnt; c++) {
+    if (columns[c].offset != recLength || columns[c].length < 1) {
+      return BADSCANPARM;
+    }
+    colLengths[c] = columns[c].length;
+    recLength += columns[c].length;
+  }
+  if (colCnt > 0 && Page::paxCapacity(pageSize, recLength, colCnt) < 1) {
+    return INVALIDRECLEN;
+  }
+  
   // try to open the file. This should return an error
   status = db.openFile(fileName, file);
   if (status != OK) {
     // file doesn't exist. First create it and allocate
     // an empty header page and data page.
     
-    status = db.createFile(fileName);
+    status = db.createFile(fileName, pageSize);
     if (status!=OK) {
       return status;
     }
@@ -47,12 +446,31 @@ const Status createHeapFile(const string fileName)
       return status;
     }
     
-    newPage->init(newPageNo);
+    if (colCnt > 0) newPage->initPax(newPageNo, pageSize, colLengths, colCnt);
+    else newPage->init(newPageNo, pageSize);
     
     hdrPage->firstPage= newPageNo;
     hdrPage->lastPage = newPageNo;
-    hdrPage->pageCnt = 1;
+    hdrPage->pageCnt = 0;
     hdrPage->recCnt = 0;
+    hdrPage->fsmCnt = 0;
+    hdrPage->fsmCursor = 0;
+    memset(hdrPage->classCnt, 0, sizeof(hdrPage->classCnt));
+    hdrPage->indexCnt = 0;
+    hdrPage->zoneCnt = 0;
+    hdrPage->colCnt = colCnt;
+    hdrPage->recLength = recLength;
+    
+    // the first data page goes into the directory and the free-space map
+    status = dirAppend(file, hdrPage, newPageNo);
+    if (status!=OK) {
+      return status;
+    }
+    hdrPage->pageCnt = 1;
+    status = fsmSet(file, hdrPage, newPageNo, newPage->getFreeSpace());
+    if (status!=OK) {
+      return status;
+    }
     
     status = bufMgr->unPinPage(file, newPageNo, true);
     if (status!=OK) {
@@ -74,21 +492,54 @@ const Status createHeapFile(const string fileName)
   return (FILEEXISTS);
 }
 
-// routine to destroy a heapfile
+// routine to destroy a heapfile and its indexes
 const Status destroyHeapFile(const string fileName)
 {
-  return (db.destroyFile (fileName));
+  Status  status;
+  File*   file;
+  Page*   page;
+  int     hdrPageNo;
+  int     indexCnt = 0;
+  
+  // the header says how many index files go with the file
+  if (db.openFile(fileName, file) == OK) {
+    status = file->getFirstPage(hdrPageNo);
+    if (status == OK) status = bufMgr->readPage(file, hdrPageNo, page);
+    if (status == OK) {
+      indexCnt = ((FileHdrPage*) page)->indexCnt;
+      status = bufMgr->unPinPage(file, hdrPageNo, false);
+    }
+    Status closeStatus = db.closeFile(file);
+    if (status!=OK) {
+      return status;
+    }
+    if (closeStatus!=OK) {
+      return closeStatus;
+    }
+  }
+  
+  status = db.destroyFile (fileName);
+  for (int k = 0; k < indexCnt && status == OK; k++) {
+    status = db.destroyFile(indexFileName(fileName, k));
+  }
+  return status;
 }
 
 // constructor opens the underlying file
-HeapFile::HeapFile(const string & fileName, Status& returnStatus)
+HeapFile::HeapFile(const string & fileName, Status& returnStatus,
+                   const int mode)
 {
   Status  status;
   Page*   pagePtr;
   int     hdrPageNo;
   
+  headerPage = NULL;
+  curPage = NULL;
+  recBuf = NULL;
+  openMode = mode;
+  
   // open the file and read in the header page and the first data page
-  if ((status = db.openFile(fileName, filePtr)) == OK) {
+  if ((status = db.openFile(fileName, filePtr, mode)) == OK) {
     
     // get the header page no
     status = filePtr->getFirstPage(hdrPageNo);
@@ -119,10 +570,18 @@ HeapFile::HeapFile(const string & fileName, Status& returnStatus)
     curPageNo = headerPage->firstPage;
     curDirtyFlag = false;
     curRec = NULLRID;
+    
+    // new data pages of a PAX file get the columns of the first one
+    if (headerPage->colCnt > 0) {
+      colLengths.assign(curPage->colLengths(),
+                        curPage->colLengths() + headerPage->colCnt);
+    }
+    recBuf = new char[filePtr->getPageSize()];
     returnStatus = OK;
   }
   else {
     cerr << "open of heap file failed" << endl;
+    filePtr = NULL;
     returnStatus = status;
     return;
   }
@@ -132,6 +591,16 @@ HeapFile::HeapFile(const string & fileName, Status& returnStatus)
 HeapFile::~HeapFile()
 {
   Status status;
+  
+  delete [] recBuf;
+  
+  // nothing to do if the file could not be opened
+  if (filePtr == NULL) return;
+  for (size_t k = 0; k < indexes.size(); k++) delete indexes[k];
+  if (headerPage == NULL) {
+    db.closeFile(filePtr);
+    return;
+  }
   cout << "invoking heapfile destructor on file " << headerPage->fileName << endl;
   
   // see if there is a pinned data page. If so, unpin it
@@ -158,90 +627,690 @@ HeapFile::~HeapFile()
   }
 }
 
-// Return number of records in heap file
+// a new data page gets the layout of the file
+void HeapFile::initDataPage(Page* page, const int pageNo) const
+{
+  if (colLengths.empty()) page->init(pageNo, filePtr->getPageSize());
+  else page->initPax(pageNo, filePtr->getPageSize(), colLengths.data(),
+                     colLengths.size());
+}
 
-const int HeapFile::getRecCnt() const
+// record the free space of page pageNo in the free-space map
+const Status HeapFile::setFreeSpace(const int pageNo, const int freeSpace)
 {
-  return headerPage->recCnt;
+  hdrDirtyFlag = true;
+  return fsmSet(filePtr, headerPage, pageNo, freeSpace);
 }
 
-// retrieve an arbitrary record from a file.
-// if record is not on the currently pinned page, the current page
-// is unpinned and the required page is read into the buffer pool
-// and pinned.  returns a pointer to the record via the rec parameter
+// find a page with room for a record of length bytes
+const Status HeapFile::findFreePage(const int length, int& pageNo)
+{
+  hdrDirtyFlag = true;
+  return fsmFind(filePtr, headerPage, length, pageNo);
+}
 
-const Status HeapFile::getRecord(const RID &  rid, Record & rec)
+// add data page pageNo to the directory.  it becomes the last page
+const Status HeapFile::addDataPage(const int pageNo)
+{
+  Status status = dirAppend(filePtr, headerPage, pageNo);
+  if (status!=OK) {
+    return status;
+  }
+  headerPage->lastPage = pageNo;
+  headerPage->pageCnt++;
+  hdrDirtyFlag = true;
+  return OK;
+}
+
+// allocate a new last data page
+const Status HeapFile::appendDataPage(Page*& page, int& pageNo)
 {
   Status status;
+  Page*  lastPage;
   
-  //if the record does not reside on the current page, read the record's page from disk
-  if (curPageNo != rid.pageNo) {
-    status = bufMgr->unPinPage(filePtr, curPageNo, curDirtyFlag);
-    if (status!=OK) {
-      return status;
-    }
-    
-    // read the desired page into the buffer and update the current page tracking variable;
-    Page *page;
-    status = bufMgr->readPage(filePtr, rid.pageNo, page);
-    if (status!=OK) {
-      return status;
-    }
-    curPage = page;
-    curPageNo = rid.pageNo;
-    curDirtyFlag = false;
-    curRec = NULLRID;
+  if (dirFull(filePtr, headerPage)) {
+    return FILEHDRFULL;
+  }
+  status = bufMgr->allocPage(filePtr, pageNo, page);
+  if (status!=OK) {
+    return status;
   }
+  initDataPage(page, pageNo);
   
-  status = curPage->getRecord(rid, rec);
+  status = bufMgr->readPage(filePtr, headerPage->lastPage, lastPage);
+  if (status == OK) {
+    lastPage->setNextPage(pageNo);
+    status = bufMgr->unPinPage(filePtr, headerPage->lastPage, true);
+  }
+  if (status == OK) status = addDataPage(pageNo);
   if (status!=OK) {
+    bufMgr->unPinPage(filePtr, pageNo, true);
     return status;
   }
-  curRec = rid;
   return OK;
 }
 
-
-HeapFileScan::HeapFileScan(const string & name,
-                           Status & status) : HeapFile(name, status)
-{
-  filter = NULL;
-}
-
-const Status HeapFileScan::startScan(const int offset_,
-                                     const int length_,
-                                     const Datatype type_,
-                                     const char* filter_,
-                                     const Operator op_)
+// a moved record goes where an insert would put it, but not on its
+// home page: that is where it did not fit
+const Status HeapFile::placeMoved(const Record & rec, const RID & home,
+                                  RID& at)
 {
-  if (!filter_) {                        // no filtering requested
-    filter = NULL;
-    return OK;
-  }
+  Status status;
+  Page*  page;
+  int    pageNo;
+  int    length = rec.length + sizeof(RID);
   
-  if ((offset_ < 0 || length_ < 1) ||
-      (type_ != STRING && type_ != INTEGER && type_ != FLOAT) ||
-      ((type_ == INTEGER && length_ != sizeof(int))
-       || (type_ == FLOAT && length_ != sizeof(float))) ||
-      (op_ != LT && op_ != LTE && op_ != EQ && op_ != GTE && op_ != GT && op_ != NE))
-  {
-    return BADSCANPARM;
+  if ((unsigned int) length >
+      pageDataSize(filePtr->getPageSize()) - sizeof(slot_t)) {
+    return INVALIDRECLEN;
+  }
+  status = findFreePage(length, pageNo);
+  if (status!=OK) {
+    return status;
   }
+  if (pageNo == -1) pageNo = headerPage->lastPage;
   
-  offset = offset_;
-  length = length_;
-  type = type_;
-  filter = filter_;
-  op = op_;
+  status = NOSPACE;
+  if (pageNo != home.pageNo) {
+    status = bufMgr->readPage(filePtr, pageNo, page);
+    if (status!=OK) {
+      return status;
+    }
+    status = page->insertRecord(rec, at, &home);
+    if (status!=OK) {
+      Status s = bufMgr->unPinPage(filePtr, pageNo, false);
+      if (status == NOSPACE && s != OK) status = s;
+      if (status != NOSPACE) return status;
+    }
+  }
+  if (status == NOSPACE) {
+    status = appendDataPage(page, pageNo);
+    if (status!=OK) {
+      return status;
+    }
+    status = page->insertRecord(rec, at, &home);
+  }
   
-  return OK;
+  if (status == OK) status = setFreeSpace(pageNo, page->getFreeSpace());
+  Status s = bufMgr->unPinPage(filePtr, pageNo, true);
+  return (status != OK) ? status : s;
 }
 
+// read a record through its stub
+const Status HeapFile::movedRecord(const RID & at, Record & rec, char* buf)
+{
+  Page*  page;
+  Status status = bufMgr->readPage(filePtr, at.pageNo, page);
+  if (status!=OK) {
+    return status;
+  }
+  status = page->gatherRecord(at, buf, rec);
+  Status s = bufMgr->unPinPage(filePtr, at.pageNo, false);
+  return (status != OK) ? status : s;
+}
 
-const Status HeapFileScan::endScan()
+// delete a record and, if it moved, its stub.  its index entries go
+// first, while the record can still be read
+const Status HeapFile::eraseRecord(const RID & home, const RID & at)
 {
   Status status;
-  // generally must unpin last page of the scan
+  Page*  page;
+  Record rec;
+  
+  status = bufMgr->readPage(filePtr, at.pageNo, page);
+  if (status!=OK) {
+    return status;
+  }
+  status = pageRecord(page, at, rec, recBuf);
+  if (status == OK) status = indexDelete(rec, home);
+  if (status == OK) status = page->deleteRecord(at);
+  if (status == OK) status = setFreeSpace(at.pageNo, page->getFreeSpace());
+  Status s = bufMgr->unPinPage(filePtr, at.pageNo, status == OK);
+  if (status == OK) status = s;
+  
+  if (status == OK && (home.pageNo != at.pageNo || home.slotNo != at.slotNo)) {
+    status = bufMgr->readPage(filePtr, home.pageNo, page);
+    if (status!=OK) {
+      return status;
+    }
+    status = page->deleteRecord(home);
+    if (status == OK) status = setFreeSpace(home.pageNo, page->getFreeSpace());
+    s = bufMgr->unPinPage(filePtr, home.pageNo, status == OK);
+    if (status == OK) status = s;
+  }
+  if (status!=OK) {
+    return status;
+  }
+  
+  // reduce count of number of records in the file
+  headerPage->recCnt--;
+  hdrDirtyFlag = true;
+  return OK;
+}
+
+// read a run of directory entries
+const Status HeapFile::getDataPages(const int first, const int max,
+                                    int* pageNos, int& n)
+{
+  return dirRead(filePtr, headerPage, first, max, pageNos, n);
+}
+
+// open the indexes added to the header since the last call
+const Status HeapFile::openIndexes()
+{
+  Status status;
+  
+  while ((int) indexes.size() < headerPage->indexCnt) {
+    string name = indexFileName(headerPage->fileName, indexes.size());
+    BTreeIndex* index = new BTreeIndex(name, status, openMode);
+    if (status!=OK) {
+      delete index;
+      return status;
+    }
+    indexes.push_back(index);
+  }
+  return OK;
+}
+
+// add the entries of a new record to the indexes
+const Status HeapFile::indexInsert(const Record & rec, const RID & rid)
+{
+  Status status = openIndexes();
+  for (size_t k = 0; k < indexes.size() && status == OK; k++) {
+    status = indexes[k]->insertEntry(rec, rid);
+  }
+  return status;
+}
+
+// remove the entries of a record about to be deleted
+const Status HeapFile::indexDelete(const Record & rec, const RID & rid)
+{
+  Status status = openIndexes();
+  for (size_t k = 0; k < indexes.size() && status == OK; k++) {
+    status = indexes[k]->deleteEntry(rec, rid);
+  }
+  return status;
+}
+
+// change the entries of an updated record whose key changed
+const Status HeapFile::indexUpdate(const Record & old, const Record & rec,
+                                   const RID & rid)
+{
+  Status status = openIndexes();
+  for (size_t k = 0; k < indexes.size() && status == OK; k++) {
+    if (indexes[k]->sameKey(old, rec)) continue;
+    status = indexes[k]->deleteEntry(old, rid);
+    if (status == OK) status = indexes[k]->insertEntry(rec, rid);
+  }
+  return status;
+}
+
+// create a new index file and load it with the records of the file
+const Status HeapFile::createIndex(const int offset, const int length,
+                                   const Datatype type)
+{
+  Status status;
+  
+  if (filePtr->isReadOnly()) return FILEREADONLY;
+  if ((status = openIndexes()) != OK) {
+    return status;
+  }
+  for (size_t k = 0; k < indexes.size(); k++) {
+    if (indexes[k]->covers(offset, length, type)) return INDEXEXISTS;
+  }
+  if (headerPage->indexCnt == MAXINDEXES) return FILEHDRFULL;
+  
+  string name = indexFileName(headerPage->fileName, headerPage->indexCnt);
+  status = BTreeIndex::create(name, filePtr->getPageSize(), offset, length,
+                              type);
+  if (status!=OK) {
+    return status;
+  }
+  BTreeIndex* index = new BTreeIndex(name, status, openMode);
+  if (status == OK) status = index->bulkLoad(headerPage->fileName);
+  if (status!=OK) {
+    delete index;
+    db.destroyFile(name);
+    return status;
+  }
+  LogChange change(bufMgr->getLog());
+  indexes.push_back(index);
+  headerPage->indexCnt++;
+  hdrDirtyFlag = true;
+  return OK;
+}
+
+// start a zone map and summarize the data pages already in the file
+const Status HeapFile::addZoneMap(const int offset, const Datatype type)
+{
+  Status status;
+  Page*  page;
+  int    rootPageNo;
+  
+  if (filePtr->isReadOnly()) return FILEREADONLY;
+  if (offset < 0 || (type != INTEGER && type != FLOAT)) return BADINDEXPARM;
+  for (int z = 0; z < headerPage->zoneCnt; z++) {
+    if (headerPage->zones[z].offset == offset &&
+        headerPage->zones[z].type == type) return INDEXEXISTS;
+  }
+  if (headerPage->zoneCnt == MAXZONES) return FILEHDRFULL;
+  
+  LogChange change(bufMgr->getLog());
+  status = bufMgr->allocPage(filePtr, rootPageNo, page);
+  if (status!=OK) {
+    return status;
+  }
+  memset((char*) page, 0xff, filePtr->getPageSize());   // every leaf -1
+  status = bufMgr->unPinPage(filePtr, rootPageNo, true);
+  if (status!=OK) {
+    return status;
+  }
+  ZoneMapHdr& zone = headerPage->zones[headerPage->zoneCnt++];
+  zone.offset = offset;
+  zone.type = type;
+  zone.rootPageNo = rootPageNo;
+  hdrDirtyFlag = true;
+  
+  int pageNos[DIRBATCH];
+  for (int idx = 0, n = 0; idx < headerPage->pageCnt; idx += n) {
+    status = getDataPages(idx, DIRBATCH, pageNos, n);
+    if (status!=OK) {
+      return status;
+    }
+    for (int k = 0; k < n; k++) {
+      status = bufMgr->readPage(filePtr, pageNos[k], page);
+      if (status!=OK) {
+        return status;
+      }
+      status = zoneSummarize(filePtr, zone, pageNos[k], page);
+      Status s = bufMgr->unPinPage(filePtr, pageNos[k], false);
+      if (status!=OK) {
+        return status;
+      }
+      if (s!=OK) {
+        return s;
+      }
+    }
+  }
+  return OK;
+}
+
+// widen the zones of a data page to include a record added to it
+const Status HeapFile::zoneInsert(const int pageNo, const Record & rec)
+{
+  Status status;
+  Page*  leaf;
+  int    leafPageNo;
+  int    perLeaf = zonePerLeaf(filePtr);
+  
+  for (int z = 0; z < headerPage->zoneCnt; z++) {
+    const ZoneMapHdr& zone = headerPage->zones[z];
+    if (zone.offset + (int) sizeof(int) > rec.length) continue;
+    status = zoneLeafPage(filePtr, zone, pageNo / perLeaf, true, leafPageNo);
+    if (status!=OK) {
+      return status;
+    }
+    if (leafPageNo == -1) continue;
+    status = bufMgr->readPage(filePtr, leafPageNo, leaf);
+    if (status!=OK) {
+      return status;
+    }
+    char* e = (char*) leaf + (pageNo % perLeaf) * 2 * sizeof(int);
+    bool changed = zoneWiden(zone.type, e, (char*) rec.data + zone.offset);
+    status = bufMgr->unPinPage(filePtr, leafPageNo, changed);
+    if (status!=OK) {
+      return status;
+    }
+  }
+  return OK;
+}
+
+// compute the zones of a data page whose records have been changed
+const Status HeapFile::zoneRefresh(const int pageNo, const Page* page)
+{
+  for (int z = 0; z < headerPage->zoneCnt; z++) {
+    Status status = zoneSummarize(filePtr, headerPage->zones[z], pageNo, page);
+    if (status!=OK) {
+      return status;
+    }
+  }
+  return OK;
+}
+
+// Return number of records in heap file
+
+const int HeapFile::getRecCnt() const
+{
+  return headerPage->recCnt;
+}
+
+// Return number of data pages in heap file
+
+const int HeapFile::getPageCnt() const
+{
+  return headerPage->pageCnt;
+}
+
+// retrieve an arbitrary record from a file.
+// if record is not on the currently pinned page, the current page
+// is unpinned and the required page is read into the buffer pool
+// and pinned.  returns a pointer to the record via the rec parameter
+
+const Status HeapFile::getRecord(const RID &  rid, Record & rec)
+{
+  Status status;
+  RID    at = rid, to;
+  
+  // the page of a stub is left for that of the record it forwards
+  // to.  stubs never forward to stubs
+  for (int hop = 0; hop < 2; hop++) {
+    //if the record does not reside on the current page, read the record's page from disk
+    if (curPage == NULL || curPageNo != at.pageNo) {
+      if (curPage != NULL) {
+        status = bufMgr->unPinPage(filePtr, curPageNo, curDirtyFlag);
+        curPage = NULL;
+        if (status!=OK) {
+          return status;
+        }
+      }
+      
+      // read the desired page into the buffer and update the current page tracking variable;
+      Page *page;
+      status = bufMgr->readPage(filePtr, at.pageNo, page);
+      if (status!=OK) {
+        return status;
+      }
+      curPage = page;
+      curPageNo = at.pageNo;
+      curDirtyFlag = false;
+      curRec = NULLRID;
+    }
+    if (curPage->getForward(at, to) != OK || to.pageNo == -1) break;
+    at = to;
+  }
+  
+  status = pageRecord(curPage, at, rec, recBuf);
+  if (status!=OK) {
+    return status;
+  }
+  curRec = at;
+  return OK;
+}
+
+
+// getRecord with the page read through io
+IoTask HeapFile::getRecordAsync(IoRing& io, const RID rid, Record& rec)
+{
+  Status status;
+  RID    at = rid, to;
+  
+  for (int hop = 0; hop < 2; hop++) {
+    if (curPage == NULL || curPageNo != at.pageNo) {
+      Page *page;
+      status = co_await bufMgr->readPageAsync(filePtr, at.pageNo, page, io);
+      if (status!=OK) {
+        co_return status;
+      }
+      if (curPage != NULL) {
+        status = bufMgr->unPinPage(filePtr, curPageNo, curDirtyFlag);
+        if (status!=OK) {
+          bufMgr->unPinPage(filePtr, at.pageNo, false);
+          curPage = NULL;
+          co_return status;
+        }
+      }
+      curPage = page;
+      curPageNo = at.pageNo;
+      curDirtyFlag = false;
+      curRec = NULLRID;
+    }
+    if (curPage->getForward(at, to) != OK || to.pageNo == -1) break;
+    at = to;
+  }
+  
+  status = pageRecord(curPage, at, rec, recBuf);
+  if (status!=OK) {
+    co_return status;
+  }
+  curRec = at;
+  co_return OK;
+}
+
+
+// Fetch the records of many RIDs.  The RIDs are taken a window at a
+// time, as many as are on MAXBATCHPAGES pages, and the pages of a
+// window are pinned together, so RIDs in input order still find
+// their page pinned however they jump about.  For page order the RIDs
+// are sorted first, keeping the input order within a page.
+
+const Status HeapFile::getRecords(const RID* rids, const int n,
+                                  const RecordFn& fn, const bool inOrder)
+{
+  Status status = OK;
+  int    pageNos[MAXBATCHPAGES];
+  Page*  pages[MAXBATCHPAGES];
+  
+  if (n < 0 || (n > 0 && !rids)) return BADSCANPARM;
+  
+  vector<int> order(n);
+  for (int k = 0; k < n; k++) order[k] = k;
+  vector<char> buf(filePtr->getPageSize());
+  if (!inOrder)
+    std::stable_sort(order.begin(), order.end(),
+                     [rids](const int a, const int b)
+                     { return rids[a].pageNo < rids[b].pageNo; });
+  
+  for (int w = 0; w < n && status == OK; ) {
+    // the RIDs of the window and their pages, in page order
+    int cnt = 0, end = w;
+    for (; end < n; end++) {
+      int pageNo = rids[order[end]].pageNo;
+      if (std::find(pageNos, pageNos + cnt, pageNo) != pageNos + cnt) continue;
+      if (cnt == MAXBATCHPAGES) break;
+      pageNos[cnt++] = pageNo;
+    }
+    std::sort(pageNos, pageNos + cnt);
+    
+    // bring in the runs of consecutive pages with one read each
+    for (int i = 0, j; i < cnt && status == OK; i = j) {
+      for (j = i + 1; j < cnt && pageNos[j] == pageNos[j - 1] + 1; j++) ;
+      if (j - i > 1) status = bufMgr->prefetchPages(filePtr, pageNos[i], j - i);
+    }
+    
+    int pinned = 0;
+    for (; pinned < cnt && status == OK; pinned++) {
+      status = bufMgr->readPage(filePtr, pageNos[pinned], pages[pinned]);
+      if (status != OK) break;
+    }
+    for (int i = w; i < end && status == OK; i++) {
+      const RID& rid = rids[order[i]];
+      int p = std::lower_bound(pageNos, pageNos + cnt, rid.pageNo) - pageNos;
+      Record rec;
+      RID    to;
+      status = pageRecord(pages[p], rid, rec, buf.data());
+      if (status == INVALIDSLOTNO && pages[p]->getForward(rid, to) == OK
+          && to.pageNo != -1)
+        status = movedRecord(to, rec, buf.data());
+      if (status == OK) fn(order[i], rid, rec);
+    }
+    for (int i = 0; i < pinned; i++) {
+      Status s = bufMgr->unPinPage(filePtr, pageNos[i], false);
+      if (status == OK) status = s;
+    }
+    w = end;
+  }
+  return status;
+}
+
+
+HeapFileScan::HeapFileScan(const string & name, Status & status,
+                           const int mode)
+  : HeapFile(name, status, mode)
+{
+  // without the OS cache nothing else reads ahead of the scan, so it
+  // reads further ahead itself, into a ring big enough to keep two
+  // windows of pages
+  readAhead = DEFAULTREADAHEAD;
+  if (status == OK && filePtr->isDirect()) readAhead = DIRECTREADAHEAD;
+  raNextIdx = 0;
+  ring = new BufRing(readAhead * 2 > SCANRINGSIZE ? readAhead * 2
+                                                  : SCANRINGSIZE);
+  scanIdx = 0;
+  rangeEnd = -1;
+  dirBufStart = dirBufCnt = 0;
+  markedIdx = 0;
+  evalPageNo = -1;
+  copyRid = NULLRID;
+  copyLength = 0;
+  pageCnt = pagePos = 0;
+  pageCap = Page::maxRecords(status == OK ? filePtr->getPageSize() : MINPAGESIZE);
+  pageRecs = new Record[pageCap];
+  pageRids = new RID[pageCap];
+  pageMatch = new unsigned char[pageCap];
+  candIdx = new int[pageCap];
+  candRecs = new Record[pageCap];
+  candPos = new int[pageCap];
+  candMatch = new unsigned char[pageCap];
+  evalBuf = NULL;
+  if (status == OK && headerPage->colCnt > 0)
+    evalBuf = new char[filePtr->getPageSize()];
+  anyOf = false;
+  batchCnt = 0;
+  source = NULL;
+  scanIndex = NULL;
+  asyncIo = NULL;
+  zonesUsed = false;
+  for (int z = 0; z < MAXZONES; z++) {
+    zoneLeaf[z] = -1;
+    zonePage[z] = NULL;
+  }
+}
+
+const Status HeapFileScan::startScan(const int offset_,
+                                     const int length_,
+                                     const Datatype type_,
+                                     const char* filter_,
+                                     const Operator op_)
+{
+  Predicate pred;
+  Status status = pred.compile(offset_, length_, type_, filter_, op_);
+  if (status != OK) return status;
+  
+  return startScan(&pred, filter_ ? 1 : 0);
+}
+
+
+const Status HeapFileScan::startScan(const Predicate* preds_, const int n,
+                                     const bool anyOf_)
+{
+  if (n < 0 || (n > 0 && !preds_)) return BADSCANPARM;
+  
+  preds.assign(preds_, preds_ + n);
+  anyOf = anyOf_;
+  predOrder.resize(n);
+  for (int i = 0; i < n; i++) predOrder[i] = i;
+  predTested.assign(n, 0);
+  predPassed.assign(n, 0);
+  
+  // the page has to be evaluated again with the new filter
+  evalPageNo = -1;
+  
+  // AND can pass over a page any zone map rules out, OR only pages
+  // all of them rule out
+  predZone.assign(n, -1);
+  int zoned = 0;
+  for (int i = 0; i < n; i++) {
+    if (!preds[i].filter) continue;
+    for (int z = 0; z < headerPage->zoneCnt; z++) {
+      if (headerPage->zones[z].offset == preds[i].offset &&
+          headerPage->zones[z].type == preds[i].type) predZone[i] = z;
+    }
+    if (predZone[i] != -1) zoned++;
+  }
+  zonesUsed = anyOf ? (n > 0 && zoned == n) : zoned > 0;
+  
+  // on a PAX file a predicate is tested on the column its attribute
+  // lies in, if it lies in one
+  predCol.assign(n, -1);
+  predColOffset.assign(n, 0);
+  for (int i = 0; i < n; i++) {
+    if (!preds[i].filter) continue;
+    int start = 0;
+    for (size_t c = 0; c < colLengths.size(); c++) {
+      if (preds[i].offset >= start &&
+          preds[i].offset + preds[i].length <= start + colLengths[c]) {
+        predCol[i] = c;
+        predColOffset[i] = preds[i].offset - start;
+      }
+      start += colLengths[c];
+    }
+  }
+  
+  // look for the index that selects the fewest records, if any
+  // selects few enough.  only a scan that has to satisfy all of the
+  // predicates and goes through the whole file can use one
+  BTreeIndex* index = NULL;
+  int   indexPred = -1;
+  if (!anyOf && rangeEnd == -1 && !source) {
+    Status status = openIndexes();
+    if (status!=OK) {
+      return status;
+    }
+    double best = INDEXSELECTIVITY;
+    for (int i = 0; i < n; i++) {
+      const Predicate& p = preds[i];
+      if (!p.filter || p.op == NE) continue;
+      for (size_t k = 0; k < indexes.size(); k++) {
+        if (!indexes[k]->covers(p.offset, p.length, p.type)) continue;
+        double fraction;
+        status = indexes[k]->estimate(p, fraction);
+        if (status!=OK) {
+          return status;
+        }
+        if (fraction <= best) {
+          best = fraction;
+          index = indexes[k];
+          indexPred = i;
+        }
+      }
+    }
+  }
+  
+  if (index) {
+    scanIndex = index;
+    return scanIndex->startScan(preds[indexPred]);
+  }
+  if (scanIndex) {
+    // back from an index scan to the pages
+    scanIndex = NULL;
+    return positionAt(0);
+  }
+  return OK;
+}
+
+
+const Status HeapFileScan::setProjection(const AttrRange* fields, const int n)
+{
+  if (n < 0 || (n > 0 && !fields)) return BADSCANPARM;
+  for (int i = 0; i < n; i++)
+    if (fields[i].offset < 0 || fields[i].length < 0) return BADSCANPARM;
+  
+  projection.assign(fields, fields + n);
+  return OK;
+}
+
+
+const Status HeapFileScan::endScan()
+{
+  Status status;
+  // pages held for a batch go first
+  if ((status = releaseBatch()) != OK) {
+    return status;
+  }
+  if ((status = releaseZones()) != OK) {
+    return status;
+  }
+  // generally must unpin last page of the scan
   if (curPage != NULL) {
     status = bufMgr->unPinPage(filePtr, curPageNo, curDirtyFlag);
     curPage = NULL;
@@ -254,108 +1323,756 @@ const Status HeapFileScan::endScan()
 
 HeapFileScan::~HeapFileScan()
 {
+  // pages read ahead through a ring may still be coming in
+  if (asyncIo) asyncIo->waitFor(filePtr);
   endScan();
+  delete ring;
+  delete [] pageRecs;
+  delete [] pageRids;
+  delete [] pageMatch;
+  delete [] candIdx;
+  delete [] candRecs;
+  delete [] candPos;
+  delete [] candMatch;
+  delete [] evalBuf;
 }
 
 const Status HeapFileScan::markScan()
 {
   // make a snapshot of the state of the scan
   markedPageNo = curPageNo;
+  markedIdx = scanIdx;
   markedRec = curRec;
+  if (scanIndex) scanIndex->markScan();
   return OK;
 }
 
 const Status HeapFileScan::resetScan()
 {
   Status status;
+  if (scanIndex) {
+    // the index has the position, the record only has to be found
+    // again for getRecord
+    scanIndex->resetScan();
+    if (markedRec.pageNo == -1) {
+      curRec = markedRec;
+      return OK;
+    }
+    Record rec;
+    return HeapFile::getRecord(markedRec, rec);
+  }
   if (markedPageNo != curPageNo) {
     if (curPage != NULL) {
       status = bufMgr->unPinPage(filePtr, curPageNo, curDirtyFlag);
       if (status != OK) return status;
     }
-    // restore curPageNo and curRec values
-    curPageNo = markedPageNo;
-    curRec = markedRec;
-    // then read the page
-    status = bufMgr->readPage(filePtr, curPageNo, curPage);
-    if (status != OK) return status;
-    curDirtyFlag = false; // it will be clean
+    // restore curPageNo and curRec values
+    curPageNo = markedPageNo;
+    scanIdx = markedIdx;
+    curRec = markedRec;
+    evalPageNo = -1;
+    raNextIdx = scanIdx + 1;
+    // then read the page
+    status = bufMgr->readPage(filePtr, curPageNo, curPage);
+    if (status != OK) return status;
+    curDirtyFlag = false; // it will be clean
+  }
+  else {
+    scanIdx = markedIdx;
+    curRec = markedRec;
+    evalPageNo = -1;
+  }
+  return OK;
+}
+
+
+const Status HeapFileScan::scanNext(RID& outRid)
+{
+  Status  status = OK;
+  
+  if ((status = releaseBatch()) != OK) {
+    return status;
+  }
+  if (scanIndex) return indexNext(outRid);
+  
+  // a scan given an empty page source has no page
+  if (curPage == NULL) return FILEEOF;
+  
+  while (true) {
+    // evaluate the filter for the whole page when the scan gets to
+    // it, then hand out the matching records one by one
+    if (evalPageNo != curPageNo) {
+      evalPage();
+    }
+    while (pagePos < pageCnt) {
+      int k = pagePos++;
+      if (pageMatch[k]) {
+        curRec = pageRids[k];
+        outRid = curRec;
+        return OK;
+      }
+    }
+    
+    status = nextPage(false);
+    if (status!=OK) {
+      return status;
+    }
+  }
+  return NORECORDS;
+}
+
+
+// scanNext with the page reads of nextPage made through io
+IoTask HeapFileScan::scanNextAsync(IoRing& io, RID& outRid)
+{
+  Status  status = OK;
+  
+  if (asyncIo != &io) setIoRing(&io);
+  if ((status = releaseBatch()) != OK) {
+    co_return status;
+  }
+  if (scanIndex) co_return indexNext(outRid);
+  if (curPage == NULL) co_return FILEEOF;
+  
+  while (true) {
+    if (evalPageNo != curPageNo) {
+      evalPage();
+    }
+    while (pagePos < pageCnt) {
+      int k = pagePos++;
+      if (pageMatch[k]) {
+        curRec = pageRids[k];
+        outRid = curRec;
+        co_return OK;
+      }
+    }
+    
+    status = co_await nextPageAsync(io);
+    if (status!=OK) {
+      co_return status;
+    }
+  }
+}
+
+
+// Like scanNext, but hands out all matching records of a page at
+// once.  When a page runs out before max records have been found the
+// scan moves on to the next page, keeping the page pinned if any of
+// its records went into the batch, until max records have been found
+// or MAXBATCHPAGES pages are held.
+
+const Status HeapFileScan::scanNextBatch(RID* rids, Record* recs,
+                                         const int max, int& n)
+{
+  Status  status = OK;
+  
+  n = 0;
+  if (max < 1) return BADSCANPARM;
+  if ((status = releaseBatch()) != OK) {
+    return status;
+  }
+  if (headerPage->colCnt > 0) {
+    batchBuf.resize((size_t) max * headerPage->recLength);
+  }
+  
+  // an index scan hands out its records one at a time
+  if (scanIndex) {
+    status = indexNext(rids[0]);
+    if (status!=OK) {
+      return status;
+    }
+    n = 1;
+    return pageRecord(curPage, curRec, recs[0], batchBuf.data());
+  }
+  if (curPage == NULL) return FILEEOF;
+  
+  while (true) {
+    if (evalPageNo != curPageNo) {
+      evalPage();
+    }
+    int first = n;
+    while (pagePos < pageCnt && n < max) {
+      int k = pagePos++;
+      if (pageMatch[k]) {
+        // the page may have been changed since it was evaluated
+        curRec = pageRids[k];
+        rids[n] = curRec;
+        status = pageRecord(curPage, curRec, recs[n],
+                            batchBuf.data() + (size_t) n * headerPage->recLength);
+        
+        // a record that moved is copied, as its page is not kept
+        RID to;
+        if (status == INVALIDSLOTNO && curPage->getForward(curRec, to) == OK
+            && to.pageNo != -1 && movedRecord(to, recs[n], recBuf) == OK) {
+          char* data = (char*) recs[n].data;
+          batchMoved.emplace_back(data, data + recs[n].length);
+          recs[n].data = batchMoved.back().data();
+        }
+        n++;
+      }
+    }
+    if (n == max || batchCnt == MAXBATCHPAGES) {
+      return OK;
+    }
+    
+    status = nextPage(n > first);
+    if (status == FILEEOF && n > 0) {
+      return OK;
+    }
+    if (status!=OK) {
+      return status;
+    }
+  }
+}
+
+
+// Take the RIDs the index finds until one is of a record that
+// satisfies all of the predicates.  its page becomes the current page
+const Status HeapFileScan::indexNext(RID& outRid)
+{
+  Status status;
+  RID    rid;
+  Record rec;
+  
+  while ((status = scanIndex->scanNext(rid)) == OK) {
+    status = HeapFile::getRecord(rid, rec);
+    if (status!=OK) {
+      return status;
+    }
+    size_t i = 0;
+    while (i < preds.size() && preds[i].match(rec)) i++;
+    if (i == preds.size()) {
+      outRid = rid;
+      return OK;
+    }
+  }
+  return status;
+}
+
+
+// unpin the pages an earlier batch left pinned
+const Status HeapFileScan::releaseBatch()
+{
+  Status status = OK;
+  batchMoved.clear();
+  while (batchCnt > 0) {
+    batchCnt--;
+    Status s = bufMgr->unPinPage(filePtr, batchPageNo[batchCnt],
+                                 batchDirty[batchCnt]);
+    if (s != OK) status = s;
+  }
+  return status;
+}
+
+
+// unpin the zone map leaves the scan looked at last
+const Status HeapFileScan::releaseZones()
+{
+  Status status = OK;
+  for (int z = 0; z < MAXZONES; z++) {
+    if (zonePage[z] != NULL) {
+      Status s = bufMgr->unPinPage(filePtr, zoneLeafNo[z], false);
+      if (s != OK) status = s;
+    }
+    zoneLeaf[z] = -1;
+    zonePage[z] = NULL;
+  }
+  return status;
+}
+
+const Status HeapFileScan::ruledOut(const int pageNo, bool& out)
+{
+  Status status;
+  int    perLeaf = zonePerLeaf(filePtr);
+  
+  out = false;
+  if (!zonesUsed) return OK;
+  for (size_t i = 0; i < preds.size(); i++) {
+    int  z = predZone[i];
+    bool excluded = false;
+    if (z != -1) {
+      // move the pinned leaf of the zone map to the one of pageNo
+      int k = pageNo / perLeaf;
+      if (k != zoneLeaf[z]) {
+        if (zonePage[z] != NULL) {
+          status = bufMgr->unPinPage(filePtr, zoneLeafNo[z], false);
+          zonePage[z] = NULL;
+          if (status!=OK) {
+            return status;
+          }
+        }
+        zoneLeaf[z] = k;
+        status = zoneLeafPage(filePtr, headerPage->zones[z], k, false,
+                              zoneLeafNo[z]);
+        if (status == OK && zoneLeafNo[z] != -1)
+          status = bufMgr->readPage(filePtr, zoneLeafNo[z], zonePage[z]);
+        if (status!=OK) {
+          zoneLeaf[z] = -1;
+          zonePage[z] = NULL;
+          return status;
+        }
+      }
+      if (zonePage[z] != NULL)
+        excluded = zoneExcludes(preds[i], (char*) zonePage[z]
+                                + (pageNo % perLeaf) * 2 * sizeof(int));
+    }
+    if (excluded != anyOf) {
+      out = excluded;
+      return OK;
+    }
+  }
+  out = anyOf;
+  return OK;
+}
+
+
+// Move the scan to the page of the next directory entry, or to the
+// next run of entries handed out by the page source, passing over
+// pages the zone maps rule out.  returns FILEEOF, and stays on the
+// current page, if there is none
+
+const Status HeapFileScan::findNextPage(int& nextIdx, int& nextPageNo)
+{
+  Status  status;
+  bool    skip;
+  
+  nextIdx = scanIdx;
+  do {
+    if (++nextIdx >= scanEnd()) {
+      if (!source) return FILEEOF;
+      int count;
+      source->next(nextIdx, count);
+      if (count == 0) {
+        // the pages passed over may have run into a new range
+        rangeEnd = scanIdx + 1;
+        return FILEEOF;
+      }
+      rangeEnd = nextIdx + count;
+      raNextIdx = nextIdx;
+    }
+    status = dirPageNo(nextIdx, nextPageNo);
+    if (status == OK) status = ruledOut(nextPageNo, skip);
+    if (status!=OK) {
+      return status;
+    }
+  } while (skip);
+  return OK;
+}
+
+// unpin the current page, or keep it pinned for the batch if
+// keepPinned is true, and make sure the pages from entry nextIdx on
+// are being read in, into the frames of the scan's ring.  the reads
+// go through io if it is not NULL
+const Status HeapFileScan::leavePage(const bool keepPinned,
+                                     const int nextIdx, IoRing* io)
+{
+  Status status;
+  
+  if (keepPinned) {
+    batchPageNo[batchCnt] = curPageNo;
+    batchDirty[batchCnt] = curDirtyFlag;
+    batchCnt++;
+  }
+  else {
+    status = bufMgr->unPinPage(filePtr, curPageNo, curDirtyFlag);
+    if (status!=OK) {
+      return status;
+    }
+  }
+  curPage = NULL;
+  
+  if (readAhead > 0 && nextIdx >= raNextIdx) {
+    status = readAheadFrom(nextIdx, io);
+    if (status!=OK) {
+      return status;
+    }
+  }
+  return OK;
+}
+
+const Status HeapFileScan::nextPage(const bool keepPinned)
+{
+  Status  status;
+  int     nextIdx;
+  int     nextPageNo;
+  Page    *newPage;
+  
+  status = findNextPage(nextIdx, nextPageNo);
+  if (status == OK) status = leavePage(keepPinned, nextIdx, NULL);
+  if (status!=OK) {
+    return status;
+  }
+  
+  status = bufMgr->readPage(filePtr, nextPageNo, newPage, ring);
+  if (status!=OK) {
+    return status;
+  }
+  scanIdx = nextIdx;
+  curPageNo = nextPageNo;
+  curPage = newPage;
+  curDirtyFlag = false;
+  curRec = NULLRID;
+  return OK;
+}
+
+// nextPage for scanNextAsync
+IoTask HeapFileScan::nextPageAsync(IoRing& io)
+{
+  Status  status;
+  int     nextIdx;
+  int     nextPageNo;
+  Page    *newPage;
+  
+  status = findNextPage(nextIdx, nextPageNo);
+  if (status == OK) status = leavePage(false, nextIdx, asyncIo);
+  if (status!=OK) {
+    co_return status;
+  }
+  
+  status = co_await bufMgr->readPageAsync(filePtr, nextPageNo, newPage, io, ring);
+  if (status!=OK) {
+    co_return status;
+  }
+  scanIdx = nextIdx;
+  curPageNo = nextPageNo;
+  curPage = newPage;
+  curDirtyFlag = false;
+  curRec = NULLRID;
+  co_return OK;
+}
+
+
+// first directory entry past the pages of the scan
+const int HeapFileScan::scanEnd() const
+{
+  if (rangeEnd >= 0 && rangeEnd < headerPage->pageCnt) return rangeEnd;
+  return headerPage->pageCnt;
+}
+
+// look up the page of directory entry idx, through dirBuf
+const Status HeapFileScan::dirPageNo(const int idx, int& pageNo)
+{
+  if (idx < dirBufStart || idx >= dirBufStart + dirBufCnt) {
+    Status status = getDataPages(idx, DIRBATCH, dirBuf, dirBufCnt);
+    if (status!=OK) {
+      return status;
+    }
+    dirBufStart = idx;
+    if (dirBufCnt == 0) return BADPAGENO;
+  }
+  pageNo = dirBuf[idx - dirBufStart];
+  return OK;
+}
+
+// Unpin the pages of the scan and move it to the page of directory
+// entry idx.  Past the end of the scan it is left without a page.
+
+const Status HeapFileScan::positionAt(const int idx)
+{
+  Status status;
+  int    pageNo;
+  
+  if ((status = endScan()) != OK) {
+    return status;
+  }
+  evalPageNo = -1;
+  scanIdx = idx;
+  raNextIdx = idx;
+  if (idx >= scanEnd()) return OK;      // curPage stays NULL
+  
+  status = dirPageNo(idx, pageNo);
+  if (status!=OK) {
+    return status;
+  }
+  // pages read ahead through a ring are only queued, so the first
+  // page is read before rather than after them
+  if (readAhead > 0 && !asyncIo) {
+    status = readAheadFrom(idx);
+    if (status!=OK) {
+      return status;
+    }
+  }
+  status = bufMgr->readPage(filePtr, pageNo, curPage, ring);
+  if (status!=OK) {
+    curPage = NULL;
+    return status;
+  }
+  if (readAhead > 0 && asyncIo) {
+    status = readAheadFrom(idx, asyncIo);
+    if (status!=OK) {
+      return status;
+    }
   }
-  else curRec = markedRec;
+  curPageNo = pageNo;
+  curDirtyFlag = false;
+  curRec = NULLRID;
   return OK;
 }
 
 
-const Status HeapFileScan::scanNext(RID& outRid)
+// Gather the records of the current page and evaluate the filter for
+// all of them at once.  If the scan has already returned records of
+// the page (after resetScan, or a getRecord that moved the scan), it
+// carries on after curRec.  On a PAX page a predicate whose attribute
+// lies in one column only looks at that column, the others at the
+// records put together in evalBuf.
+
+void HeapFileScan::evalPage()
 {
-  Status  status = OK;
-  RID     nextRid;
-  RID     tmpRid;
-  int     nextPageNo;
-  Record  rec;
-  Page    *newPage;
+  pageCnt = curPage->getAllRecords(pageRecs, pageRids, pageCap);
+  const bool pax = curPage->isPax();
   
-  tmpRid = curRec;
-  while (true) {
-    while (true) {
-      // if curRec is NULLRID, read the first record
-      if ((tmpRid.pageNo == NULLRID.pageNo) && (curRec.slotNo==NULLRID.slotNo)) {
-        status = curPage->firstRecord(nextRid);
-      }
-      else {
-        status = curPage->nextRecord(tmpRid, nextRid);
-      }
-      
-      if (status == ENDOFPAGE || status == NORECORDS) {
-        break;
+  // the records that moved away are copied to movedBuf from the pages
+  // they are on, and pointed to once all are there.  one that cannot
+  // be read is empty
+  vector<pair<int, int>> moved;
+  movedBuf.clear();
+  for (int k = 0; k < pageCnt; k++) {
+    if (pageRecs[k].length != -1) continue;
+    RID    to;
+    Record rec;
+    pageRecs[k].length = 0;
+    if (curPage->getForward(pageRids[k], to) == OK && to.pageNo != -1
+        && movedRecord(to, rec, recBuf) == OK) {
+      moved.push_back({k, (int) movedBuf.size()});
+      movedBuf.insert(movedBuf.end(), (char*) rec.data,
+                      (char*) rec.data + rec.length);
+      pageRecs[k].length = rec.length;
+    }
+    pageRecs[k].data = recBuf;
+  }
+  for (auto& m : moved) pageRecs[m.first].data = movedBuf.data() + m.second;
+  
+  // each predicate is only tested on the records that are still
+  // undecided: for AND those that passed all predicates so far, for
+  // OR those that passed none of them
+  memset(pageMatch, (preds.empty() || !anyOf) ? 1 : 0, pageCnt);
+  int undecided = pageCnt;
+  for (int k = 0; k < pageCnt; k++) candIdx[k] = k;
+  for (size_t o = 0; o < predOrder.size() && undecided > 0; o++) {
+    int p = predOrder[o];
+    
+    if (pax && predCol[p] != -1) {
+      int c = predCol[p];
+      for (int k = 0; k < undecided; k++) candPos[k] = pageRids[candIdx[k]].slotNo;
+      preds[p].matchColumn(curPage->column(c) + predColOffset[p],
+                           curPage->colLengths()[c], candPos, undecided,
+                           candMatch);
+    }
+    else {
+      // while nothing has been decided the records are still pageRecs
+      const Record* recs = pageRecs;
+      if (pax && preds[p].filter) {
+        for (int k = 0; k < undecided; k++)
+          curPage->gatherRecord(pageRids[candIdx[k]],
+                                evalBuf + (size_t) k * headerPage->recLength,
+                                candRecs[k]);
+        recs = candRecs;
       }
-      
-      if (status!=OK) {
-        return status;
+      else if (undecided < pageCnt) {
+        for (int k = 0; k < undecided; k++) candRecs[k] = pageRecs[candIdx[k]];
+        recs = candRecs;
       }
-      
-      status = curPage->getRecord(nextRid, rec);
+      preds[p].matchAll(recs, undecided, candMatch);
+    }
+    
+    int left = 0;
+    int passed = 0;
+    for (int k = 0; k < undecided; k++) {
+      passed += candMatch[k];
+      if (candMatch[k] != anyOf) candIdx[left++] = candIdx[k];
+      else pageMatch[candIdx[k]] = anyOf;
+    }
+    predTested[p] += undecided;
+    predPassed[p] += passed;
+    undecided = left;
+  }
+  orderPreds();
+  
+  evalPageNo = curPageNo;
+  pagePos = 0;
+  if (curRec.pageNo == curPageNo)
+    while (pagePos < pageCnt && pageRids[pagePos].slotNo <= curRec.slotNo)
+      pagePos++;
+}
+
+
+// Read the pages of the next readAhead directory entries starting at
+// idx into the buffer pool and ask the kernel to start on the window
+// after that, so that by the time the scan gets there the pages are
+// in the OS cache if not in the pool.  Data pages of a file that was
+// filled by InsertFileScan are mostly allocated in order, so the
+// pages of a window normally make up a few long runs, each read with
+// one vectored read.
+
+const Status HeapFileScan::readAheadFrom(const int idx, IoRing* io)
+{
+  Status status;
+  int    end = scanEnd();
+  int    windowEnd = (end - idx > readAhead) ? idx + readAhead : end;
+  int    adviseEnd = (end - windowEnd > readAhead) ? windowEnd + readAhead : end;
+  
+  int runStart = -1, runLen = 0;
+  for (int k = idx; k <= adviseEnd; k++) {
+    int  pageNo = -1;
+    bool skip = false;
+    if (k < adviseEnd) {
+      status = dirPageNo(k, pageNo);
+      if (status == OK) status = ruledOut(pageNo, skip);
       if (status!=OK) {
         return status;
       }
-      
-      if (matchRec(rec)) {
-        curRec = nextRid;
-        return OK;
-      }
-      tmpRid = nextRid;
     }
-    
-    curPage->getNextPage(nextPageNo);
-    if (nextPageNo==-1) {
-      return FILEEOF;
+    // the run ends with the window, at a gap in the page numbers, or
+    // at a page the scan will pass over
+    if (runLen > 0 && (k == windowEnd || k == adviseEnd || skip
+                       || pageNo != runStart + runLen)) {
+      if (k <= windowEnd) {
+        if (io) {
+          status = bufMgr->prefetchPagesAsync(filePtr, runStart, runLen,
+                                              *io, ring);
+        }
+        else status = bufMgr->prefetchPages(filePtr, runStart, runLen, ring);
+        if (status!=OK) {
+          return status;
+        }
+      }
+      else filePtr->advisePages(runStart, runLen);
+      runLen = 0;
     }
-    
-    status = bufMgr->unPinPage(filePtr, curPageNo, curDirtyFlag);
-    if (status!=OK) {
-      return status;
+    if (skip) continue;
+    if (runLen++ == 0) runStart = pageNo;
+  }
+  raNextIdx = windowEnd;
+  return OK;
+}
+
+// set the size of the read-ahead window
+const Status HeapFileScan::setReadAhead(const int pages)
+{
+  if (pages < 0) return BADSCANPARM;
+  readAhead = pages;
+  raNextIdx = scanIdx + 1;
+  return OK;
+}
+
+// Put the predicates that decide the most records first: for AND the
+// ones fewest records pass, for OR the ones most records pass.  The
+// counts are halved now and then so that the order follows changes
+// in the data.
+
+void HeapFileScan::orderPreds()
+{
+  int n = predOrder.size();
+  for (int i = 0; i < n; i++) {
+    if (predTested[i] > 1e6) {
+      predTested[i] /= 2;
+      predPassed[i] /= 2;
     }
-    
-    status = bufMgr->readPage(filePtr, nextPageNo, newPage);
-    if (status!=OK) {
-      return status;
+  }
+  
+  // insertion sort, there are only a few predicates
+  for (int i = 1; i < n; i++) {
+    int p = predOrder[i];
+    double r = (predPassed[p] + 1) / (predTested[p] + 2);
+    int j = i;
+    for (; j > 0; j--) {
+      int q = predOrder[j - 1];
+      double rq = (predPassed[q] + 1) / (predTested[q] + 2);
+      if (anyOf ? rq >= r : rq <= r) break;
+      predOrder[j] = q;
     }
-    curPageNo = nextPageNo;
-    curPage = newPage;
-    curDirtyFlag = false;
-    curRec = NULLRID;
-    tmpRid = curRec;
+    predOrder[j] = p;
   }
-  return NORECORDS;
 }
 
+// the reads queued on the ring used so far have to be in before the
+// scan can stop caring about them
+
+void HeapFileScan::setIoRing(IoRing* io)
+{
+  if (asyncIo && asyncIo != io) asyncIo->waitFor(filePtr);
+  asyncIo = io;
+}
+
+// set the size of the scan's ring
+const Status HeapFileScan::setScanRing(const int frames)
+{
+  if (frames < 0) return BADSCANPARM;
+  delete ring;
+  ring = (frames > 0) ? new BufRing(frames) : NULL;
+  return OK;
+}
+
+// restrict the scan to a run of directory entries
+const Status HeapFileScan::setPageRange(const int first, const int count)
+{
+  if (first < 0 || count < 0) return BADSCANPARM;
+  source = NULL;
+  scanIndex = NULL;
+  rangeEnd = first + count;
+  return positionAt(first);
+}
+
+// take the pages of the scan from source
+const Status HeapFileScan::setPageSource(PageSource* source_)
+{
+  int first, count;
+  
+  if (!source_) return BADSCANPARM;
+  source = source_;
+  scanIndex = NULL;
+  source->next(first, count);
+  rangeEnd = first + count;
+  return positionAt(first);
+}
 
-// returns pointer to the current record.  page is left pinned
-// and the scan logic is required to unpin the page
+// returns pointer to the current record, or to a copy of it in
+// copyBuf if it is on a PAX page or moved.  page is left pinned and
+// the scan logic is required to unpin the page
 
 const Status HeapFileScan::getRecord(Record & rec)
 {
-  return curPage->getRecord(curRec, rec);
+  copyBuf.resize(filePtr->getPageSize());
+  copyRid = NULLRID;
+  Status status = pageRecord(curPage, curRec, rec, copyBuf.data());
+  if (status == OK && rec.data == copyBuf.data()) copyRid = curRec;
+  
+  // an update may have moved the record off the page since
+  RID to;
+  if (status == INVALIDSLOTNO && curPage->getForward(curRec, to) == OK
+      && to.pageNo != -1) {
+    status = movedRecord(to, rec, copyBuf.data());
+    if (status == OK) copyRid = curRec;
+  }
+  copyLength = rec.length;
+  return status;
+}
+
+// copy the projected fields of the current record into buf
+const Status HeapFileScan::getProjection(char* buf, int& length)
+{
+  Record rec;
+  Status status = getRecord(rec);
+  if (status != OK) return status;
+  
+  if (projection.empty()) {
+    memcpy(buf, rec.data, rec.length);
+    length = rec.length;
+    return OK;
+  }
+  
+  length = 0;
+  for (size_t i = 0; i < projection.size(); i++) {
+    const AttrRange& f = projection[i];
+    int avail = rec.length - f.offset;
+    if (avail < 0) avail = 0;
+    if (avail > f.length) avail = f.length;
+    memcpy(buf + length, (char*) rec.data + f.offset, avail);
+    memset(buf + length + avail, 0, f.length - avail);
+    length += f.length;
+  }
+  return OK;
 }
 
 // delete record from file.
@@ -363,80 +2080,219 @@ const Status HeapFileScan::deleteRecord()
 {
   Status status;
   
-  // delete the "current" record from the page
-  status = curPage->deleteRecord(curRec);
-  curDirtyFlag = true;
+  if (filePtr->isReadOnly()) return FILEREADONLY;
+  copyRid = NULLRID;
+  // a change must not open files (see LogChange)
+  if ((status = openIndexes()) != OK) {
+    return status;
+  }
+  LogChange change(bufMgr->getLog());
   
-  // reduce count of number of records in the file
-  headerPage->recCnt--;
-  hdrDirtyFlag = true;
+  // the "current" record may be one that moved here, or one that an
+  // update has moved away since
+  RID home = curPage->homeOf(curRec), at = curRec, to;
+  if (curPage->getForward(curRec, to) == OK && to.pageNo != -1) at = to;
+  status = eraseRecord(home, at);
+  if (status == OK && at.pageNo == curPageNo) curDirtyFlag = true;
   return status;
 }
 
 
-// mark current page of scan dirty
+// Update a record.  It is first tried on its home page, where a stub
+// takes it back, then on the page it moved to, if it did.  Only then
+// does it move, from its home page or from where it was, so that a
+// stub always forwards to the record itself.
+
+const Status HeapFileScan::updateRecord(const RID & rid, const Record & rec)
+{
+  Status status;
+  Page*  home;
+  Page*  page;
+  RID    at = rid, to;
+  
+  if (filePtr->isReadOnly()) return FILEREADONLY;
+  if ((unsigned int) rec.length >
+      pageDataSize(filePtr->getPageSize()) - sizeof(slot_t)) {
+    return INVALIDRECLEN;
+  }
+  if (headerPage->colCnt > 0 && rec.length != headerPage->recLength) {
+    return INVALIDRECLEN;
+  }
+  // a change must not open files (see LogChange)
+  if ((status = openIndexes()) != OK) {
+    return status;
+  }
+  LogChange change(bufMgr->getLog());
+  
+  status = bufMgr->readPage(filePtr, rid.pageNo, home);
+  if (status!=OK) {
+    return status;
+  }
+  page = home;
+  status = home->getForward(rid, to);
+  if (status == OK && to.pageNo != -1) {
+    at = to;
+    status = bufMgr->readPage(filePtr, at.pageNo, page);
+  }
+  if (status!=OK) {
+    bufMgr->unPinPage(filePtr, rid.pageNo, false);
+    return status;
+  }
+  
+  // the old record is kept for the indexes.  it has a buffer of its
+  // own, as rec may be the copy getRecord made in recBuf
+  Record old;
+  vector<char> oldBuf(filePtr->getPageSize());
+  status = pageRecord(page, at, old, oldBuf.data());
+  if (status == OK && headerPage->indexCnt > 0 && old.data != oldBuf.data()) {
+    memcpy(oldBuf.data(), old.data, old.length);
+    old.data = oldBuf.data();
+  }
+  
+  RID place = rid;         // where the record ends up
+  if (status == OK) status = home->updateRecord(rid, rec);
+  if (status == NOSPACE && page != home) {
+    place = at;
+    status = page->updateRecord(at, rec);
+  }
+  if (status == NOSPACE) {
+    status = placeMoved(rec, rid, place);
+    if (status == OK) status = home->setForward(rid, place);
+  }
+  if (status == OK && page != home
+      && (place.pageNo != at.pageNo || place.slotNo != at.slotNo))
+    status = page->deleteRecord(at);
+  
+  // scans look for the record at its home
+  if (status == OK) status = zoneInsert(rid.pageNo, rec);
+  if (status == OK) status = setFreeSpace(rid.pageNo, home->getFreeSpace());
+  if (status == OK && page != home)
+    status = setFreeSpace(at.pageNo, page->getFreeSpace());
+  if (page != home) {
+    Status s = bufMgr->unPinPage(filePtr, at.pageNo, true);
+    if (status == OK) status = s;
+  }
+  Status s = bufMgr->unPinPage(filePtr, rid.pageNo, true);
+  if (status == OK) status = s;
+  if (status!=OK) {
+    return status;
+  }
+  return indexUpdate(old, rec, rid);
+}
+
+
+// mark current page of scan dirty, or write back the copy getRecord
+// made of the current record
 const Status HeapFileScan::markDirty()
 {
+  if (filePtr->isReadOnly()) return FILEREADONLY;
+  if (copyRid.pageNo == curRec.pageNo && copyRid.slotNo == curRec.slotNo
+      && curRec.pageNo != -1) {
+    Record rec = { copyBuf.data(), copyLength };
+    return updateRecord(curRec, rec);
+  }
   curDirtyFlag = true;
-  return OK;
+  
+  // the record may have been changed in place.  one that moved here,
+  // which an index scan hands out, also counts for its home
+  Status status = zoneRefresh(curPageNo, curPage);
+  Record rec;
+  if (status == OK && curRec.pageNo == curPageNo) {
+    RID home = curPage->homeOf(curRec);
+    if (home.pageNo != curPageNo
+        && pageRecord(curPage, curRec, rec, recBuf) == OK)
+      status = zoneInsert(home.pageNo, rec);
+  }
+  return status;
+}
+
+PageSource::PageSource(const int pageCnt_, const int chunk_)
+  : nextIdx(0)
+{
+  pageCnt = pageCnt_;
+  chunk = chunk_;
+}
+
+// hand out the next chunk of directory entries
+void PageSource::next(int& first, int& count)
+{
+  first = nextIdx.fetch_add(chunk);
+  count = (first < pageCnt) ? pageCnt - first : 0;
+  if (count > chunk) count = chunk;
+}
+
+
+// one worker of a parallel scan
+static void scanWorker(const string* fileName, const int worker,
+                       PageSource* source, const Predicate* preds,
+                       const int n, const bool anyOf, const ScanFn* fn,
+                       Status* result)
+{
+  Status status;
+  HeapFileScan scan(*fileName, status);
+  if (status == OK) status = scan.setPageSource(source);
+  if (status == OK) status = scan.startScan(preds, n, anyOf);
+  
+  RID    rids[100];
+  Record recs[100];
+  int    cnt;
+  while (status == OK
+         && (status = scan.scanNextBatch(rids, recs, 100, cnt)) == OK) {
+    for (int k = 0; k < cnt; k++) (*fn)(worker, rids[k], recs[k]);
+  }
+  *result = (status == FILEEOF) ? OK : status;
 }
 
-const bool HeapFileScan::matchRec(const Record & rec) const
+
+// scan fileName with several worker threads sharing a page source
+const Status parallelScan(const string& fileName, const int workers,
+                          const Predicate* preds, const int n,
+                          const bool anyOf, const ScanFn& fn)
 {
-  // no filtering requested
-  if (!filter) return true;
+  Status status;
   
-  // see if offset + length is beyond end of record
-  // maybe this should be an error???
-  if ((offset + length -1 ) >= rec.length)
-    return false;
+  if (workers < 1 || n < 0 || (n > 0 && !preds)) return BADSCANPARM;
   
-  float diff = 0;                       // < 0 if attr < fltr
-  switch(type) {
-      
-    case INTEGER:
-      int iattr, ifltr;                 // word-alignment problem possible
-      memcpy(&iattr,
-             (char *)rec.data + offset,
-             length);
-      memcpy(&ifltr,
-             filter,
-             length);
-      diff = iattr - ifltr;
-      break;
-      
-    case FLOAT:
-      float fattr, ffltr;               // word-alignment problem possible
-      memcpy(&fattr,
-             (char *)rec.data + offset,
-             length);
-      memcpy(&ffltr,
-             filter,
-             length);
-      diff = fattr - ffltr;
-      break;
-      
-    case STRING:
-      diff = strncmp((char *)rec.data + offset,
-                     filter,
-                     length);
-      break;
+  // the header tells the source how many pages there are
+  File* filePtr;
+  int   hdrPageNo, pageCnt;
+  Page* page;
+  if ((status = db.openFile(fileName, filePtr)) != OK) {
+    return status;
+  }
+  status = filePtr->getFirstPage(hdrPageNo);
+  if (status == OK) status = bufMgr->readPage(filePtr, hdrPageNo, page);
+  if (status!=OK) {
+    db.closeFile(filePtr);
+    return status;
+  }
+  pageCnt = ((FileHdrPage*) page)->pageCnt;
+  status = bufMgr->unPinPage(filePtr, hdrPageNo, false);
+  if (status!=OK) {
+    db.closeFile(filePtr);
+    return status;
   }
   
-  switch(op) {
-    case LT:  if (diff < 0.0) return true; break;
-    case LTE: if (diff <= 0.0) return true; break;
-    case EQ:  if (diff == 0.0) return true; break;
-    case GTE: if (diff >= 0.0) return true; break;
-    case GT:  if (diff > 0.0) return true; break;
-    case NE:  if (diff != 0.0) return true; break;
+  PageSource source(pageCnt, SCANCHUNK);
+  vector<Status> results(workers, OK);
+  vector<std::thread*> threads(workers);
+  for (int w = 0; w < workers; w++)
+    threads[w] = new std::thread(scanWorker, &fileName, w, &source, preds,
+                                 n, anyOf, &fn, &results[w]);
+  for (int w = 0; w < workers; w++) {
+    threads[w]->join();
+    delete threads[w];
+    if (status == OK) status = results[w];
   }
   
-  return false;
+  Status closeStatus = db.closeFile(filePtr);
+  return (status != OK) ? status : closeStatus;
 }
 
-InsertFileScan::InsertFileScan(const string & name,
-                               Status & status) : HeapFile(name, status)
+
+InsertFileScan::InsertFileScan(const string & name, Status & status,
+                               const int mode)
+  : HeapFile(name, status, mode)
 {
   //Do nothing. Heapfile constructor will read the header page and the first
   // data page of the file into the buffer pool
@@ -465,26 +2321,49 @@ const Status InsertFileScan::insertRecord(const Record & rec, RID& outRid)
   outRid = NULLRID;
   
   // check for very large records
-  if ((unsigned int) rec.length > PAGESIZE-DPFIXED) {
+  if ((unsigned int) rec.length >
+      pageDataSize(filePtr->getPageSize()) - sizeof(slot_t)) {
     // will never fit on a page, so don't even bother looking
     return INVALIDRECLEN;
   }
+  if (headerPage->colCnt > 0 && rec.length != headerPage->recLength) {
+    return INVALIDRECLEN;
+  }
+  // a change must not open files (see LogChange)
+  if ((status = openIndexes()) != OK) {
+    return status;
+  }
+  LogChange change(bufMgr->getLog());
   
-  //make sure we are on the last page
-  if (curPageNo!=headerPage->lastPage) {
-    status = bufMgr->unPinPage(filePtr, curPageNo, curDirtyFlag);
-    if (status!=OK) {
-      return status;
-    }
-    // bring in the last page for record insertion
-    status = bufMgr->readPage(filePtr, headerPage->lastPage, newPage);
+  // stay on the current page while it has room.  otherwise use a
+  // page the free-space map knows has room, or the last page
+  if (curPage == NULL ||
+      curPage->getFreeSpace() < (int) (rec.length + sizeof(slot_t))) {
+    int pageNo;
+    status = findFreePage(rec.length, pageNo);
     if (status!=OK) {
       return status;
     }
+    if (pageNo == -1) pageNo = headerPage->lastPage;
     
-    curPage = newPage;
-    curPageNo = headerPage->lastPage;
-    curDirtyFlag = false;
+    if (pageNo != curPageNo) {
+      if (curPage != NULL) {
+        status = bufMgr->unPinPage(filePtr, curPageNo, curDirtyFlag);
+        curPage = NULL;
+        if (status!=OK) {
+          return status;
+        }
+      }
+      // bring in the page for record insertion
+      status = bufMgr->readPage(filePtr, pageNo, newPage);
+      if (status!=OK) {
+        return status;
+      }
+      
+      curPage = newPage;
+      curPageNo = pageNo;
+      curDirtyFlag = false;
+    }
   }
   
   status = curPage->insertRecord(rec, rid);
@@ -494,29 +2373,24 @@ const Status InsertFileScan::insertRecord(const Record & rec, RID& outRid)
       curRec = rid;
       curDirtyFlag = true;
       headerPage->recCnt++;
+      hdrDirtyFlag = true;
       break;
       
     case NOSPACE:
       //the last page is full we need to allocate a new page for record insertion
-      status = bufMgr->allocPage(filePtr, newPageNo, newPage);
-      if (status!=OK) {
-        return status;
-      }
-      
-      curPage->setNextPage(newPageNo);
-      status = bufMgr->unPinPage(filePtr, curPageNo, true);
+      status = appendDataPage(newPage, newPageNo);
       if (status!=OK) {
         return status;
       }
       
-      newPage->init(newPageNo);
+      status = bufMgr->unPinPage(filePtr, curPageNo, curDirtyFlag);
       curPage = newPage;
       curPageNo = newPageNo;
       curDirtyFlag = false;
       curRec = NULLRID;
-      
-      headerPage->lastPage = newPageNo;
-      headerPage->pageCnt++;
+      if (status!=OK) {
+        return status;
+      }
       
       status = curPage->insertRecord(rec, rid);
       if (status!=OK) {
@@ -532,5 +2406,113 @@ const Status InsertFileScan::insertRecord(const Record & rec, RID& outRid)
       return status;
       break;
   }
-  return OK;
-}
\ No newline at end of file
+  
+  // keep the free-space map, the zone maps and the indexes up to date
+  status = setFreeSpace(curPageNo, curPage->getFreeSpace());
+  if (status == OK) status = zoneInsert(curPageNo, rec);
+  if (status!=OK) {
+    return status;
+  }
+  return indexInsert(rec, outRid);
+}
+
+
+// Insert a batch of records.  The records are packed onto the end of
+// the last page and then onto freshly allocated pages, with no slot
+// search and no free-space map lookup, and the header and the map are
+// only updated once per page.  Every record is checked to fit on a
+// page before any of them is inserted.
+const Status InsertFileScan::insertRecords(const Record* recs, const int n,
+                                           RID* outRids)
+{
+  Page*   newPage;
+  int     newPageNo;
+  Status  status;
+  
+  for (int k = 0; k < n; k++) {
+    outRids[k] = NULLRID;
+    if ((unsigned int) recs[k].length >
+        pageDataSize(filePtr->getPageSize()) - sizeof(slot_t)) {
+      return INVALIDRECLEN;
+    }
+    if (headerPage->colCnt > 0 && recs[k].length != headerPage->recLength) {
+      return INVALIDRECLEN;
+    }
+  }
+  if (n == 0) return OK;
+  // a change must not open files (see LogChange)
+  if ((status = openIndexes()) != OK) {
+    return status;
+  }
+  LogChange change(bufMgr->getLog());
+  
+  // make sure we are on the last page
+  if (curPageNo!=headerPage->lastPage) {
+    if (curPage != NULL) {
+      status = bufMgr->unPinPage(filePtr, curPageNo, curDirtyFlag);
+      curPage = NULL;
+      if (status!=OK) {
+        return status;
+      }
+    }
+    status = bufMgr->readPage(filePtr, headerPage->lastPage, newPage);
+    if (status!=OK) {
+      return status;
+    }
+    curPage = newPage;
+    curPageNo = headerPage->lastPage;
+    curDirtyFlag = false;
+  }
+  
+  hdrDirtyFlag = true;
+  int done = 0;
+  while (true) {
+    int added = curPage->appendRecords(recs + done, n - done, outRids + done);
+    if (added > 0) curDirtyFlag = true;
+    headerPage->recCnt += added;
+    
+    status = OK;
+    for (int k = done; k < done + added && status == OK; k++) {
+      status = zoneInsert(curPageNo, recs[k]);
+    }
+    done += added;
+    if (status == OK) status = setFreeSpace(curPageNo, curPage->getFreeSpace());
+    if (status!=OK || done == n) {
+      break;
+    }
+    
+    // the page is full, continue on a new last page
+    if (dirFull(filePtr, headerPage)) {
+      status = FILEHDRFULL;
+      break;
+    }
+    status = bufMgr->allocPage(filePtr, newPageNo, newPage);
+    if (status!=OK) {
+      break;
+    }
+    initDataPage(newPage, newPageNo);
+    curPage->setNextPage(newPageNo);
+    status = bufMgr->unPinPage(filePtr, curPageNo, true);
+    curPage = newPage;
+    curPageNo = newPageNo;
+    curDirtyFlag = true;
+    if (status!=OK) {
+      break;
+    }
+    status = addDataPage(newPageNo);
+    if (status!=OK) {
+      break;
+    }
+  }
+  
+  if (done > 0) curRec = outRids[done - 1];
+  
+  // index the records that went in, even if not all of them did
+  for (int k = 0; k < done; k++) {
+    Status s = indexInsert(recs[k], outRids[k]);
+    if (s!=OK) {
+      return (status != OK) ? status : s;
+    }
+  }
+  return status;
+}
@@ -2,6 +2,7 @@
 #define HEAPFILE_H
 
 #include <sys/types.h>
+#include <deque>
 #include <functional>
 #include <iostream>
 #include <vector>
@@ -13,25 +14,189 @@ using namespace std;
 
 extern DB db;
 
+class BTreeIndex;
+
 // define if debug output wanted
 //#define DEBUGREL
 
 // Some constant definitions
 const unsigned MAXNAMESIZE = 50;
+const int DEFAULTREADAHEAD = 16;  // pages a sequential scan reads ahead
+const int DIRECTREADAHEAD = 64;   // and on a file without the OS cache
+const int SCANRINGSIZE = 32;      // frames a sequential scan cycles through
+const int SCANCHUNK = 32;         // pages a parallel scan worker takes at once
+const int DIRBATCH = 64;          // directory entries a scan reads at once
+const int MAXBATCHPAGES = 16;     // most pages one scan batch holds pinned
+const int FSMCLASSES = 8;         // free space classes counted in the header
+const int MAXFSMPAGES = 200;      // most free-space map pages of a file
+const int MAXDIRROOTS = 16;       // most page directory root pages of a file
+const int MAXINDEXES = 8;         // most indexes of a file
+const int MAXZONES = 2;           // most attributes with zone maps in a file
 
 enum Datatype { STRING, INTEGER, FLOAT };    // attribute data types
 enum Operator { LT, LTE, EQ, GTE, GT, NE };  // scan operators
 
+// A scan predicate "attribute op filter", where the attribute is
+// length bytes at offset in the record.  startScan compiles it once
+// into a comparison specialized for its datatype and operator (see
+// predicate.cpp); a predicate that has not been given a filter
+// matches every record.
+class Predicate
+{
+public:
+  typedef bool (*OneFn)(const Predicate& p, const char* attr);
+  typedef void (*ManyFn)(const Predicate& p, const Record* recs, const int n,
+                         unsigned char* matches);
+  typedef void (*ColumnFn)(const Predicate& p, const char* values,
+                           const int stride, const int* pos, const int n,
+                           unsigned char* matches);
+
+  Predicate();
+
+  // returns BADSCANPARM if the parameters are not valid
+  const Status compile(const int offset, const int length,
+                       const Datatype type, const char* filter,
+                       const Operator op);
+
+  // true if rec satisfies the predicate
+  bool match(const Record& rec) const
+  {
+    if (!one) return true;
+    if (offset + length > rec.length) return false;
+    return one(*this, (const char*) rec.data + offset);
+  }
+
+  // sets matches[k] to whether recs[k] satisfies the predicate
+  void matchAll(const Record* recs, const int n, unsigned char* matches) const;
+
+  // the same for attributes stored in a column, as on a PAX page:
+  // sets matches[k] to whether the attribute at values + pos[k] *
+  // stride satisfies the predicate
+  void matchColumn(const char* values, const int stride, const int* pos,
+                   const int n, unsigned char* matches) const;
+
+  int   offset;            // byte offset of filter attribute
+  int   length;            // length of filter attribute
+  Datatype type;           // datatype of filter attribute
+  Operator op;             // comparison operator of filter
+  const char* filter;      // comparison value of filter, NULL if none
+  int   intValue;          // filter as an int, for INTEGER
+  float floatValue;        // filter as a float, for FLOAT
+
+private:
+  OneFn  one;              // compiled comparison of one record
+  ManyFn many;             // compiled comparison of many records
+  ColumnFn column;         // compiled comparison of a column
+};
+
+// a byte range of a record, for projections
+struct AttrRange
+{
+  int offset;              // byte offset of the attribute
+  int length;              // its length
+};
+
+// create and destroy heap files.  a file created with colCnt columns
+// has pages with the PAX layout (see page.h): its records all have
+// the length of the columns together, and columns, which must follow
+// each other from offset 0, gives the attribute each minipage holds
+const Status createHeapFile(const string fileName,
+                            const unsigned pageSize = PAGESIZE,
+                            const AttrRange* columns = NULL,
+                            const int colCnt = 0);
+const Status destroyHeapFile(const string fileName);
+
+// The free-space map of a heap file records how much room each data
+// page has left, so that inserts can reuse space freed by deletes.
+// Each map page holds one byte per page number of the file, the free
+// space of the page in units of 1/256 of the page size (0 for pages
+// that are not data pages or are full); map page k covers page
+// numbers k*pageSize to (k+1)*pageSize-1.  The header counts the
+// data pages in each of FSMCLASSES classes of that byte, so an insert
+// can tell without reading the map whether any page has room.
+//
+// The page directory lists the data pages of the file in the order
+// they were added, which is also their order in the page chain, so
+// that the page k steps into the file can be found without walking
+// the chain.  It has two levels of pages holding page numbers: entry
+// k of the directory is entry k%P of the leaf page that is entry
+// (k/P)%P of root page k/(P*P), where P = pageSize/sizeof(int).  The
+// header holds the root pages and pageCnt is the number of entries.
+//
+// Index k of the file is a B+-tree (see btree.h) in the file named by
+// indexFileName(fileName, k); indexCnt says how many there are.
+//
+// A zone map keeps the smallest and the largest value of an INTEGER
+// or FLOAT attribute of the records of each data page, so that scans
+// can pass over pages that cannot hold a match.  Like the free-space
+// map it is indexed by page number: leaf pages hold a (min, max) pair
+// for each of E = pageSize/8 page numbers, and the root page holds
+// the page number of leaf k%P for page numbers k*E on, -1 until it is
+// needed.  Page numbers past what the root covers have no summary.
+// A page without values has min > max.  Values only ever widen the
+// range, so deletes leave it too wide but never wrong.
+//
+// In a file with the PAX layout colCnt is the number of columns of
+// its data pages, each of which keeps the lengths of the columns.  A
+// scan tests a predicate on an attribute that lies within one column
+// on that column's minipage alone, so a filter on one attribute reads
+// only that attribute of every record.  The records a scan, getRecord
+// or getRecords hands out are put together in a buffer of the scan or
+// the file, and changing them does not change the file, except that
+// markDirty writes back the current record of a scan.
+
+struct ZoneMapHdr
+{
+  int		offset;                  // byte offset of the attribute
+  Datatype	type;                    // INTEGER or FLOAT
+  int		rootPageNo;              // pageNo of the root page
+};
+
 struct FileHdrPage
 {
   char	fileName[MAXNAMESIZE];   // name of file
   int		firstPage;	             // pageNo of first data page in file
   int		lastPage;	               // pageNo of last data page in file
-  int		pageCnt;	               // number of pages
+  int		pageCnt;	               // number of data pages
   int		recCnt;		               // record count
+  int		fsmCnt;		               // number of free-space map pages
+  int		fsmCursor;	             // pageNo the next search for room starts at
+  int		classCnt[FSMCLASSES];      // data pages per free space class (but 0)
+  int		fsmPages[MAXFSMPAGES];     // pageNos of the free-space map pages
+  int		dirRoots[MAXDIRROOTS];     // pageNos of the directory root pages
+  int		indexCnt;	               // number of indexes
+  int		zoneCnt;	               // number of zone maps
+  ZoneMapHdr	zones[MAXZONES];         // the zone maps
+  int		colCnt;		               // columns of a PAX file, 0 if none
+  int		recLength;	             // length of the records of a PAX file
 };
 
 
+// Hands out the data pages of a heap file, chunk pages at a time in
+// directory order, to the scans of a parallel scan so that each page
+// is scanned by exactly one of them.  A source may be used by several
+// threads at once.
+
+class PageSource
+{
+public:
+  PageSource(const int pageCnt, const int chunk);
+  
+  // the next run of directory entries to scan, count is 0 once all
+  // have been handed out
+  void next(int& first, int& count);
+  
+private:
+  std::atomic<int> nextIdx; // first entry not handed out
+  int   pageCnt;           // entries to hand out
+  int   chunk;             // entries handed out at a time
+};
+
+
+// called by HeapFile::getRecords with the record of rids[k]
+typedef std::function<void(const int k, const RID& rid,
+                           const Record& rec)> RecordFn;
+
 // class definition of heapFile
 class HeapFile {
 protected:
@@ -45,10 +210,18 @@ protected:
   bool  	curDirtyFlag;       // true if page has been updated
   RID   	curRec;             // rid of last record returned
   
+  int   	openMode;           // mode the file was opened with
+  vector<BTreeIndex*> indexes;  // the indexes opened so far
+  vector<int>	colLengths;         // of a PAX file, from its first page
+  char*		recBuf;             // record of a PAX file put together,
+                                  // or one read through a stub
+  
 public:
   
-  // initialize
-  HeapFile(const string & name, Status& returnStatus);
+  // initialize.  mode is how the file is opened (see File::open):
+  // nothing can be changed in a file opened OPENREADONLY
+  HeapFile(const string & name, Status& returnStatus,
+           const int mode = 0);
   
   // destructor
   ~HeapFile();
@@ -56,8 +229,88 @@ public:
   // return number of records in file
   const int getRecCnt() const;
   
-  // given a RID, read record from file, returning pointer and length
+  // return number of data pages in file
+  const int getPageCnt() const;
+  
+  // given a RID, read record from file, returning pointer and length.
+  // a record of a PAX file is a copy, good until the next getRecord.
+  // a record that moved is found through the stub at its RID
   const Status getRecord(const RID &rid, Record & rec);
+  
+  // getRecord in a task: the page of the record is read through io,
+  // without blocking the thread.  a HeapFile must only be used by one
+  // task at a time
+  IoTask getRecordAsync(IoRing& io, const RID rid, Record & rec);
+  
+  // call fn for the record of each of the n RIDs in rids.  each page
+  // is pinned once, with the pages missing from the pool read in
+  // runs.  the records come in order of page number, or in the order
+  // of rids if inOrder is true, and can only be used until fn returns
+  const Status getRecords(const RID* rids, const int n, const RecordFn& fn,
+                          const bool inOrder = false);
+  
+  // build an index on the attribute length bytes at offset in the
+  // records, from the records in the file.  the index is kept up to
+  // date by inserts and deletes and used by selective scans
+  const Status createIndex(const int offset, const int length,
+                           const Datatype type);
+  
+  // keep a zone map of the INTEGER or FLOAT attribute at offset in
+  // the records, starting with the records in the file
+  const Status addZoneMap(const int offset, const Datatype type);
+
+protected:
+  // initialize the new data page pageNo in the layout of the file
+  void initDataPage(Page* page, const int pageNo) const;
+  
+  // record the free space of a data page in the free-space map
+  const Status setFreeSpace(const int pageNo, const int freeSpace);
+
+  // find a data page with room for a record of length bytes,
+  // returns -1 in pageNo if there is none
+  const Status findFreePage(const int length, int& pageNo);
+  
+  // add new data page pageNo at the end of the page directory
+  const Status addDataPage(const int pageNo);
+  
+  // allocate a data page, link it after the last page and add it to
+  // the directory.  it is returned pinned
+  const Status appendDataPage(Page*& page, int& pageNo);
+  
+  // put rec, the record whose stub is at home, on a data page other
+  // than that of home, returning where it went in at
+  const Status placeMoved(const Record & rec, const RID & home, RID& at);
+  
+  // copy the record at at, which a stub forwards to, into buf, which
+  // has room for a page
+  const Status movedRecord(const RID & at, Record & rec, char* buf);
+  
+  // delete the record whose RID is home and that is at at, which is
+  // home unless it moved, with its index entries and its stub
+  const Status eraseRecord(const RID & home, const RID & at);
+  
+  // copy into pageNos up to max directory entries starting at entry
+  // first, n of them.  fewer are returned at the end of a leaf page
+  const Status getDataPages(const int first, const int max, int* pageNos,
+                            int& n);
+  
+  // open the indexes of the file that are not open yet.  another
+  // HeapFile may have added some since this one was opened
+  const Status openIndexes();
+  
+  // add or remove the entries of a record in all indexes
+  const Status indexInsert(const Record & rec, const RID & rid);
+  const Status indexDelete(const Record & rec, const RID & rid);
+  
+  // move the entries of record rid from old to rec in the indexes
+  // whose key differs between them
+  const Status indexUpdate(const Record & old, const Record & rec,
+                           const RID & rid);
+  
+  // widen the zones of data page pageNo to include rec, or compute
+  // them again from the records on the page
+  const Status zoneInsert(const int pageNo, const Record & rec);
+  const Status zoneRefresh(const int pageNo, const Page* page);
 };
 
 
@@ -65,7 +318,8 @@ class HeapFileScan : public HeapFile
 {
 public:
   
-  HeapFileScan(const string & name, Status & status);
+  HeapFileScan(const string & name, Status & status,
+               const int mode = 0);
   
   // end filtered scan
   ~HeapFileScan();
@@ -76,6 +330,22 @@ public:
                          const char* filter,
                          const Operator op);
   
+  // scan for the records satisfying all of the n compiled
+  // predicates in preds, or any of them if anyOf is true.  the
+  // predicates are evaluated in order of their observed selectivity.
+  // when all must be satisfied and one of them is an EQ on an indexed
+  // attribute, or a range the index estimates selects at most
+  // INDEXSELECTIVITY of the file, the records are found through the
+  // index instead, in key order.  an index scan starts from the
+  // beginning, and so does a scan that goes back from one.  pages
+  // whose zone maps show the predicates cannot hold are not read
+  const Status startScan(const Predicate* preds, const int n,
+                         const bool anyOf = false);
+  
+  // have getProjection return only the n byte ranges in fields,
+  // n = 0 returns to whole records
+  const Status setProjection(const AttrRange* fields, const int n);
+  
   const Status endScan(); // terminate the scan
   const Status markScan(); // save current position of scan
   const Status resetScan(); // reset scan to last marked location
@@ -83,44 +353,212 @@ public:
   // return RID of next record that satisfies the scan
   const Status scanNext(RID& outRid);
   
-  // read current record, returning pointer and length
+  // scanNext in a task.  the pages of the scan are read through io,
+  // and so are the pages read ahead of it (see setIoRing), so that one
+  // thread can keep many scans going.  the first page, which startScan
+  // reads, and the pages of an index are still read synchronously.  a
+  // scan must only be used by one task at a time
+  IoTask scanNextAsync(IoRing& io, RID& outRid);
+  
+  // return up to max of the next records that satisfy the scan, n
+  // of them, and their RIDs.  the records are taken from one or more
+  // pages, which stay pinned until the next call to scanNextBatch,
+  // scanNext or endScan (records of a PAX file are copies that last
+  // as long).  returns FILEEOF once no records are left
+  const Status scanNextBatch(RID* rids, Record* recs, const int max, int& n);
+  
+  // read current record, returning pointer and length.  that of a
+  // PAX page or one that moved is a copy, good until the next
+  // getRecord.  the RIDs a scan hands out are those of the stubs of
+  // records that moved
   const Status getRecord(Record & rec);
   
+  // copy the projected fields of the current record back to back
+  // into buf, returning their total length.  fields past the end of
+  // the record are zero filled
+  const Status getProjection(char* buf, int& length);
+  
   // delete current record
   const Status deleteRecord();
   
-  // marks current page of scan dirty
+  // replace the record with RID rid by rec.  it stays on its page if
+  // the page has room, and otherwise moves to another one, leaving a
+  // stub so that rid stays valid; a record that moved moves back once
+  // its page has room.  the indexes are only changed if its key is.
+  // records that were handed out from the pages it changes can move
+  // within them.  a scan sees a record that moved at its stub, so
+  // also a record the scan itself moved on ahead of it only once
+  const Status updateRecord(const RID & rid, const Record & rec);
+  
+  // marks current page of scan dirty.  a record of a PAX page or one
+  // that moved that getRecord handed out is a copy, which is written
+  // back instead
   const Status markDirty();
   
+  // set the number of pages read ahead of a sequential scan,
+  // 0 turns read-ahead off
+  const Status setReadAhead(const int pages);
+  
+  // set the number of frames a sequential scan reads its pages
+  // into, 0 lets it use the whole pool.  should be larger than the
+  // read-ahead window
+  const Status setScanRing(const int frames);
+  
+  // read ahead through io from now on, also when a scan starts, or
+  // synchronously again if io is NULL.  scanNextAsync sets its ring
+  void setIoRing(IoRing* io);
+  
+  // scan only the count data pages starting at directory entry
+  // first.  repositions the scan at the first of them, and it goes
+  // through the pages rather than an index
+  const Status setPageRange(const int first, const int count);
+  
+  // scan only the pages handed out by source.  repositions the scan
+  // at the first of them, and it goes through the pages
+  const Status setPageSource(PageSource* source);
+  
 private:
-  int   offset;            // byte offset of filter attribute
-  int   length;            // length of filter attribute
-  Datatype type;           // datatype of filter attribute
-  const char* filter;      // comparison value of filter
-  Operator op;             // comparison operator of filter
+  // filter of the scan.  predOrder is the order the predicates are
+  // tried in, most useful first, from how many of the records each
+  // was tested on (predTested) passed it (predPassed)
+  vector<Predicate> preds;
+  bool  anyOf;             // records must pass any rather than all
+  vector<int> predOrder;
+  vector<double> predTested;
+  vector<double> predPassed;
+  vector<AttrRange> projection;  // fields returned by getProjection
+  
+  // on a PAX file, the column holding the attribute of each
+  // predicate, -1 if it is not within one column, and the offsets
+  // of the attributes in their columns
+  vector<int> predCol;
+  vector<int> predColOffset;
+  
+  // zone map of each predicate, -1 if none, and whether the zone maps
+  // can ever rule out a page.  each zone map used keeps the leaf it
+  // last looked at pinned: zoneLeaf[z] is its place in the root, and
+  // zonePage[z] the page, NULL if there is none
+  vector<int> predZone;
+  bool  zonesUsed;
+  int   zoneLeaf[MAXZONES];
+  int   zoneLeafNo[MAXZONES];
+  Page* zonePage[MAXZONES];
+  
+  // the records of the current page, gathered when the scan gets to
+  // the page, and which of them satisfy the filter.  pageRecs[k] is
+  // only valid until the page is changed
+  int   evalPageNo;        // page the arrays describe, -1 if none
+  int   pageCap;           // most records a page can hold
+  int   pageCnt;           // records on the page
+  int   pagePos;           // next record to look at
+  Record* pageRecs;        // the records, in slot order
+  RID*  pageRids;          // their RIDs
+  unsigned char* pageMatch; // 1 if the record satisfies the filter
+  int*  candIdx;           // records still undecided while evaluating
+  Record* candRecs;        // and a copy of them
+  int*  candPos;           // or their slots, on a PAX page
+  unsigned char* candMatch; // result of one predicate for them
+  char* evalBuf;           // records of a PAX page put together, for
+                           // predicates that cannot use one column
+  vector<char> batchBuf;   // records of a PAX file of the last batch
+  vector<char> copyBuf;    // the copy getRecord made of record copyRid
+  RID   copyRid;           // NULLRID if the record it handed out was not one
+  int   copyLength;        // and its length
+  vector<char> movedBuf;   // the records of the page that moved away
+  deque<vector<char>> batchMoved; // and those of the last batch
   
   // The following variables are used to preserve the state
   // of the scan when the method markScan() is invoked.
   // A subsequent invocation of resetScan() will cause the
   // scan to be rolled back to the following
   int   markedPageNo;	// page number of pinned page
+  int   markedIdx;         // its directory entry
   RID   markedRec;         // rid of last record returned
   
-  const bool matchRec(const Record & rec) const;
+  // position of the scan in the page directory.  the scan covers
+  // entries up to rangeEnd, or to the end of the file if it is -1.
+  // dirBuf caches dirBufCnt entries starting at dirBufStart
+  int   scanIdx;           // entry of the current page
+  int   rangeEnd;          // first entry past the scan
+  int   dirBufStart;
+  int   dirBufCnt;
+  int   dirBuf[DIRBATCH];
+  
+  // read-ahead state.  the directory tells the scan which pages
+  // come next, and they are brought in a window at a time
+  int   readAhead;         // read-ahead window in pages
+  int   raNextIdx;         // first entry not yet read ahead
+  BufRing* ring;           // frames of the scan's pages, NULL if none
+  PageSource* source;      // where the pages come from, NULL if none
+  BTreeIndex* scanIndex;   // index the scan goes through, NULL if none
+  IoRing* asyncIo;         // ring pages were read ahead through, if any
+  
+  // read ahead from directory entry idx, through io if it is not NULL
+  const Status readAheadFrom(const int idx, IoRing* io = NULL);
+  const int scanEnd() const;   // first entry past the scan
+  const Status dirPageNo(const int idx, int& pageNo); // page of entry idx
+  const Status positionAt(const int idx);  // move to the page of entry idx
+  // pages other than the current page that the last batch holds
+  // pinned, and whether they are dirty
+  int   batchCnt;
+  int   batchPageNo[MAXBATCHPAGES];
+  bool  batchDirty[MAXBATCHPAGES];
+  
+  const Status releaseBatch();  // unpin the pages of the last batch
+  const Status releaseZones();  // unpin the zone map leaves
+  
+  // true in out if the zone maps show that no record of data page
+  // pageNo can satisfy the predicates
+  const Status ruledOut(const int pageNo, bool& out);
+  const Status indexNext(RID& outRid);  // next record of an index scan
+  
+  // go on to the next page of the file, keeping the current page
+  // pinned for the batch if keepPinned is true
+  const Status nextPage(const bool keepPinned);
+  IoTask nextPageAsync(IoRing& io);   // the same through io, not kept
+  
+  // the two halves of nextPage up to reading the page: the entry and
+  // page number of the next page the scan reads, FILEEOF if there is
+  // none, and letting go of the current page
+  const Status findNextPage(int& nextIdx, int& nextPageNo);
+  const Status leavePage(const bool keepPinned, const int nextIdx,
+                         IoRing* io);
+  
+  void evalPage();         // fill in the arrays for the current page
+  void orderPreds();       // sort the predicates by selectivity
 };
 
 
+// scan fileName with workers threads at once.  fn is called from
+// worker threads (numbered from 0) for every record satisfying all of
+// the n predicates in preds, or any of them if anyOf is true; the
+// record can only be used until fn returns.  calls of fn from
+// different workers may overlap.  returns the first error a worker
+// ran into, after all of them are done
+typedef std::function<void(const int worker, const RID& rid,
+                           const Record& rec)> ScanFn;
+
+const Status parallelScan(const string& fileName, const int workers,
+                          const Predicate* preds, const int n,
+                          const bool anyOf, const ScanFn& fn);
+
+
 class InsertFileScan : public HeapFile
 {
 public:
   
-  InsertFileScan(const string & name, Status & status);
+  InsertFileScan(const string & name, Status & status,
+                 const int mode = 0);
   
   // end filtered scan
   ~InsertFileScan();
   
   // insert record into file, returning its RID
   const Status insertRecord(const Record & rec, RID& outRid);
+  
+  // insert n records at the end of the file, returning their RIDs
+  // in outRids
+  const Status insertRecords(const Record* recs, const int n, RID* outRids);
 };
 
 #endif
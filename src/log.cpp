@@ -0,0 +1,411 @@
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <map>
+#include "log.h"
+#include "buf.h"
+
+// write-ahead log of the buffer pool, see log.h
+
+
+// LogChange objects held by the calling thread
+static thread_local int changeDepth = 0;
+
+
+const unsigned long logChecksum(const void* data, const size_t length,
+                                unsigned long sum)
+{
+  const char* p = (const char*) data;
+  size_t i = 0;
+  for ( ; i + sizeof(unsigned long) <= length; i += sizeof(unsigned long))
+    {
+      unsigned long word;
+      memcpy(&word, p + i, sizeof word);
+      sum = (sum ^ word) * 1099511628211UL;
+      sum ^= sum >> 29;
+    }
+  for ( ; i < length; i++)
+    sum = (sum ^ (unsigned char) p[i]) * 1099511628211UL;
+  return sum;
+}
+
+
+LogMgr::LogMgr(const string & name, Status & status, const int interval_,
+               const long commitBytes_, const long checkpointBytes_)
+  : fileName(name), interval(interval_), commitBytes(commitBytes_),
+    checkpointBytes(checkpointBytes_), recovered(0), pool(NULL),
+    nextLSN(0), requested(0), done(0), commitStatus(OK), stop(false),
+    writer(NULL),
+    durable(0), logBytes(0)
+{
+  unixFile = ::open(name.c_str(), O_RDWR | O_CREAT, 0666);
+  if (unixFile < 0)
+    {
+      status = UNIXERR;
+      return;
+    }
+  if ((status = recover()) != OK)
+    return;
+  writer = new std::thread(&LogMgr::runWriter, this);
+}
+
+
+LogMgr::~LogMgr()
+{
+  if (pool) pool->setLog(NULL);
+  if (writer)
+    {
+      {
+        std::lock_guard<std::mutex> guard(latch);
+        stop = true;
+      }
+      cond.notify_all();
+      writer->join();
+      delete writer;
+    }
+  if (unixFile >= 0) ::close(unixFile);
+}
+
+
+long long LogMgr::append(const int type, const string & name,
+                         const long long offset, const void* data,
+                         const int length)
+{
+  LogRecHdr hdr;
+  memset(&hdr, 0, sizeof hdr);
+  hdr.type = type;
+  hdr.nameLength = name.size();
+  hdr.length = length;
+  hdr.lsn = nextLSN;
+  hdr.offset = offset;
+
+  unsigned long sum = logChecksum(&hdr, sizeof hdr);
+  sum = logChecksum(name.data(), name.size(), sum);
+  sum = logChecksum(data, length, sum);
+  hdr.checksum = (unsigned) (sum ^ (sum >> 32));
+
+  size_t at = buf.size();
+  buf.resize(at + sizeof hdr + name.size() + length);
+  memcpy(&buf[at], &hdr, sizeof hdr);
+  memcpy(&buf[at + sizeof hdr], name.data(), name.size());
+  if (length > 0)
+    memcpy(&buf[at + sizeof hdr + name.size()], data, length);
+
+  nextLSN += sizeof hdr + name.size() + length;
+  return nextLSN;
+}
+
+
+// the records are written where the last ones ended.  if writing
+// them fails they are put back, to be written again by the next flush
+
+const Status LogMgr::flush()
+{
+  std::lock_guard<std::mutex> guard(writeLatch);
+  vector<char> out;
+  long long end;
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    out.swap(buf);
+    end = nextLSN;
+  }
+  if (out.empty())
+    return OK;
+
+  size_t written = 0;
+  while (written < out.size())
+    {
+      ssize_t n = pwrite(unixFile, &out[written], out.size() - written,
+                         logBytes + written);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+      written += n;
+    }
+  if (written < out.size() || fdatasync(unixFile) < 0)
+    {
+      std::lock_guard<std::mutex> guard(latch);
+      out.insert(out.end(), buf.begin(), buf.end());
+      buf.swap(out);
+      return UNIXERR;
+    }
+
+  syncs.add();
+  logBytes += out.size();
+  durable = end;
+  return OK;
+}
+
+
+// a commit holds changeLatch so that no change is in progress: one
+// change may cover pages of several files, a heap file and its
+// indexes, and must be committed all at once.  flushFile takes it
+// for a commit of one file
+
+const Status LogMgr::commitChanges(const File* file)
+{
+  std::unique_lock<std::shared_mutex> quiet(changeLatch, std::defer_lock);
+  if (!file) quiet.lock();
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    long long start = nextLSN;
+    if (pool) pool->logChanges(this, file);
+    if (nextLSN == start && buf.empty())
+      return OK;
+    append(LOGCOMMIT, "", 0, NULL, 0);
+    commits.add();
+  }
+  if (quiet.owns_lock()) quiet.unlock();
+  return flush();
+}
+
+
+const Status LogMgr::logDispose(const File* file, const int pageNo,
+                                const DBPage & away, const DBPage & header)
+{
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    append(LOGPAGE, file->fileName, (long long) pageNo * file->pageSize,
+           &away, sizeof away);
+    append(LOGPAGE, file->fileName, 0, &header, sizeof header);
+    append(LOGCOMMIT, "", 0, NULL, 0);
+    commits.add();
+  }
+  return flush();
+}
+
+
+const Status LogMgr::logDestroy(const string & name)
+{
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    append(LOGDESTROY, name, 0, NULL, 0);
+    append(LOGCOMMIT, "", 0, NULL, 0);
+    commits.add();
+  }
+  return flush();
+}
+
+
+const bool LogMgr::inChange()
+{
+  return changeDepth > 0;
+}
+
+
+// a commit asked for is made by the log writer, together with all
+// others asked for meanwhile
+
+const Status LogMgr::commit()
+{
+  if (inChange())
+    return LOGBUSY;
+
+  std::unique_lock<std::mutex> guard(latch);
+  long long ticket = ++requested;
+  cond.notify_all();
+  cond.wait(guard, [&]() { return done >= ticket || stop; });
+  return done >= ticket ? commitStatus : OK;
+}
+
+
+// the changes are committed and written back while changeLatch keeps
+// new ones from being made, and ckptLatch files from being closed.
+// the log is only emptied once the files have been synced
+
+const Status LogMgr::checkpoint()
+{
+  if (inChange())
+    return LOGBUSY;
+
+  std::unique_lock<std::shared_mutex> quiet(changeLatch);
+  std::lock_guard<std::mutex> files(ckptLatch);
+  {
+    std::lock_guard<std::mutex> guard(latch);
+    if (pool) pool->logChanges(this, NULL);
+    append(LOGCOMMIT, "", 0, NULL, 0);
+    commits.add();
+  }
+  Status status = flush();
+  if (status == OK && pool) status = pool->writeBack();
+  if (status != OK)
+    return status;
+
+  std::lock_guard<std::mutex> guard(writeLatch);
+  if (ftruncate(unixFile, 0) < 0 || fdatasync(unixFile) < 0)
+    return UNIXERR;
+  logBytes = 0;
+  return OK;
+}
+
+
+// Log writer thread.  Commits every interval milliseconds, or sooner
+// when woken by commit() or by the pool, and takes a checkpoint once
+// the log has grown long enough.
+
+void LogMgr::runWriter()
+{
+  std::unique_lock<std::mutex> guard(latch);
+  while (!stop)
+    {
+      if (done == requested)
+        cond.wait_for(guard, std::chrono::milliseconds(interval));
+      if (stop) break;
+
+      long long ticket = requested;
+      guard.unlock();
+      Status status = commitChanges();
+      if (status == OK && logBytes > checkpointBytes) status = checkpoint();
+      guard.lock();
+
+      commitStatus = status;
+      done = ticket;
+      cond.notify_all();
+    }
+
+  // one last commit, so that nothing is lost on a clean shutdown
+  guard.unlock();
+  Status status = commitChanges();
+  guard.lock();
+  commitStatus = status;
+  done = requested;
+  cond.notify_all();
+}
+
+
+// Recover the log.  The records are read up to the first one that is
+// torn or out of place; only those up to the last LOGCOMMIT count.
+// The images among them are written in log order to the files they
+// belong to, but not those followed by a LOGDESTROY of their file,
+// and the files synced before the log is emptied.  A file that no
+// longer exists is skipped.
+
+struct LogRec
+{
+  LogRecHdr hdr;
+  string name;
+  const char* data;
+};
+
+const Status LogMgr::recover()
+{
+  struct stat st;
+  if (fstat(unixFile, &st) < 0)
+    return UNIXERR;
+
+  vector<char> log(st.st_size);
+  size_t got = 0;
+  while (got < log.size())
+    {
+      ssize_t n = pread(unixFile, &log[got], log.size() - got, got);
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        return UNIXERR;
+      got += n;
+    }
+
+  vector<LogRec> recs;
+  size_t committed = 0;         // records up to the last LOGCOMMIT
+  size_t pos = 0;
+  while (pos + sizeof(LogRecHdr) <= log.size())
+    {
+      LogRecHdr hdr;
+      memcpy(&hdr, &log[pos], sizeof hdr);
+      if (hdr.nameLength < 0 || hdr.length < 0
+          || pos + sizeof hdr + hdr.nameLength + hdr.length > log.size()
+          || (!recs.empty() && hdr.lsn != nextLSN))
+        break;
+
+      unsigned checksum = hdr.checksum;
+      hdr.checksum = 0;
+      unsigned long sum = logChecksum(&hdr, sizeof hdr);
+      sum = logChecksum(&log[pos + sizeof hdr], hdr.nameLength, sum);
+      sum = logChecksum(&log[pos + sizeof hdr + hdr.nameLength],
+                        hdr.length, sum);
+      if (checksum != (unsigned) (sum ^ (sum >> 32)))
+        break;
+
+      LogRec rec;
+      rec.hdr = hdr;
+      rec.name.assign(&log[pos + sizeof hdr], hdr.nameLength);
+      rec.data = &log[pos + sizeof hdr + hdr.nameLength];
+      recs.push_back(rec);
+      nextLSN = hdr.lsn + sizeof hdr + hdr.nameLength + hdr.length;
+      pos += sizeof hdr + hdr.nameLength + hdr.length;
+      if (hdr.type == LOGCOMMIT)
+        {
+          committed = recs.size();
+          recovered++;
+        }
+    }
+
+  map<string, size_t> destroyed;      // last LOGDESTROY of each file
+  for (size_t k = 0; k < committed; k++)
+    if (recs[k].hdr.type == LOGDESTROY)
+      destroyed[recs[k].name] = k;
+
+  Status status = OK;
+  map<string, int> files;             // files written to
+  for (size_t k = 0; k < committed && status == OK; k++)
+    {
+      if (recs[k].hdr.type != LOGPAGE)
+        continue;
+      map<string, size_t>::iterator d = destroyed.find(recs[k].name);
+      if (d != destroyed.end() && d->second > k)
+        continue;
+
+      map<string, int>::iterator f = files.find(recs[k].name);
+      if (f == files.end())
+        f = files.insert(make_pair(recs[k].name,
+                                   ::open(recs[k].name.c_str(), O_RDWR))).first;
+      if (f->second < 0)
+        continue;
+
+      const LogRecHdr& hdr = recs[k].hdr;
+      if (pwrite(f->second, recs[k].data, hdr.length, hdr.offset)
+          != hdr.length)
+        status = UNIXERR;
+    }
+
+  for (map<string, int>::iterator f = files.begin(); f != files.end(); f++)
+    if (f->second >= 0)
+      {
+        if (fdatasync(f->second) < 0) status = UNIXERR;
+        ::close(f->second);
+      }
+  if (status != OK)
+    return status;
+
+  if (ftruncate(unixFile, 0) < 0 || fdatasync(unixFile) < 0)
+    return UNIXERR;
+  durable = nextLSN;
+  return OK;
+}
+
+
+LogChange::LogChange(LogMgr* log_) : log(log_)
+{
+  if (!log || changeDepth++ > 0)
+    return;
+
+  // make room for this change first if the pool is full of pages
+  // that cannot be written back before a commit
+  if (log->pool && log->pool->logBacklog())
+    {
+      changeDepth--;
+      log->commit();
+      changeDepth++;
+    }
+  log->changeLatch.lock_shared();
+}
+
+
+LogChange::~LogChange()
+{
+  if (log && --changeDepth == 0)
+    log->changeLatch.unlock_shared();
+}
@@ -0,0 +1,178 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include "db.h"
+#include "stats.h"
+
+// the log writer commits at least every COMMITINTERVAL milliseconds,
+// and sooner once COMMITBYTES bytes of pages have been changed.  it
+// takes a checkpoint once the log is CHECKPOINTBYTES long
+const int COMMITINTERVAL = 10;
+const long COMMITBYTES = 1L << 20;
+const long CHECKPOINTBYTES = 64L << 20;
+
+// kinds of log records
+enum LogRecType { LOGPAGE = 1, LOGCOMMIT, LOGDESTROY };
+
+// every log record starts with this header, followed by nameLength
+// bytes of file name and length bytes of data.  a LOGPAGE record holds
+// bytes to be written at offset in the file, a LOGDESTROY record names
+// a file that was destroyed and a LOGCOMMIT record ends a group of
+// records that are only recovered together
+struct LogRecHdr
+{
+  int       type;          // a LogRecType
+  int       nameLength;    // bytes of file name
+  int       length;        // bytes of data
+  unsigned  checksum;      // of the record, taken with checksum 0
+  long long lsn;           // position of the record in the log
+  long long offset;        // where the data goes in the file
+};
+
+class BufMgr;
+
+// A write-ahead log of the pages of a buffer pool, with group commit.
+//
+// The log holds page images.  A commit appends an image of every page
+// that has changed since the last commit, once however often it was
+// changed, then a LOGCOMMIT record, and makes the log durable with a
+// single fdatasync.  Commits are made by a log writer thread every
+// interval milliseconds, sooner once commitBytes of pages have been
+// changed, and when a thread asks for one with commit(); all changes
+// made by all threads up to the commit become durable with it.
+//
+// Code that changes pages holds a LogChange for as long as one change
+// (an insert, say) takes.  A commit waits for the changes in progress
+// and holds off new ones while it takes its images, so that a commit
+// never has half of a change.  Changes made outside a LogChange are
+// logged all the same, but may be recovered in part.
+//
+// The buffer manager writes a dirty page back only once its latest
+// image is durable in the log (its LSN is at most durableLSN()), and
+// cannot evict a page changed since the last commit.  The pages on
+// disk are thus either as of some commit or torn by a crash, and
+// recovery writes the images of the last commits over them.
+//
+// A checkpoint writes all changed pages back, syncs the files and
+// empties the log.  The log writer takes one once the log grows past
+// checkpointBytes.  Opening a log recovers it: the images of all
+// committed groups are written to their files, in log order, and the
+// log is emptied.  Images of a file that was destroyed later are
+// skipped, as are records after the last LOGCOMMIT.
+
+class LogMgr
+{
+  friend class BufMgr;
+  friend class LogChange;
+public:
+  // open (or create) and recover log file name
+  LogMgr(const string & name, Status & status,
+         const int interval = COMMITINTERVAL,
+         const long commitBytes = COMMITBYTES,
+         const long checkpointBytes = CHECKPOINTBYTES);
+
+  // commits and stops the log writer.  the pool is detached from the
+  // log first if it is still attached
+  ~LogMgr();
+
+  // make every change made so far durable, then return
+  const Status commit();
+
+  // write back all pages changed so far and empty the log
+  const Status checkpoint();
+
+  // the log is durable up to here
+  const long long durableLSN() const { return durable; }
+
+  // committed groups recovered when the log was opened
+  const int getRecovered() const { return recovered; }
+
+  StatCounter commits;     // groups committed
+  StatCounter images;      // page images logged
+  StatCounter syncs;       // fdatasync calls on the log
+
+private:
+  string    fileName;      // the log file
+  int       unixFile;      // and its descriptor
+  int       interval;      // see the constructor
+  long      commitBytes;
+  long      checkpointBytes;
+  int       recovered;     // see getRecovered
+
+  BufMgr*   pool;          // pool attached with BufMgr::setLog
+  std::shared_mutex changeLatch; // shared by changes, taken by commits
+  std::mutex ckptLatch;    // held by checkpoints and file flushes
+
+  std::mutex latch;        // protects the fields below
+  std::condition_variable cond; // signals the writer and the waiters
+  vector<char> buf;        // records not written yet
+  long long nextLSN;       // LSN of the next record
+  long long requested;     // commits asked for by commit()
+  long long done;          // commits asked for that are durable
+  Status    commitStatus;  // of the last commit of the log writer
+  bool      stop;          // tells the log writer to exit
+  std::thread* writer;     // the log writer thread
+
+  std::mutex writeLatch;   // one thread writes the log at a time
+  std::atomic<long long> durable; // LSN up to which the log is durable
+  std::atomic<long> logBytes; // length of the log file
+
+  // append a record to buf, returning the LSN just past it.  the
+  // caller holds latch
+  long long append(const int type, const string & name,
+                   const long long offset, const void* data,
+                   const int length);
+
+  // write buf to the log file and make it durable
+  const Status flush();
+
+  // take images of the changed pages of the pool (of file only, if
+  // it is not NULL) and commit them.  a commit of one file is made by
+  // BufMgr::flushFile, which already holds changeLatch
+  const Status commitChanges(const File* file = NULL);
+
+  // called by the pool: commit the free-list link written into
+  // disposed page pageNo (away) and the file's new DB header before
+  // File::disposePage writes them; log a file being destroyed
+  const Status logDispose(const File* file, const int pageNo,
+                          const DBPage & away, const DBPage & header);
+  const Status logDestroy(const string & name);
+
+  // wake the log writer early
+  void wake() { cond.notify_all(); }
+
+  // true if the calling thread holds a LogChange
+  static const bool inChange();
+
+  void runWriter();        // body of the log writer thread
+  const Status recover();  // recover the log, called by the constructor
+};
+
+// held around a change of pages in the pool of log, which may be NULL.
+// a change that finds too many pages changed since the last commit
+// waits for a commit first.  a thread may hold several at once.  no
+// file may be opened or closed during a change: closing a file
+// commits it, which waits for the changes in progress while holding
+// the files of the database
+class LogChange
+{
+public:
+  LogChange(LogMgr* log);
+  ~LogChange();
+
+private:
+  LogMgr*  log;
+};
+
+// checksum of length bytes at data, continuing from sum, also used by
+// the pool to tell whether a pinned page has changed
+const unsigned long logChecksum(const void* data, const size_t length,
+                                unsigned long sum = 14695981039346656037UL);
+
+#endif
@@ -2,18 +2,53 @@
 #include <functional>
 #include <string>
 #include <iostream>
+#include <algorithm>
+#include <vector>
 using namespace std;
 #include "page.h"
 
 // page class constructor
-void Page::init(int pageNo)
+void Page::init(const int pageNo, const unsigned pageSize_)
 {
   nextPage = -1;
   slotCnt = 0; // no slots in use
   curPage = pageNo;
+  pageSize = pageSize_;
   freePtr=0; // offset of free space in data array
-  //    freeSpace=PAGESIZE-DPFIXED + sizeof(slot_t); // amount of space available
-  freeSpace=PAGESIZE-DPFIXED; // amount of space available
+  freeSpace=pageDataSize(pageSize); // amount of space available
+  colCnt = 0;
+  recLength = 0;
+}
+
+// a PAX page is a page with the column lengths at the front of data[]
+void Page::initPax(const int pageNo, const unsigned pageSize_,
+                   const int* lengths, const int colCnt_)
+{
+  init(pageNo, pageSize_);
+  colCnt = colCnt_;
+  recLength = 0;
+  for (int c = 0; c < colCnt; c++) recLength += lengths[c];
+  memcpy(data, lengths, colCnt * sizeof(int));
+  freeSpace = capacity() * (recLength + sizeof(slot_t));
+}
+
+const char* Page::column(const int c) const
+{
+  int offset = colCnt * sizeof(int);
+  int cap = capacity();
+  for (int k = 0; k < c; k++) offset += cap * colLengths()[k];
+  return &data[offset];
+}
+
+void Page::scatterRecord(const Record & rec, const int pos)
+{
+  const char* from = (const char*) rec.data;
+  for (int c = 0; c < colCnt; c++)
+  {
+    int length = colLengths()[c];
+    memcpy((char*) column(c) + pos * length, from, length);
+    from += length;
+  }
 }
 
 // dump page utlity
@@ -22,12 +57,16 @@ void Page::dumpPage() const
   int i;
   
   cout << "curPage = " << curPage <<", nextPage = " << nextPage
+  << ", pageSize = " << pageSize
   << "\nfreePtr = " << freePtr << ",  freeSpace = " << freeSpace
   << ", slotCnt = " << slotCnt << endl;
+  if (isPax())
+    cout << "PAX page of " << colCnt << " columns, records of "
+         << recLength << " bytes, capacity " << capacity() << endl;
   
   for (i=0;i>slotCnt;i--)
-    cout << "slot[" << i << "].offset = " << slot[i].offset
-	   << ", slot[" << i << "].length = " << slot[i].length << endl;
+    cout << "slot[" << i << "].offset = " << slot()[i].offset
+	   << ", slot[" << i << "].length = " << slot()[i].length << endl;
 }
 
 const Status Page::setNextPage(int pageNo)
@@ -42,7 +81,7 @@ const Status Page::getNextPage(int& pageNo) const
   return OK;
 }
 
-const short Page::getFreeSpace() const
+const int Page::getFreeSpace() const
 {
   return freeSpace;
 }
@@ -51,14 +90,17 @@ const short Page::getFreeSpace() const
 // otherwise, returns NOSPACE if sufficient space does not exist
 // RID of the new record is returned via rid parameter
 
-const Status Page::insertRecord(const Record & rec, RID& rid)
+const Status Page::insertRecord(const Record & rec, RID& rid,
+                                const RID* home)
 {
   RID tmpRid;
-  int spaceNeeded = rec.length + sizeof(slot_t);
+  int length = rec.length + (home ? sizeof(RID) : 0);
+  int spaceNeeded = length + sizeof(slot_t);
   
   // Start by checking if sufficient space exists
   // This is an upper bound check. may not actually need a slot
   // if we can find an empty one
+  if (isPax() && (home || rec.length != recLength)) return INVALIDRECLEN;
   if (spaceNeeded > freeSpace) return NOSPACE;
   else
   {
@@ -66,12 +108,29 @@ const Status Page::insertRecord(const Record & rec, RID& rid)
     // look for an empty slot
     while (i > slotCnt)
     {
-      if (slot[i].length == -1) break;
+      if (slot()[i].length == -1) break;
       else i--;
     }
     // at this point we have either found an empty slot
     // or i will be equal to slotCnt.  In either case,
     // we can just use i as the slot index
+
+    // a PAX page has a place for the record in every minipage
+    if (isPax())
+    {
+      if (i == slotCnt) slotCnt--;
+      freeSpace -= spaceNeeded;
+      slot()[i].offset = -i;
+      slot()[i].length = rec.length;
+      scatterRecord(rec, -i);
+      rid.pageNo = curPage;
+      rid.slotNo = -i;
+      return OK;
+    }
+    
+    // the free space may be in holes left by deletes
+    if (contiguousSpace() < (i == slotCnt ? spaceNeeded : length))
+      compact();
     
     // adjust free space
     if (i == slotCnt)
@@ -83,15 +142,20 @@ const Status Page::insertRecord(const Record & rec, RID& rid)
     else
     {
       // reusing an existing slot
-      freeSpace -= rec.length;
+      freeSpace -= length;
     }
     
     // use existing value of slotCnt as the index into slot array
     // use before incrementing because constructor sets the initial
     // value to 0
-    slot[i].offset = freePtr;
-    slot[i].length = rec.length;
+    slot()[i].offset = home ? (freePtr | MOVEDIN) : freePtr;
+    slot()[i].length = length;
     
+    if (home)
+    {
+      memcpy(&data[freePtr], home, sizeof(RID));
+      freePtr += sizeof(RID);
+    }
     memcpy(&data[freePtr], rec.data, rec.length); // copy data on to the data page
     freePtr += rec.length; // adjust freePtr
     
@@ -103,90 +167,220 @@ const Status Page::insertRecord(const Record & rec, RID& rid)
   }
 }
 
+// Add records to the end of the page without looking for free slots,
+// stopping at the first one that does not fit.  Used for bulk loads,
+// where the page is usually new and has no free slots anyway.
+const int Page::appendRecords(const Record* recs, const int n, RID* rids)
+{
+  int i;
+  for (i = 0; i < n; i++)
+  {
+    int spaceNeeded = recs[i].length + sizeof(slot_t);
+    if (spaceNeeded > freeSpace) break;
+    if (isPax())
+    {
+      if (recs[i].length != recLength) break;
+      slot()[slotCnt].offset = -slotCnt;
+      slot()[slotCnt].length = recLength;
+      scatterRecord(recs[i], -slotCnt);
+      freeSpace -= spaceNeeded;
+      rids[i].pageNo = curPage;
+      rids[i].slotNo = -slotCnt;
+      slotCnt--;
+      continue;
+    }
+    if (spaceNeeded > contiguousSpace()) compact();
+    
+    slot()[slotCnt].offset = freePtr;
+    slot()[slotCnt].length = recs[i].length;
+    memcpy(&data[freePtr], recs[i].data, recs[i].length);
+    freePtr += recs[i].length;
+    freeSpace -= spaceNeeded;
+    
+    rids[i].pageNo = curPage;
+    rids[i].slotNo = -slotCnt;
+    slotCnt--;
+  }
+  return i;
+}
+
+
 // delete a record from a page. Returns OK if everything went OK
-// compacts remaining records but leaves hole in slot array
-// use bcopy and not memcpy to do the compaction
+// the record's space becomes a hole that the next compact() gets
+// rid of, unless it is the last record in the data area
 
 const Status Page::deleteRecord(const RID & rid)
 {
   int	slotNo = -rid.slotNo;   // convert to negative format
   
   // first check if the record being deleted is actually valid
-  if ((slotNo > slotCnt) && (slot[slotNo].length > 0))
+  if ((slotNo > slotCnt) && (slot()[slotNo].length != -1))
   {
-    // valid slot
-    
-    // two major cases.  case (i) is the case that the record
-    // being deleted is the "last" record on the page.  This
-    // case is identified by the fact that slotNo == slotCnt+1;
-    // In this case the records do not need to be compacted.
-    // case (ii) occurs when the record being deleted has one
-    // or more records after it.  This case requires compaction.
-    // It is identified by the condition slotNo > slotCnt+1
+    int offset = slot()[slotNo].offset & ~MOVEDIN; // offset of record being deleted
+    int recLen = slot()[slotNo].length; // length of record being deleted
+
+    if (recLen < 0) recLen = 0;  // a stub has no data
+    if (isPax()) recLen += sizeof(slot_t);  // slots are counted too
+    else if (offset + recLen == freePtr) freePtr = offset;
+    freeSpace += recLen;  // increase freespace by size of hole
+    slot()[slotNo].length = -1; // mark slot free
+    slot()[slotNo].offset = 0;  // mark slot free
     
-#if 0
-    // this doesn't work if last slot is not last physical
-    // record
-    if (slotNo == (slotCnt+1))
+    // Slots at the end of the slot array can be given back.  Note
+    // that we should even compact slots that might have been emptied
+    // previously.
+    while (slotCnt < 0 && slot()[slotCnt + 1].length == -1)
     {
-      // case (i) - no compaction required
-      freePtr -= slot[slotNo].length;
-      freeSpace += sizeof(slot_t)+ slot[slotNo].length;
       slotCnt++;
-      return OK;
-    }
-    else
-#endif
-    {
-      // case (ii) - compaction required
-      int offset = slot[slotNo].offset; // offset of record being deleted
-      int recLen = slot[slotNo].length; // length of record being deleted
-      char* recPtr = &data[offset];  // get a pointer to the record
-      
-      // get handle on next record
-      int nextOffset = offset + recLen;
-      char* nextRec = &data[nextOffset];
-      
-      int cnt = freePtr-nextOffset; // calculate number of bytes to move
-      bcopy(nextRec, recPtr, cnt); // shift bytes to the left
-      
-      // now need to adjust offsets of all valid slots to the
-      // 'right' of slot being removed by recLen (size of the hole)
-      
-      for(int i = 0; i > slotCnt; i--)
-        if (slot[i].length >= 0 && slot[i].offset > slot[slotNo].offset)
-          slot[i].offset -= recLen;
-      
-      freePtr -= recLen;  // back up free pointer
-      freeSpace += recLen;  // increase freespace by size of hole
-      
-      // Now there are two cases:
-      if (slotNo == slotCnt + 1)
-        
-        // Case 1 : Slot being freed is at end of slot array. In this
-        //          case we can compact the slot array. Note that we
-        //          should even compact slots that might have been
-        //          emptied previously.
-        do
-        {
-          slotCnt++;
-          freeSpace += sizeof(slot_t);
-        }
-      while (slotCnt < 0 && slot[slotCnt + 1].length == -1);
-      
-      else
-      {
-        // Case 2: Slot being freed is in middle of slot array. No
-        //         compaction can be done.
-        slot[slotNo].length = -1; // mark slot free
-        slot[slotNo].offset = 0;  // mark slot free
-      }
-      return OK;
+      if (!isPax()) freeSpace += sizeof(slot_t);
     }
+    
+    // an empty page has no holes
+    if (slotCnt == 0) freePtr = 0;
+    return OK;
   }
   else return INVALIDSLOTNO;
 }
 
+// Replace a record.  One that does not grow, or the last one in the
+// data area with room after it, is changed where it is; any other is
+// written at freePtr, its old copy becoming a hole.  A record that
+// moved here keeps its home RID in front, and a stub takes the record
+// back from wherever it went.
+
+const Status Page::updateRecord(const RID & rid, const Record & rec)
+{
+  int	slotNo = -rid.slotNo;
+  if (slotNo <= slotCnt || slot()[slotNo].length == -1) return INVALIDSLOTNO;
+  
+  slot_t& s = slot()[slotNo];
+  if (isPax())
+  {
+    if (s.length < 0) return INVALIDSLOTNO;
+    if (rec.length != recLength) return INVALIDRECLEN;
+    scatterRecord(rec, rid.slotNo);
+    return OK;
+  }
+  
+  bool moved = s.length > 0 && (s.offset & MOVEDIN);
+  int prefix = moved ? sizeof(RID) : 0;
+  int offset = s.length > 0 ? s.offset & ~MOVEDIN : 0;
+  int oldLength = s.length > 0 ? s.length : 0;
+  int newLength = rec.length + prefix;
+  
+  if (oldLength > 0 && newLength <= oldLength)
+  {
+    memmove(&data[offset + prefix], rec.data, rec.length);
+    if (offset + oldLength == freePtr) freePtr = offset + newLength;
+  }
+  else if (newLength - oldLength > freeSpace) return NOSPACE;
+  else if (oldLength > 0 && offset + oldLength == freePtr
+           && contiguousSpace() >= newLength - oldLength)
+  {
+    memcpy(&data[offset + prefix], rec.data, rec.length);
+    freePtr = offset + newLength;
+  }
+  else
+  {
+    RID home;
+    if (moved) memcpy(&home, &data[offset], sizeof home);
+    s.length = -1;  // so that compact leaves the old copy behind
+    if (contiguousSpace() < newLength) compact();
+    
+    s.offset = moved ? (freePtr | MOVEDIN) : freePtr;
+    if (moved) memcpy(&data[freePtr], &home, sizeof home);
+    memcpy(&data[freePtr + prefix], rec.data, rec.length);
+    freePtr += newLength;
+  }
+  freeSpace -= newLength - oldLength;
+  s.length = newLength;
+  return OK;
+}
+
+// returns where the stub at rid forwards to
+const Status Page::getForward(const RID & rid, RID& to) const
+{
+  int	slotNo = -rid.slotNo;
+  if (slotNo <= slotCnt || slot()[slotNo].length == -1) return INVALIDSLOTNO;
+  
+  if (slot()[slotNo].length > -1) to = NULLRID;
+  else
+  {
+    to.pageNo = slot()[slotNo].offset;
+    to.slotNo = -2 - slot()[slotNo].length;
+  }
+  return OK;
+}
+
+// turn the record at rid into a stub forwarding to to.  its data
+// becomes a hole, as with deleteRecord
+const Status Page::setForward(const RID & rid, const RID & to)
+{
+  int	slotNo = -rid.slotNo;
+  if (slotNo <= slotCnt || slot()[slotNo].length == -1) return INVALIDSLOTNO;
+  if (isPax()) return BADRECPTR;
+  
+  slot_t& s = slot()[slotNo];
+  if (s.length > 0)
+  {
+    int offset = s.offset & ~MOVEDIN;
+    if (offset + s.length == freePtr) freePtr = offset;
+    freeSpace += s.length;
+  }
+  s.offset = to.pageNo;
+  s.length = -2 - to.slotNo;
+  return OK;
+}
+
+// the home RID of a record that moved here is in front of it
+const RID Page::homeOf(const RID & rid) const
+{
+  int	slotNo = -rid.slotNo;
+  if (slotNo <= slotCnt || slot()[slotNo].length <= 0
+      || !(slot()[slotNo].offset & MOVEDIN))
+    return rid;
+  
+  RID home;
+  memcpy(&home, &data[slot()[slotNo].offset & ~MOVEDIN], sizeof home);
+  return home;
+}
+
+// Squeeze out the holes left by deleted records.  The records are
+// moved down in the order they lie in the data area, so each move
+// goes to a lower address and never overwrites a record still to be
+// moved.
+
+struct slotOrder
+{
+  const slot_t* slots;
+  bool operator()(const int a, const int b) const
+    { return (slots[a].offset & ~MOVEDIN) < (slots[b].offset & ~MOVEDIN); }
+};
+
+void Page::compact()
+{
+  if (isPax()) return;            // the records never move
+
+  vector<int> order(-slotCnt);
+  int n = 0;
+  for (int i = 0; i > slotCnt; i--)
+    if (slot()[i].length > 0) order[n++] = i;
+  
+  slotOrder byOffset = { slot() };
+  std::sort(order.begin(), order.begin() + n, byOffset);
+  
+  int dest = 0;
+  for (int k = 0; k < n; k++)
+  {
+    slot_t& s = slot()[order[k]];
+    int offset = s.offset & ~MOVEDIN;
+    if (offset != dest) memmove(&data[dest], &data[offset], s.length);
+    s.offset = dest | (s.offset & MOVEDIN);
+    dest += s.length;
+  }
+  freePtr = dest;
+}
+
 // returns RID of first record on page
 const Status Page::firstRecord(RID& firstRid) const
 {
@@ -196,10 +390,10 @@ const Status Page::firstRecord(RID& firstRid) const
   // find the first non-empty slot
   while (i > slotCnt)
   {
-    if (slot[i].length == -1) i--;
+    if (slot()[i].length < 0) i--;
     else break;
   }
-  if ((i == slotCnt) || (slot[i].length == -1)) return NORECORDS;
+  if ((i == slotCnt) || (slot()[i].length < 0)) return NORECORDS;
   else
   {
     // found a non-empty slot
@@ -222,10 +416,10 @@ const Status Page::nextRecord (const RID &curRid, RID& nextRid) const
   // find the first non-empty slot
   while (i > slotCnt)
   {
-    if (slot[i].length == -1) i--;
+    if (slot()[i].length < 0) i--;
     else break;
   }
-  if ((i <= slotCnt) || (slot[i].length == -1)) return ENDOFPAGE;
+  if ((i <= slotCnt) || (slot()[i].length < 0)) return ENDOFPAGE;
   else
   {
     // found a non-empty slot
@@ -236,18 +430,67 @@ const Status Page::nextRecord (const RID &curRid, RID& nextRid) const
   }
 }
 
+// returns the records on the page in slot order.  a record that moved
+// here is left to its stub, which comes with no data and length -1
+const int Page::getAllRecords(Record* recs, RID* rids, const int max)
+{
+  int n = 0;
+  for (int i = 0; i > slotCnt && n < max; i--)
+  {
+    const slot_t& s = slot()[i];
+    if (s.length == -1 || (s.length > 0 && (s.offset & MOVEDIN))) continue;
+    if (s.length < -1) {
+      recs[n].data = NULL;
+      recs[n].length = -1;
+    }
+    else {
+      recs[n].data = isPax() ? NULL : &data[recStart(i)];
+      recs[n].length = recSize(i);
+    }
+    rids[n].pageNo = curPage;
+    rids[n].slotNo = -i;
+    n++;
+  }
+  return n;
+}
+
 // returns length and pointer to record with RID rid
 const Status Page::getRecord(const RID & rid, Record & rec)
 {
   int	slotNo = rid.slotNo;
   int offset;
   
-  if (((-slotNo) > slotCnt) && (slot[-slotNo].length > 0))
+  if (((-slotNo) > slotCnt) && (slot()[-slotNo].length > 0))
   {
-    offset = slot[-slotNo].offset; // extract offset in data[]
+    if (isPax()) return BADRECPTR;
+    offset = recStart(-slotNo); // extract offset in data[]
     rec.data = &data[offset];  // return pointer to actual record
-    rec.length = slot[-slotNo].length; // return length of record
+    rec.length = recSize(-slotNo); // return length of record
     return OK;
   }
   else return INVALIDSLOTNO;
 }
+
+// copies the record with RID rid to buf, putting the columns of a
+// record of a PAX page back together
+const Status Page::gatherRecord(const RID & rid, char* buf, Record & rec) const
+{
+  int	slotNo = -rid.slotNo;
+  if (slotNo <= slotCnt || slot()[slotNo].length <= 0)
+    return INVALIDSLOTNO;
+
+  rec.data = buf;
+  rec.length = recSize(slotNo);
+  if (!isPax())
+  {
+    memcpy(buf, &data[recStart(slotNo)], rec.length);
+    return OK;
+  }
+  for (int c = 0; c < colCnt; c++)
+  {
+    int length = colLengths()[c];
+    memcpy(buf, column(c) + rid.slotNo * length, length);
+    buf += length;
+  }
+  return OK;
+}
@@ -17,59 +17,208 @@ struct Record
   int length;
 };
 
-// slot structure
+// slot structure.  offsets are ints so that pages larger than
+// 32 KB can be addressed
 struct slot_t {
-        short	offset;  
-        short	length;  // equals -1 if slot is not in use
+        int	offset;
+        int	length;  // equals -1 if slot is not in use
 };
 
-const unsigned PAGESIZE = 1024;
-const unsigned DPFIXED= sizeof(slot_t)+4*sizeof(short)+2*sizeof(int);
-const unsigned PAGEDATASIZE = PAGESIZE-DPFIXED+sizeof(slot_t);
-// size of the data area of a page
+// the offset of a record that moved to its page from another one has
+// this bit set (see the Page class)
+const int MOVEDIN = 1 << 30;
 
-// Class definition for a minirel data page.   
-// The design assumes that records are kept compacted when
-// deletions are performed. Notice, however, that the slot
-// array cannot be compacted.  Notice, this class does not keep
+// page sizes are chosen per file when the file is created and must
+// be a power of two between MINPAGESIZE and MAXPAGESIZE.  PAGESIZE
+// is the size used when the caller does not ask for one.
+const unsigned MINPAGESIZE = 1024;
+const unsigned MAXPAGESIZE = 65536;
+const unsigned PAGESIZE = 8192;
+
+const unsigned DPFIXED= 8*sizeof(int);
+// size of the fixed page header
+
+// most columns of a page with the PAX layout
+const int MAXPAXCOLUMNS = 16;
+
+// returns true if pageSize is one of the supported page sizes
+inline bool validPageSize(const unsigned pageSize)
+{
+  return pageSize >= MINPAGESIZE && pageSize <= MAXPAGESIZE
+      && (pageSize & (pageSize - 1)) == 0;
+}
+
+// size of the data area of a page of pageSize bytes
+inline unsigned pageDataSize(const unsigned pageSize)
+{
+  return pageSize - DPFIXED;
+}
+
+// Class definition for a minirel data page.
+// Deleting a record leaves a hole in the data area; the holes
+// are only squeezed out by compact() when an insert needs more
+// contiguous room than is left after freePtr.  freeSpace counts
+// the holes too.  Notice, however, that the slot array cannot
+// be compacted.  Notice, this class does not keep
 // the records align, relying instead on upper levels to take
 // care of non-aligned attributes
+//
+// The fixed header sits at the front of the page.  Records grow
+// forward from the start of data[] and the slot array grows
+// backwards from the last byte of the page, so the position of
+// the slot array depends on the page size recorded in the header.
+// data[] is declared with the largest supported size; only the
+// first pageSize bytes of a Page object are ever read or written.
+//
+// A page initialized with initPax holds records of one fixed length
+// split into colCnt columns (PAX, "partition attributes across").
+// data[] starts with the lengths of the columns, followed by one
+// minipage per column that holds that column of every record back
+// to back, so the values of one attribute on the page lie together.
+// The record in slot s is at position s in every minipage.  The
+// slot array is kept as on other pages, with room for capacity()
+// slots set aside; freeSpace is the room left for that many more
+// records, each counted with its slot.  A record of a PAX page is
+// not in one piece, so getRecord returns BADRECPTR and the record
+// has to be put together with gatherRecord.
+//
+// A record that grew too long for its page is moved to another page
+// by the heap file, leaving a forwarding stub in its slot so that its
+// RID stays valid.  A stub has no data: its offset is the page number
+// of the record and its length -2 minus the slot number.  The moved
+// record starts with the RID of its stub, its home, and MOVEDIN is
+// set in its offset; the records a page hands out begin after the
+// home RID.  Scans find a moved record at its stub and pass over it
+// on the page it moved to, so that they see it once.  Records of a
+// PAX page have one length and never move.
 
 class Page {
 private:
-    char 	data[PAGESIZE - DPFIXED]; 
-    slot_t 	slot[1]; // first element of slot array - grows backwards!
-    short	slotCnt; // number of slots in use;
-    short	freePtr; // offset of first free byte in data[]
-    short	freeSpace; // number of bytes free in data[]
-    short	dummy;	// for alignment purposes
-    int		nextPage; // forwards pointer
     int		curPage;  // page number of current pointer
+    int		nextPage; // forwards pointer
+    int		slotCnt; // number of slots in use;
+    int		freePtr; // offset of first free byte in data[]
+    int		freeSpace; // number of bytes free in data[], holes included
+    int		pageSize; // size of this page in bytes
+    int		colCnt;   // columns of a PAX page, 0 for other pages
+    int		recLength; // length of the records of a PAX page
+    char 	data[MAXPAGESIZE - DPFIXED];
+
+    // first element of slot array - grows backwards!
+    slot_t* slot()
+      { return (slot_t*)((char*)this + pageSize) - 1; }
+    const slot_t* slot() const
+      { return (const slot_t*)((const char*)this + pageSize) - 1; }
+
+    // bytes between freePtr and the slot array
+    int contiguousSpace() const
+      { return pageDataSize(pageSize) + slotCnt * (int) sizeof(slot_t) - freePtr; }
+
+    // copy rec into position pos of the minipages
+    void scatterRecord(const Record & rec, const int pos);
+
+    // where the record in slot i starts in data[] and its length,
+    // without the home RID of a record that moved here
+    int recStart(const int i) const
+      { return (slot()[i].offset & ~MOVEDIN)
+               + ((slot()[i].offset & MOVEDIN) ? (int) sizeof(RID) : 0); }
+    int recSize(const int i) const
+      { return slot()[i].length
+               - ((slot()[i].offset & MOVEDIN) ? (int) sizeof(RID) : 0); }
 
 public:
-    void init(const int pageNo); // initialize a new page
+    void init(const int pageNo, const unsigned pageSize); // initialize a new page
+
+    // initialize a new PAX page for records of colCnt columns whose
+    // lengths are in lengths
+    void initPax(const int pageNo, const unsigned pageSize,
+                 const int* lengths, const int colCnt);
+
+    const bool isPax() const    // true if the page has the PAX layout
+      { return colCnt > 0; }
+
+    // the number of records a PAX page of pageSize bytes can hold
+    static int paxCapacity(const unsigned pageSize, const int recLength,
+                           const int colCnt)
+      { return (pageDataSize(pageSize) - colCnt * (int) sizeof(int))
+               / (recLength + (int) sizeof(slot_t)); }
+    const int capacity() const
+      { return paxCapacity(pageSize, recLength, colCnt); }
+
+    // the lengths of the columns of a PAX page
+    const int* colLengths() const
+      { return (const int*) data; }
+
+    // minipage of column c of a PAX page.  the value of the record in
+    // slot s is at column(c) + s * (length of column c)
+    const char* column(const int c) const;
     void dumpPage() const;       // dump contents of a page
 
     const Status getNextPage(int& pageNo) const; // returns value of nextPage
     const Status setNextPage(const int pageNo); // sets value of nextPage to pageNo
-    const short getFreeSpace() const; // returns amount of free space
+    const int getFreeSpace() const; // returns amount of free space
 
-    // inserts a new record (rec) into the page, returns RID of record 
-    const Status insertRecord(const Record & rec, RID& rid);
+    // inserts a new record (rec) into the page, returns RID of record.
+    // a record that moved here is given the RID of its stub in home
+    const Status insertRecord(const Record & rec, RID& rid,
+                              const RID* home = NULL);
 
-    // delete the record with the specified rid
+    // appends as many of the n records in recs as fit, each in a new
+    // slot, returning their RIDs in rids.  returns how many were added
+    const int appendRecords(const Record* recs, const int n, RID* rids);
+
+    // delete the record with the specified rid, or the stub there
     const Status deleteRecord(const RID & rid);
 
+    // replace the record with RID rid by rec, in place if it is no
+    // longer and otherwise in the free space of the page, compacting
+    // it if need be.  a stub takes rec back in its slot.  returns
+    // NOSPACE if the page has too little room.  rec must not be in
+    // the page unless it is no longer than the record
+    const Status updateRecord(const RID & rid, const Record & rec);
+
+    // the RID of the record the stub at rid forwards to, NULLRID if
+    // rid is a record
+    const Status getForward(const RID & rid, RID& to) const;
+
+    // free the data of the record at rid and leave a stub forwarding
+    // to to, or point the stub there at to
+    const Status setForward(const RID & rid, const RID & to);
+
+    // the RID of the stub of the record at rid if it moved here from
+    // another page, rid itself otherwise
+    const RID homeOf(const RID & rid) const;
+
+    // move the records together so that all free space is after
+    // freePtr.  records keep their slots but not their addresses
+    void compact();
+
     // returns RID of first record on page
     // returns  NORECORDS if page contains no records.  Otherwise, returns OK
     const Status firstRecord(RID& firstRid) const;
 
-    // returns RID of next record on the page 
+    // returns RID of next record on the page
     // returns ENDOFPAGE if no more records exist on the page
     const Status nextRecord (const RID & curRid, RID& nextRid) const;
 
     // returns reference to record with RID rid
     const Status getRecord(const RID & rid, Record & rec);
+
+    // copies the record with RID rid to buf, which must have room
+    // for it, and returns it in rec.  works on pages of both layouts
+    const Status gatherRecord(const RID & rid, char* buf, Record & rec) const;
+
+    // returns the largest number of records a page of pageSize
+    // bytes can hold
+    static int maxRecords(const unsigned pageSize)
+      { return pageDataSize(pageSize) / sizeof(slot_t); }
+
+    // fills in the records on the page and their RIDs, in slot
+    // order, returning how many there are (at most max).  on a PAX
+    // page the records have the right length but no data.  records
+    // that moved here are left out, and a stub comes with no data
+    // and length -1
+    const int getAllRecords(Record* recs, RID* rids, const int max);
 };
 
 #endif
@@ -0,0 +1,187 @@
+#include "heapfile.h"
+
+// compiled scan predicates.  a predicate is compiled by picking the
+// instantiation of the comparison templates below for its datatype
+// and operator, so evaluating it does not dispatch on either.
+
+// a op b for a comparison operator known at compile time
+template <Operator O, typename T>
+static inline bool compare(const T a, const T b)
+{
+  switch (O) {
+    case LT:  return a < b;
+    case LTE: return a <= b;
+    case EQ:  return a == b;
+    case GTE: return a >= b;
+    case GT:  return a > b;
+    case NE:  return a != b;
+  }
+  return false;
+}
+
+// the attribute of one record, attr points at it
+template <Datatype D, Operator O>
+static bool matchOne(const Predicate& p, const char* attr)
+{
+  if (D == INTEGER) {
+    int value;                          // attributes may be unaligned
+    memcpy(&value, attr, sizeof value);
+    return compare<O>(value, p.intValue);
+  }
+  if (D == FLOAT) {
+    float value;
+    memcpy(&value, attr, sizeof value);
+    return compare<O>(value, p.floatValue);
+  }
+  return compare<O>(strncmp(attr, p.filter, p.length), 0);
+}
+
+// n records at once.  numeric attributes are first gathered into a
+// small aligned array and then compared in a loop without branches,
+// which the compiler turns into vector compares
+template <Datatype D, Operator O, typename T>
+static void matchNumeric(const Predicate& p, const Record* recs, const int n,
+                         unsigned char* matches)
+{
+  const int CHUNK = 64;
+  T values[CHUNK];
+  unsigned char present[CHUNK];
+  T constant = (D == INTEGER) ? (T) p.intValue : (T) p.floatValue;
+
+  for (int start = 0; start < n; start += CHUNK) {
+    int cnt = (n - start < CHUNK) ? n - start : CHUNK;
+    for (int k = 0; k < cnt; k++) {
+      const Record& rec = recs[start + k];
+      present[k] = (p.offset + p.length <= rec.length);
+      if (present[k]) memcpy(&values[k], (char*) rec.data + p.offset, sizeof(T));
+      else values[k] = constant;
+    }
+    for (int k = 0; k < cnt; k++)
+      matches[start + k] = compare<O>(values[k], constant) & present[k];
+  }
+}
+
+template <Datatype D, Operator O>
+static void matchMany(const Predicate& p, const Record* recs, const int n,
+                      unsigned char* matches)
+{
+  if (D == INTEGER) matchNumeric<D, O, int>(p, recs, n, matches);
+  else if (D == FLOAT) matchNumeric<D, O, float>(p, recs, n, matches);
+  else
+    for (int k = 0; k < n; k++)
+      matches[k] = (p.offset + p.length <= recs[k].length) &&
+                   matchOne<D, O>(p, (char*) recs[k].data + p.offset);
+}
+
+// n attributes of a column, stride bytes apart.  the values to look
+// at are mostly near each other, and there is no length to check
+template <Datatype D, Operator O, typename T>
+static void columnNumeric(const Predicate& p, const char* values,
+                          const int stride, const int* pos, const int n,
+                          unsigned char* matches)
+{
+  const int CHUNK = 64;
+  T gathered[CHUNK];
+  T constant = (D == INTEGER) ? (T) p.intValue : (T) p.floatValue;
+
+  for (int start = 0; start < n; start += CHUNK) {
+    int cnt = (n - start < CHUNK) ? n - start : CHUNK;
+    for (int k = 0; k < cnt; k++)
+      memcpy(&gathered[k], values + (size_t) pos[start + k] * stride, sizeof(T));
+    for (int k = 0; k < cnt; k++)
+      matches[start + k] = compare<O>(gathered[k], constant);
+  }
+}
+
+template <Datatype D, Operator O>
+static void matchColumns(const Predicate& p, const char* values,
+                         const int stride, const int* pos, const int n,
+                         unsigned char* matches)
+{
+  if (D == INTEGER) columnNumeric<D, O, int>(p, values, stride, pos, n, matches);
+  else if (D == FLOAT) columnNumeric<D, O, float>(p, values, stride, pos, n, matches);
+  else
+    for (int k = 0; k < n; k++)
+      matches[k] = matchOne<D, O>(p, values + (size_t) pos[k] * stride);
+}
+
+// the instantiations for one datatype, indexed by operator
+#define PREDOPS(D, F) { F<D, LT>, F<D, LTE>, F<D, EQ>, F<D, GTE>, F<D, GT>, F<D, NE> }
+
+static Predicate::OneFn oneFns[3][6] = {
+  PREDOPS(STRING, matchOne), PREDOPS(INTEGER, matchOne), PREDOPS(FLOAT, matchOne)
+};
+
+static Predicate::ManyFn manyFns[3][6] = {
+  PREDOPS(STRING, matchMany), PREDOPS(INTEGER, matchMany), PREDOPS(FLOAT, matchMany)
+};
+
+static Predicate::ColumnFn columnFns[3][6] = {
+  PREDOPS(STRING, matchColumns), PREDOPS(INTEGER, matchColumns),
+  PREDOPS(FLOAT, matchColumns)
+};
+
+
+Predicate::Predicate()
+{
+  one = NULL;
+  many = NULL;
+  column = NULL;
+  filter = NULL;
+}
+
+
+// check the parameters and compile the predicate.  a NULL filter
+// gives a predicate that every record satisfies.
+const Status Predicate::compile(const int offset_, const int length_,
+                                const Datatype type_, const char* filter_,
+                                const Operator op_)
+{
+  one = NULL;
+  many = NULL;
+  column = NULL;
+  filter = NULL;
+  if (!filter_) return OK;
+
+  if ((offset_ < 0 || length_ < 1) ||
+      (type_ != STRING && type_ != INTEGER && type_ != FLOAT) ||
+      ((type_ == INTEGER && length_ != sizeof(int))
+       || (type_ == FLOAT && length_ != sizeof(float))) ||
+      (op_ != LT && op_ != LTE && op_ != EQ && op_ != GTE && op_ != GT && op_ != NE))
+  {
+    return BADSCANPARM;
+  }
+
+  offset = offset_;
+  length = length_;
+  type = type_;
+  op = op_;
+  filter = filter_;
+  if (type == INTEGER) memcpy(&intValue, filter, sizeof intValue);
+  if (type == FLOAT) memcpy(&floatValue, filter, sizeof floatValue);
+  one = oneFns[type][op];
+  many = manyFns[type][op];
+  column = columnFns[type][op];
+  return OK;
+}
+
+
+// evaluate the predicate for n records, setting matches[k] to 1 if
+// recs[k] satisfies it and to 0 otherwise
+void Predicate::matchAll(const Record* recs, const int n,
+                         unsigned char* matches) const
+{
+  if (!many) memset(matches, 1, n);
+  else many(*this, recs, n, matches);
+}
+
+
+// evaluate the predicate for n attributes in a column.  values points
+// at the attribute of the record in position 0
+void Predicate::matchColumn(const char* values, const int stride,
+                            const int* pos, const int n,
+                            unsigned char* matches) const
+{
+  if (!column) memset(matches, 1, n);
+  else column(*this, values, stride, pos, n, matches);
+}
@@ -0,0 +1,86 @@
+#include "stats.h"
+
+// counters and histograms of the buffer manager and the files
+
+
+void LatencyHist::record(const long ns)
+{
+    int i = 0;
+    if (ns > 1)
+    {
+        i = 63 - __builtin_clzl((unsigned long) ns);
+        if (i >= LATENCYBUCKETS) i = LATENCYBUCKETS - 1;
+    }
+    buckets[i].add();
+    totalNs.add(ns > 0 ? ns : 0);
+}
+
+
+void LatencyHist::clear()
+{
+    for (int i = 0; i < LATENCYBUCKETS; i++) buckets[i].clear();
+    totalNs.clear();
+}
+
+
+const long LatencyHist::count() const
+{
+    long n = 0;
+    for (int i = 0; i < LATENCYBUCKETS; i++) n += buckets[i].get();
+    return n;
+}
+
+
+const long LatencyHist::mean() const
+{
+    long n = count();
+    return n ? totalNs.get() / n : 0;
+}
+
+
+// the buckets are read one at a time while others may be recording,
+// so the result is only as exact as the histogram itself
+
+const long LatencyHist::percentile(const double q) const
+{
+    long n = count();
+    if (n == 0) return 0;
+
+    long want = (long) (q * n + 0.5);
+    if (want < 1) want = 1;
+    long seen = 0;
+    for (int i = 0; i < LATENCYBUCKETS; i++)
+    {
+        seen += buckets[i].get();
+        if (seen >= want) return 2L << i;
+    }
+    return 2L << (LATENCYBUCKETS - 1);
+}
+
+
+void PageStats::clear()
+{
+    hits.clear();
+    misses.clear();
+    prefetches.clear();
+    evictions.clear();
+    writebacks.clear();
+}
+
+
+void FileStats::clear()
+{
+    PageStats::clear();
+    readTime.clear();
+    writeTime.clear();
+    runReadTime.clear();
+    runWriteTime.clear();
+}
+
+
+void PoolStats::clear()
+{
+    PageStats::clear();
+    sweepSteps.clear();
+    missTime.clear();
+}
@@ -0,0 +1,125 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <chrono>
+
+// define to compile the instrumentation out.  counters and histograms
+// then take no time and always read as zero (BufStats is not affected)
+//#define NOSTATS
+
+// an event counter.  adds are relaxed atomic adds: any thread may
+// count, but a count is not ordered with anything else it does
+class StatCounter
+{
+private:
+#ifndef NOSTATS
+  std::atomic<long> n;
+#endif
+
+public:
+  StatCounter() { clear(); }
+
+#ifndef NOSTATS
+  void add(const long k = 1) { n.fetch_add(k, std::memory_order_relaxed); }
+  const long get() const { return n.load(std::memory_order_relaxed); }
+  void clear() { n.store(0, std::memory_order_relaxed); }
+#else
+  void add(const long k = 1) {}
+  const long get() const { return 0; }
+  void clear() {}
+#endif
+};
+
+// number of buckets of a latency histogram.  bucket 0 counts times
+// below 2 ns and bucket i those from 2^i up to 2^(i+1) ns; the last
+// bucket (about 4 seconds and up) counts everything longer too
+const int LATENCYBUCKETS = 32;
+
+// a histogram of times in nanoseconds with buckets growing by powers
+// of two, so that recording a time costs two relaxed atomic adds
+class LatencyHist
+{
+private:
+  StatCounter buckets[LATENCYBUCKETS];
+  StatCounter totalNs;       // sum of all times recorded
+
+public:
+  void record(const long ns);
+  void clear();
+
+  const long count() const;              // number of times recorded
+  const long bucket(const int i) const   // times in bucket i
+    { return buckets[i].get(); }
+  const long mean() const;               // mean time, 0 if none
+  // upper bound of the bucket holding fraction q (0 to 1) of the
+  // times, so percentile(0.99) is within a factor of two of the
+  // 99th percentile.  0 if no times were recorded
+  const long percentile(const double q) const;
+};
+
+// measures the time from its construction to stop()
+class StatTimer
+{
+private:
+#ifndef NOSTATS
+  std::chrono::steady_clock::time_point start;
+#endif
+
+public:
+#ifndef NOSTATS
+  StatTimer() : start(std::chrono::steady_clock::now()) {}
+  void stop(LatencyHist & hist) const
+    {
+      hist.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+    }
+#else
+  void stop(LatencyHist & hist) const {}
+#endif
+};
+
+// what the buffer manager did with the pages of a file, or of all
+// files in a pool.  readPage calls that found the page resident (or
+// mapped, for a read-only file) are hits and the others misses; pages
+// read by prefetchPages are counted apart from both.  evictions are
+// pages dropped to make room for other pages, write-backs dirty pages
+// written by evictions, flushes and the page cleaner
+struct PageStats
+{
+  StatCounter hits;
+  StatCounter misses;
+  StatCounter prefetches;
+  StatCounter evictions;
+  StatCounter writebacks;
+
+  void clear();
+};
+
+// statistics of one open file.  besides what the pool did with its
+// pages, the time taken by each single page read and write
+// (File::intread and File::intwrite) and by each vectored read and
+// write of a run of pages
+struct FileStats : public PageStats
+{
+  LatencyHist readTime;
+  LatencyHist writeTime;
+  LatencyHist runReadTime;
+  LatencyHist runWriteTime;
+
+  void clear();
+};
+
+// statistics of a buffer pool.  sweepSteps counts the frames the clock
+// hand passed over looking for victims, which cannot be charged to
+// any one file, and missTime the time readPage took on a miss, from
+// finding a frame to the page being installed in it
+struct PoolStats : public PageStats
+{
+  StatCounter sweepSteps;
+  LatencyHist missTime;
+
+  void clear();
+};
+
+#endif
@@ -1,15 +1,119 @@
 #include <stdio.h>
 #include "heapfile.h"
+#include "log.h"
 #include <string.h>
+#include <thread>
+#include <unistd.h>
+#include <sys/wait.h>
 #include "stdlib.h"
 
-extern Status createHeapFile(string FileName);
-extern Status destroyHeapFile(string FileName);
-
 // globals
 DB db;
 BufMgr* bufMgr;
 
+// scan a file rounds times, storing the number of records seen by
+// each round in counts[]. used to run several scans at once.
+static void countRecords(const char* fileName, const int rounds, int* counts)
+{
+  Status status;
+  RID rid;
+  for (int r = 0; r < rounds; r++) {
+    HeapFileScan scan(fileName, status);
+    counts[r] = -1;
+    if (status != OK) return;
+    scan.startScan(0, 0, STRING, NULL, EQ);
+    int n = 0;
+    while ((status = scan.scanNext(rid)) == OK) n++;
+    if (status == FILEEOF) counts[r] = n;
+  }
+}
+
+// count the records of scan in count, reading its pages through io
+static IoTask countAsync(IoRing& io, HeapFileScan* scan, int& count)
+{
+  Status status;
+  RID rid;
+  count = 0;
+  while ((status = co_await scan->scanNextAsync(io, rid)) == OK) count++;
+  co_return status == FILEEOF ? OK : status;
+}
+
+// really close the files that linger after their last close, so
+// that their pages leave the pool
+static void closeLingering()
+{
+  db.setLingerLimit(0);
+  db.setLingerLimit(LINGERFILES);
+}
+
+// insert and delete records of random lengths on a page of every
+// page size, checking the page against a model of its slots after
+// every step: records read back as written, the holes deletes leave
+// are compacted away once an insert needs the room, the first free
+// slot is reused before a new one is taken, and the free space is
+// what the model leaves.  returns the number of steps that went wrong
+static int checkPageModel()
+{
+  int bad = 0;
+  unsigned seed = 1;
+  Page* page = new Page;
+  for (unsigned size = MINPAGESIZE; size <= MAXPAGESIZE; size *= 2) {
+    vector<vector<char> > model;   // record of each slot, empty if free
+    int used = 0;                  // bytes of the records in the model
+    page->init(0, size);
+    for (int step = 0; step < 4000; step++) {
+      seed = seed * 1103515245 + 12345;
+      unsigned r = seed >> 8;
+      int live = 0;
+      for (size_t s = 0; s < model.size(); s++) if (!model[s].empty()) live++;
+      int room = pageDataSize(size) - used - model.size() * sizeof(slot_t);
+      
+      if (r % 3 != 0 || live == 0) {
+        int length = 1 + (r >> 2) % (size / 16);
+        vector<char> rec(length);
+        for (int k = 0; k < length; k++) rec[k] = (char) (step + k);
+        Record dbrec = { rec.data(), length };
+        RID rid;
+        Status status = page->insertRecord(dbrec, rid);
+        if (length + (int) sizeof(slot_t) > room) {
+          if (status != NOSPACE) bad++;
+        }
+        else {
+          size_t s = 0;
+          while (s < model.size() && !model[s].empty()) s++;
+          if (status != OK || rid.slotNo != (int) s) bad++;
+          else if (s == model.size()) model.push_back(rec);
+          else model[s] = rec;
+          if (status == OK) used += length;
+        }
+      }
+      else {
+        int k = (r >> 2) % live, s = 0;
+        for (; model[s].empty() || k-- > 0; s++) ;
+        RID rid = { 0, s };
+        if (page->deleteRecord(rid) != OK) bad++;
+        used -= model[s].size();
+        model[s].clear();
+        while (!model.empty() && model.back().empty()) model.pop_back();
+      }
+      
+      room = pageDataSize(size) - used - model.size() * sizeof(slot_t);
+      if (page->getFreeSpace() != room) bad++;
+      for (size_t s = 0; s < model.size(); s++) {
+        RID rid = { 0, (int) s };
+        Record rec;
+        Status status = page->getRecord(rid, rec);
+        if (model[s].empty() ? status == OK
+            : (status != OK || rec.length != (int) model[s].size()
+               || memcmp(rec.data, model[s].data(), rec.length) != 0))
+          bad++;
+      }
+    }
+  }
+  delete page;
+  return bad;
+}
+
 int main(int argc, char **argv)
 {
   cout << "Testing the relation interface" << endl << endl;
@@ -36,7 +140,14 @@ int main(int argc, char **argv)
   Record        dbrec2;
   RID		  rec2Rid;
   
-  bufMgr = new BufMgr(101);
+  // frames are large enough for every supported page size, and the
+  // page cleaner keeps between 10 and 40 frames dirty.  the pool asks
+  // for huge pages spread over the NUMA nodes, and has to be aligned
+  // for direct I/O whether it gets them or not
+  bufMgr = new BufMgr(101, MAXPAGESIZE, 10, 40, CLOCKREPL,
+                      POOLHUGE2M | POOLINTERLEAVE);
+  if ((size_t) bufMgr->bufPool % 4096 != 0)
+    cout << "Error.   buffer pool is not aligned" << endl;
   
   int i,j;
   int num = 10120;
@@ -229,6 +340,44 @@ int main(int argc, char **argv)
     cout << "getRecord() tests passed successfully" << endl;
   }
   delete file1; // close the file
+  
+  // fetch every 5th record at once, asking for them back to front
+  cout << endl;
+  cout << "pull every 5th record from file dummy.02 using file->getRecords() "
+       << endl;
+  file1 = new HeapFile("dummy.02", status);
+  if (status != OK) error.print(status);
+  else
+  {
+    vector<RID> rids;
+    for (i = num - 1; i >= 0; i -= 5) rids.push_back(ridArray[i]);
+    for (int inOrder = 0; inOrder < 2; inOrder++)
+    {
+      int seen = 0, lastPageNo = -1;
+      bool ordered = true, matched = true;
+      status = file1->getRecords(&rids[0], rids.size(),
+        [&](const int k, const RID& rid, const Record& rec) {
+          RECORD *currRec = (RECORD *) rec.data;
+          char expected[sizeof(currRec->s)];
+          int key = num - 1 - 5 * k;
+          sprintf(expected, "This is record %05d", key);
+          if (currRec->i != key || currRec->f != key
+              || strcmp(currRec->s, expected) != 0) matched = false;
+          if (inOrder ? k != seen : rid.pageNo < lastPageNo) ordered = false;
+          lastPageNo = rid.pageNo;
+          seen++;
+        }, inOrder);
+      if (status != OK) error.print(status);
+      if (seen != (int) rids.size() || !matched)
+        cout << "Error.   getRecords returned the wrong records" << endl;
+      else if (!ordered)
+        cout << "Error.   getRecords returned the records out of order" << endl;
+      else
+        cout << "getRecords() returned " << seen << " records in "
+             << (inOrder ? "input" : "page") << " order" << endl;
+    }
+  }
+  delete file1;
   delete [] ridArray;
   
   
@@ -324,6 +473,39 @@ int main(int argc, char **argv)
       << " records!" << endl;
   }
   
+  // the file is empty now, so inserting the records again must reuse
+  // its pages rather than grow the file
+  cout << endl << "insert " << num << " records into the emptied dummy.02" << endl;
+  {
+    File* file;
+    int pagesBefore = 0, pagesAfter = 0;
+    if ((status = db.openFile("dummy.02", file)) == OK) {
+      file->getNumPages(pagesBefore);
+      db.closeFile(file);
+    }
+    iScan = new InsertFileScan("dummy.02", status);
+    if (status != OK) error.print(status);
+    for (i = 0; i < num && status == OK; i++) {
+      rec1.i = i;
+      rec1.f = i;
+      sprintf(rec1.s, "This is record %05d", i);
+      dbrec1.data = &rec1;
+      dbrec1.length = sizeof(RECORD);
+      status = iScan->insertRecord(dbrec1, newRid);
+    }
+    if (status != OK) error.print(status);
+    delete iScan;
+    if ((status = db.openFile("dummy.02", file)) == OK) {
+      file->getNumPages(pagesAfter);
+      db.closeFile(file);
+    }
+    if (pagesAfter == pagesBefore)
+      cout << "file stayed at " << pagesAfter << " pages" << endl;
+    else
+      cout << "Error.   file grew from " << pagesBefore << " to "
+           << pagesAfter << " pages" << endl;
+  }
+  
   status = destroyHeapFile("dummy.02");
   if (status != OK)
   {
@@ -553,6 +735,208 @@ int main(int argc, char **argv)
   delete scan1;
   
   
+  // run several scans of the same file in parallel
+  const int numThreads = 4;
+  const int numRounds = 3;
+  cout << endl << "scan dummy.04 from " << numThreads << " threads at once" << endl;
+  {
+    int counts[numThreads][numRounds];
+    std::thread* threads[numThreads];
+    for (j = 0; j < numThreads; j++)
+      threads[j] = new std::thread(countRecords, "dummy.04", numRounds, counts[j]);
+    int bad = 0;
+    for (j = 0; j < numThreads; j++) {
+      threads[j]->join();
+      delete threads[j];
+      for (int r = 0; r < numRounds; r++)
+        if (counts[j][r] != i) bad++;
+    }
+    if (bad == 0)
+      cout << "all parallel scans saw " << i << " records" << endl;
+    else
+      cout << "Error.   " << bad << " parallel scans did not see "
+           << i << " records" << endl;
+  }
+  
+  
+  // split one scan among several threads.  each record goes to
+  // exactly one worker, so the counts of the workers add up
+  cout << endl << "parallel scan of dummy.04 with " << numThreads << " workers" << endl;
+  {
+    std::atomic<int> seen[numThreads];
+    std::atomic<long> keySum(0);
+    for (j = 0; j < numThreads; j++) seen[j] = 0;
+    status = parallelScan("dummy.04", numThreads, NULL, 0, false,
+                          [&](const int worker, const RID& rid, const Record& rec) {
+                            seen[worker]++;
+                            keySum += ((RECORD *) rec.data)->i;
+                          });
+    if (status != OK) error.print(status);
+    int total = 0;
+    for (j = 0; j < numThreads; j++) total += seen[j];
+    long expectSum = 0;
+    scan1 = new HeapFileScan("dummy.04", status);
+    scan1->startScan(0, 0, STRING, NULL, EQ);
+    while ((status = scan1->scanNext(rec2Rid)) == OK) {
+      scan1->getRecord(dbrec2);
+      expectSum += ((RECORD *) dbrec2.data)->i;
+    }
+    delete scan1;
+    if (total == i && keySum == expectSum)
+      cout << "parallel scan saw " << total << " records" << endl;
+    else
+      cout << "Error.   parallel scan saw " << total << " records, not "
+           << i << endl;
+  }
+  
+  
+  // the page directory lets a scan start anywhere in the file.  the
+  // two halves of the file make up the whole of it
+  cout << endl << "scan the two halves of dummy.04 through the page directory" << endl;
+  {
+    int halves[2] = {0, 0};
+    int pages = 0;
+    for (int h = 0; h < 2; h++) {
+      scan1 = new HeapFileScan("dummy.04", status);
+      if (status != OK) error.print(status);
+      pages = scan1->getPageCnt();
+      scan1->startScan(0, 0, STRING, NULL, EQ);
+      if (h == 0) status = scan1->setPageRange(0, pages / 2);
+      else status = scan1->setPageRange(pages / 2, pages - pages / 2);
+      if (status != OK) error.print(status);
+      while ((status = scan1->scanNext(rec2Rid)) == OK) halves[h]++;
+      delete scan1;
+    }
+    if (halves[0] + halves[1] == i && halves[0] > 0 && halves[1] > 0)
+      cout << "halves of " << pages << " pages saw " << halves[0] << " and "
+           << halves[1] << " records" << endl;
+    else
+      cout << "Error.   halves saw " << halves[0] << " and " << halves[1]
+           << " records, not " << i << " in all" << endl;
+  }
+  
+  
+  // a file opened read-only is scanned straight out of a mapping of
+  // it.  it cannot be changed, nor opened for writing, meanwhile
+  cout << endl << "scan dummy.04 opened read-only" << endl;
+  {
+    bufMgr->clearBufStats();
+    scan1 = new HeapFileScan("dummy.04", status, true);
+    if (status != OK) error.print(status);
+    scan1->startScan(0, 0, STRING, NULL, EQ);
+    j = 0;
+    RID lastRid = NULLRID;
+    while ((status = scan1->scanNext(rec2Rid)) == OK) {
+      lastRid = rec2Rid;
+      j++;
+    }
+    Status delStatus = scan1->deleteRecord();
+    Status getStatus = scan1->HeapFile::getRecord(lastRid, dbrec2);
+    iScan = new InsertFileScan("dummy.04", status);
+    Status insStatus = status;
+    delete iScan;
+    delete scan1;
+    if (j == i && bufMgr->getBufStats().diskreads == 0)
+      cout << "read-only scan saw " << j << " records without reading into the pool" << endl;
+    else
+      cout << "Error.   read-only scan saw " << j << " records, not " << i << endl;
+    if (delStatus == FILEREADONLY && insStatus == FILEREADONLY && getStatus == OK)
+      cout << "read-only file could not be changed" << endl;
+    else
+      cout << "Error.   read-only file was open for changes" << endl;
+  }
+  
+  
+  // a sequential scan reads its pages into a small ring of frames,
+  // so a page that was just used by getRecord stays in the pool.
+  // file2 keeps dummy.04 open so that its pages are not flushed
+  cout << endl << "scan dummy.04 through a ring of 8 frames" << endl;
+  {
+    HeapFile* file2 = new HeapFile("dummy.04", status);
+    if (status != OK) error.print(status);
+    RID hotRid = NULLRID;
+    scan1 = new HeapFileScan("dummy.04", status);
+    scan1->startScan(0, 0, STRING, NULL, EQ);
+    for (j = 0; j < i / 2 && (status = scan1->scanNext(rec2Rid)) == OK; j++)
+      hotRid = rec2Rid;
+    delete scan1;
+    file1 = new HeapFile("dummy.04", status);
+    if (status == OK) status = file1->getRecord(hotRid, dbrec2);
+    if (status != OK) error.print(status);
+    delete file1;
+
+    scan1 = new HeapFileScan("dummy.04", status);
+    scan1->setReadAhead(4);
+    scan1->setScanRing(8);
+    scan1->startScan(0, 0, STRING, NULL, EQ);
+    j = 0;
+    while ((status = scan1->scanNext(rec2Rid)) == OK) j++;
+    delete scan1;
+    if (j != i)
+      cout << "Error.   scan should have returned " << i << " records!" << endl;
+
+    bufMgr->clearBufStats();
+    file1 = new HeapFile("dummy.04", status);
+    if (status == OK) status = file1->getRecord(hotRid, dbrec2);
+    if (status != OK) error.print(status);
+    delete file1;
+    delete file2;
+    if (bufMgr->getBufStats().diskreads == 0)
+      cout << "page read before the scan is still in the pool" << endl;
+    else
+      cout << "Error.   scan evicted the page read before it" << endl;
+  }
+
+
+  // the pool and the file count the same hits and misses, and every
+  // miss is timed once by the pool and once by the page read
+  cout << endl << "count hits and misses of two scans of dummy.04" << endl;
+  {
+    closeLingering();
+    bufMgr->clearBufStats();
+    bufMgr->clearPoolStats();
+    HeapFile* file2 = new HeapFile("dummy.04", status);
+    if (status != OK) error.print(status);
+    for (int t = 0; t < 2; t++) {
+      scan1 = new HeapFileScan("dummy.04", status);
+      scan1->startScan(0, 0, STRING, NULL, EQ);
+      while ((status = scan1->scanNext(rec2Rid)) == OK) ;
+      delete scan1;
+    }
+    PoolSnapshot open;
+    bufMgr->snapshot(open);
+
+    File* file = NULL;
+    status = db.openFile("dummy.04", file);
+    if (status != OK) error.print(status);
+#ifndef NOSTATS
+    const FileStats& fs = file->getStats();
+    const PoolStats& ps = bufMgr->getPoolStats();
+    bool same = fs.hits.get() == ps.hits.get()
+             && fs.misses.get() == ps.misses.get()
+             && fs.prefetches.get() == ps.prefetches.get();
+    bool timed = ps.missTime.count() == ps.misses.get()
+              && fs.readTime.count() == fs.misses.get();
+    long reads = ps.misses.get() + ps.prefetches.get();
+    long hits = ps.hits.get();
+    if (same && timed && reads == bufMgr->getBufStats().diskreads && hits > 0)
+      cout << reads << " pages read and " << hits << " hits" << endl;
+    else
+      cout << "Error.   pool and file statistics do not agree" << endl;
+#endif
+    db.closeFile(file);
+    delete file2;
+    closeLingering();
+    PoolSnapshot closed;
+    bufMgr->snapshot(closed);
+
+    if (open.pinned > 0 && closed.pinned == 0 && closed.dirty == 0)
+      cout << "no frames pinned or dirty once dummy.04 is closed" << endl;
+    else
+      cout << "Error.   " << closed.pinned << " frames still pinned" << endl;
+  }
+
+  
   // perform filtered scan #1
   scan1 = new HeapFileScan("dummy.04", status);
   if (status != OK) error.print(status);
@@ -594,6 +978,37 @@ int main(int argc, char **argv)
   
   delete scan1;
   
+  // the same scan in batches of up to 100 records.  the records of a
+  // batch stay pinned, so they can be read until the next batch
+  cout << endl << "Batched scan matching i field GTE than " << filterVal1 << endl;
+  {
+    const int batchMax = 100;
+    RID batchRids[batchMax];
+    Record batchRecs[batchMax];
+    int n, bad = 0;
+    scan1 = new HeapFileScan("dummy.04", status);
+    if (status == OK)
+      status = scan1->startScan(0, sizeof(int), INTEGER, (char *) &filterVal1, GTE);
+    if (status != OK) error.print(status);
+    i = 0;
+    j = 0;
+    while ((status = scan1->scanNextBatch(batchRids, batchRecs, batchMax, n)) == OK)
+    {
+      for (int k = 0; k < n; k++) {
+        RECORD *currRec = (RECORD *) batchRecs[k].data;
+        if (currRec->i < filterVal1 || batchRids[k].pageNo < 0) bad++;
+      }
+      i += n;
+      j++;
+    }
+    if (status != FILEEOF) error.print(status);
+    delete scan1;
+    cout << "batched scan saw " << i << " records in " << j << " batches" << endl;
+    if (i != num/4 || bad != 0)
+      cout << "Error.   batched scan should have returned " << num/4
+           << " matching records!" << endl;
+  }
+  
   // perform filtered scan #2
   scan1 = new HeapFileScan("dummy.04", status);
   if (status != OK) error.print(status);
@@ -635,6 +1050,226 @@ int main(int argc, char **argv)
   delete scan1;
   
   
+  // conjunctive and disjunctive scans with several predicates
+  {
+    Predicate preds[2];
+    int filterVal4 = num * 3 / 4;
+    float filterVal5 = num * 9 / 10;
+    preds[0].compile(0, sizeof(int), INTEGER, (char *) &filterVal4, GTE);
+    preds[1].compile(sizeof(int), sizeof(float), FLOAT, (char *) &filterVal5, LT);
+    cout << endl << "Filtered scan matching i field GTE " << filterVal4
+         << " and f field LT " << filterVal5 << endl;
+    scan1 = new HeapFileScan("dummy.04", status);
+    if (status != OK) error.print(status);
+    status = scan1->startScan(preds, 2);
+    if (status != OK) error.print(status);
+    i = 0;
+    while ((status = scan1->scanNext(rec2Rid)) == OK)
+    {
+      scan1->getRecord(dbrec2);
+      RECORD *currRec = (RECORD *) dbrec2.data;
+      if (!(currRec->i >= filterVal4 && currRec->f < filterVal5))
+        cout << "Error.   scan returned record " << currRec->i
+             << " that doesn't satisfy both predicates" << endl;
+      i++;
+    }
+    if (status != FILEEOF) error.print(status);
+    cout << "scan file1 saw " << i << " records " << endl;
+    if (i != (int) filterVal5 - filterVal4)
+      cout << "Error.   scan should have returned " << (int) filterVal5 - filterVal4
+           << " records!" << endl;
+    delete scan1;
+
+    // return only the i and s fields of the records that match either
+    int filterVal6 = 500;
+    float filterVal7 = num * 9 / 10;
+    preds[0].compile(0, sizeof(int), INTEGER, (char *) &filterVal6, LT);
+    preds[1].compile(sizeof(int), sizeof(float), FLOAT, (char *) &filterVal7, GT);
+    AttrRange fields[2] = { { 0, sizeof(int) }, { 2 * sizeof(int), 20 } };
+    cout << endl << "Filtered scan matching i field LT " << filterVal6
+         << " or f field GT " << filterVal7 << ", returning i and s" << endl;
+    scan1 = new HeapFileScan("dummy.04", status);
+    if (status != OK) error.print(status);
+    status = scan1->startScan(preds, 2, true);
+    if (status == OK) status = scan1->setProjection(fields, 2);
+    if (status != OK) error.print(status);
+    i = 0;
+    while ((status = scan1->scanNext(rec2Rid)) == OK)
+    {
+      char proj[sizeof(int) + 20];
+      char expected[21];
+      int projLen, key;
+      scan1->getProjection(proj, projLen);
+      memcpy(&key, proj, sizeof(int));
+      sprintf(expected, "This is record %05d", key);
+      if (projLen != sizeof(proj) || !(key < filterVal6 || key > filterVal7)
+          || memcmp(proj + sizeof(int), expected, 20) != 0)
+        cout << "Error.   bad projection of record " << key << endl;
+      i++;
+    }
+    if (status != FILEEOF) error.print(status);
+    cout << "scan file1 saw " << i << " records " << endl;
+    if (i != filterVal6 + num - 1 - (int) filterVal7)
+      cout << "Error.   scan should have returned " << filterVal6 + num - 1 - (int) filterVal7
+           << " records!" << endl;
+    delete scan1;
+  }
+  
+  
+  // a closed file lingers with its pages in the pool, so opening it
+  // again reads nothing until it is really closed
+  cout << endl << "reopen dummy.04 after closing it" << endl;
+  {
+    int reads[3];
+    for (int t = 0; t < 3; t++) {
+      if (t == 2) closeLingering();
+      bufMgr->clearBufStats();
+      file1 = new HeapFile("dummy.04", status);
+      if (status != OK) error.print(status);
+      delete file1;
+      reads[t] = bufMgr->getBufStats().diskreads;
+    }
+    if (reads[1] == 0 && reads[2] > 0)
+      cout << "reopened file read no pages until it was really closed" << endl;
+    else
+      cout << "Error.   reopening dummy.04 read " << reads[1] << " pages, "
+           << reads[2] << " once really closed" << endl;
+  }
+  
+  
+  // the records of dummy.04 went in in order of i, so with a zone map
+  // on i a scan for the largest quarter of them need not read the
+  // other pages.  the file is really closed before each scan, so
+  // every page a scan reads is a disk read
+  cout << endl << "scan dummy.04 with a zone map on the i field" << endl;
+  {
+    int filterVal8 = num * 3 / 4;
+    int reads[2];
+    for (int t = 0; t < 2; t++) {
+      if (t == 1) {
+        file1 = new HeapFile("dummy.04", status);
+        if (status == OK) status = file1->addZoneMap(0, INTEGER);
+        if (status != OK) error.print(status);
+        if (file1->addZoneMap(0, INTEGER) != INDEXEXISTS)
+          cout << "Error.   second zone map on the i field was added" << endl;
+        delete file1;
+      }
+      closeLingering();
+      bufMgr->clearBufStats();
+      scan1 = new HeapFileScan("dummy.04", status);
+      if (status == OK)
+        status = scan1->startScan(0, sizeof(int), INTEGER, (char *) &filterVal8, GTE);
+      if (status != OK) error.print(status);
+      j = 0;
+      while ((status = scan1->scanNext(rec2Rid)) == OK) j++;
+      delete scan1;
+      reads[t] = bufMgr->getBufStats().diskreads;
+      if (j != num / 4)
+        cout << "Error.   scan should have returned " << num / 4 << " records!" << endl;
+    }
+    if (reads[1] < reads[0] / 2)
+      cout << "zone map cut page reads from " << reads[0] << " to "
+           << reads[1] << endl;
+    else
+      cout << "Error.   zone map scan read " << reads[1]
+           << " pages, " << reads[0] << " without" << endl;
+    
+    // a record added at the start of the file widens its zone
+    iScan = new InsertFileScan("dummy.04", status);
+    rec1.i = num + 1;
+    rec1.f = num + 1;
+    dbrec1.data = &rec1;
+    dbrec1.length = sizeof(RECORD);
+    if (status == OK) status = iScan->insertRecord(dbrec1, newRid);
+    if (status != OK) error.print(status);
+    delete iScan;
+    scan1 = new HeapFileScan("dummy.04", status);
+    int filterVal9 = num;
+    if (status == OK)
+      status = scan1->startScan(0, sizeof(int), INTEGER, (char *) &filterVal9, GT);
+    j = 0;
+    while ((status = scan1->scanNext(rec2Rid)) == OK) {
+      if (rec2Rid.pageNo != newRid.pageNo || rec2Rid.slotNo != newRid.slotNo)
+        cout << "Error.   scan returned the wrong record" << endl;
+      else status = scan1->deleteRecord();
+      j++;
+    }
+    delete scan1;
+    if (j != 1)
+      cout << "Error.   scan should have returned the record added" << endl;
+  }
+  
+  
+  // an index on i turns selective scans on it into a few page reads.
+  // it is kept up to date by inserts and deletes
+  cout << endl << "index dummy.04 on the i field" << endl;
+  {
+    file1 = new HeapFile("dummy.04", status);
+    if (status == OK) status = file1->createIndex(0, sizeof(int), INTEGER);
+    if (status != OK) error.print(status);
+    if (file1->createIndex(0, sizeof(int), INTEGER) != INDEXEXISTS)
+      cout << "Error.   second index on the i field was created" << endl;
+    int pages = file1->getPageCnt();
+    delete file1;
+    
+    int keys[4] = { 5000, 1500, 100, num + 5 };
+    Operator ops[4] = { EQ, EQ, LT, EQ };
+    int expected[4] = { 1, 0, 100, 1 };
+    for (int t = 0; t < 4; t++) {
+      if (t == 3) {
+        // add the record looked up next
+        iScan = new InsertFileScan("dummy.04", status);
+        rec1.i = keys[t];
+        rec1.f = keys[t];
+        dbrec1.data = &rec1;
+        dbrec1.length = sizeof(RECORD);
+        if (status == OK) status = iScan->insertRecord(dbrec1, newRid);
+        if (status != OK) error.print(status);
+        delete iScan;
+      }
+      closeLingering();
+      bufMgr->clearBufStats();
+      scan1 = new HeapFileScan("dummy.04", status);
+      if (status == OK)
+        status = scan1->startScan(0, sizeof(int), INTEGER, (char *) &keys[t], ops[t]);
+      if (status != OK) error.print(status);
+      j = 0;
+      while ((status = scan1->scanNext(rec2Rid)) == OK) {
+        scan1->getRecord(dbrec2);
+        RECORD *currRec = (RECORD *) dbrec2.data;
+        if (ops[t] == EQ ? currRec->i != keys[t] : currRec->i >= keys[t])
+          cout << "Error.   index scan returned record " << currRec->i << endl;
+        if (t == 3 && (status = scan1->deleteRecord()) != OK) error.print(status);
+        j++;
+      }
+      int reads = bufMgr->getBufStats().diskreads;
+      delete scan1;
+      if (j != expected[t])
+        cout << "Error.   index scan should have returned " << expected[t]
+             << " records, returned " << j << endl;
+      else if (t < 2 && reads > 8)
+        cout << "Error.   index lookup read " << reads << " of " << pages
+             << " pages" << endl;
+      else
+        cout << "index scan for key " << keys[t] << " saw " << j << " records" << endl;
+    }
+    
+    // the record deleted through the index is gone from both
+    scan1 = new HeapFileScan("dummy.04", status);
+    if (status == OK)
+      status = scan1->startScan(0, sizeof(int), INTEGER, (char *) &keys[3], EQ);
+    if (status == OK && scan1->scanNext(rec2Rid) != FILEEOF)
+      cout << "Error.   record deleted through the index was found again" << endl;
+    scan1->endScan();
+    scan1->startScan(0, 0, STRING, NULL, EQ);
+    j = 0;
+    while ((status = scan1->scanNext(rec2Rid)) == OK) j++;
+    delete scan1;
+    if (j != num - 1000)
+      cout << "Error.   scan should have returned " << num - 1000 << " records!" << endl;
+  }
+  
+  
   // open up the heapFile
   file1 = new HeapFile("dummy.04", status);
   if (status != OK)
@@ -684,12 +1319,710 @@ int main(int argc, char **argv)
   delete scan1;
   
   // MORE ERROR HANDLING TESTS HERE
-  
+
   // get rid of the file
   if ((status = destroyHeapFile("dummy.04")) != OK) {
     cout << endl << "got error status return from destroy file" << endl;
     error.print(status);
   }
+
+  cout << endl;
+  cout << "create a file with a page size that is not supported" << endl;
+  status = createHeapFile("dummy.05", 3000);
+  if (status == BADPAGESIZE)
+    cout << "passed BADPAGESIZE test" << endl;
+  else
+  {
+    cout << "should have returned BADPAGESIZE, actually returned: " << endl;
+    error.print(status);
+  }
+
+  cout << endl;
+  cout << "insert " << num << " records into dummy.05 using "
+       << MAXPAGESIZE << " byte pages" << endl;
+  status = createHeapFile("dummy.05", MAXPAGESIZE);
+  if (status != OK) error.print(status);
+  iScan = new InsertFileScan("dummy.05", status);
+  if (status != OK) error.print(status);
+  for(i = 0; i < num; i++) {
+    sprintf(rec1.s, "This is record %05d", i);
+    rec1.i = i;
+    rec1.f = i;
+    dbrec1.data = &rec1;
+    dbrec1.length = sizeof(RECORD);
+    status = iScan->insertRecord(dbrec1, newRid);
+    if (status != OK)
+    {
+      cout << "got error status return from insertrecord" << endl;
+      error.print(status);
+    }
+  }
+
+  // the record that was too big above fits on a large page
+  dbrec1.data = (void *) &bigdata;
+  dbrec1.length = 8192;
+  status = iScan->insertRecord(dbrec1, rec2Rid);
+  if (status != OK)
+  {
+    cout << "got error status return from large record insert" << endl;
+    error.print(status);
+  }
+  delete iScan;
+
+  scan1 = new HeapFileScan("dummy.05", status);
+  if (status != OK) error.print(status);
+  scan1->startScan(0, 0, STRING, NULL, EQ);
+  i = 0;
+  while ((status = scan1->scanNext(rec2Rid)) != FILEEOF)
+  {
+    status = scan1->getRecord(dbrec2);
+    if (status != OK) break;
+    if (i < num)
+    {
+      sprintf(rec1.s, "This is record %05d", i);
+      rec1.i = i;
+      rec1.f = i;
+      if (memcmp(&rec1, dbrec2.data, sizeof(RECORD)) != 0)
+        cout << "error reading record " << i << " back" << endl;
+    }
+    else if (dbrec2.length != 8192)
+      cout << "error reading large record back" << endl;
+    i++;
+  }
+  if (status != FILEEOF) error.print(status);
+  cout << "scan of dummy.05 saw " << i << " records " << endl;
+  if (i != num + 1)
+    cout << "Error.   scan should have returned " << num + 1
+         << " records!" << endl;
+  delete scan1;
+  
+  // get rid of the file
+  if ((status = destroyHeapFile("dummy.05")) != OK) {
+    cout << endl << "got error status return from destroy file" << endl;
+    error.print(status);
+  }
+
+  // a page must agree with a model of it however records come and go
+  cout << endl << "insert and delete records on pages of every size" << endl;
+  {
+    int wrong = checkPageModel();
+    if (wrong)
+      cout << "Error.   " << wrong << " page operations disagreed with the model" << endl;
+  }
+  
+  // load a file in batches with insertRecords.  the load and the
+  // filtered scan go around the OS cache where the file system can,
+  // and through it where it cannot
+  const int batchSize = 1000;
+  cout << endl << "bulk insert " << num << " records into dummy.06 in batches of "
+       << batchSize << endl;
+  destroyHeapFile("dummy.06");
+  status = createHeapFile("dummy.06");
+  if (status != OK) error.print(status);
+  iScan = new InsertFileScan("dummy.06", status, OPENDIRECT);
+  if (status != OK) error.print(status);
+  ridArray = new RID[num];
+  {
+    RECORD* batch = new RECORD[batchSize];
+    Record* recs = new Record[batchSize];
+    for (i = 0; i < num && status == OK; i += batchSize) {
+      int n = (num - i < batchSize) ? num - i : batchSize;
+      for (j = 0; j < n; j++) {
+        memset(&batch[j], ' ', sizeof(RECORD));
+        sprintf(batch[j].s, "This is record %05d", i + j);
+        batch[j].i = i + j;
+        batch[j].f = i + j;
+        recs[j].data = &batch[j];
+        recs[j].length = sizeof(RECORD);
+      }
+      status = iScan->insertRecords(recs, n, ridArray + i);
+    }
+    if (status != OK) error.print(status);
+    delete [] recs;
+    delete [] batch;
+  }
+  delete iScan;
+
+  file1 = new HeapFile("dummy.06", status);
+  if (status != OK) error.print(status);
+  if (file1->getRecCnt() != num)
+    cout << "Error.   file should hold " << num << " records, holds "
+         << file1->getRecCnt() << endl;
+  for (i = 0; i < num; i += 7) {
+    status = file1->getRecord(ridArray[i], dbrec2);
+    if (status != OK) error.print(status);
+    else if (((RECORD *) dbrec2.data)->i != i)
+      cout << "error reading record " << i << " back" << endl;
+  }
+  delete file1;
+  delete [] ridArray;
+
+  scan1 = new HeapFileScan("dummy.06", status);
+  if (status != OK) error.print(status);
+  scan1->startScan(0, 0, STRING, NULL, EQ);
+  memset(rec1.s, ' ', sizeof(rec1.s));
+  i = 0;
+  while ((status = scan1->scanNext(rec2Rid)) == OK)
+  {
+    status = scan1->getRecord(dbrec2);
+    if (status != OK) break;
+    sprintf(rec1.s, "This is record %05d", i);
+    rec1.i = i;
+    rec1.f = i;
+    if (memcmp(&rec1, dbrec2.data, sizeof(RECORD)) != 0)
+      cout << "error reading record " << i << " back" << endl;
+    i++;
+  }
+  if (status != FILEEOF) error.print(status);
+  cout << "scan of dummy.06 saw " << i << " records " << endl;
+  if (i != num)
+    cout << "Error.   scan should have returned " << num << " records!" << endl;
+  delete scan1;
+
+  // comparing against a filter far from the attribute values must
+  // not overflow
+  int filterVal3 = -2147483000;
+  cout << endl << "Filtered scan of dummy.06 matching i field GT " << filterVal3 << endl;
+  scan1 = new HeapFileScan("dummy.06", status, OPENDIRECT);
+  if (status != OK) error.print(status);
+  status = scan1->startScan(0, sizeof(int), INTEGER, (char *) &filterVal3, GT);
+  if (status != OK) error.print(status);
+  i = 0;
+  while ((status = scan1->scanNext(rec2Rid)) == OK) i++;
+  if (status != FILEEOF) error.print(status);
+  cout << "scan of dummy.06 saw " << i << " records " << endl;
+  if (i != num)
+    cout << "Error.   filtered scan should have returned " << num << " records!" << endl;
+  delete scan1;
+
+  // scans of parts of dummy.06 at once on one thread, their pages
+  // read through one IoRing, must see the whole file between them.
+  // so must getRecordAsync, and a page read asynchronously is the
+  // same page readPage gives
+  cout << endl << "asynchronous scans and reads of dummy.06" << endl;
+  closeLingering();
+  {
+    const int scans = 8;
+    IoRing io;
+    HeapFileScan* parts[scans];
+    int counts[scans];
+    vector<IoTask> tasks;
+    int per = 0;
+    for (j = 0; j < scans; j++) {
+      parts[j] = new HeapFileScan("dummy.06", status);
+      if (status != OK) error.print(status);
+      parts[j]->setIoRing(&io);
+      if (j == 0) per = (parts[0]->getPageCnt() + scans - 1) / scans;
+      parts[j]->startScan(0, 0, STRING, NULL, EQ);
+      status = parts[j]->setPageRange(j * per, per);
+      if (status != OK) error.print(status);
+      tasks.push_back(countAsync(io, parts[j], counts[j]));
+    }
+    for (j = 0; j < scans; j++) tasks[j].start();
+    io.run();
+    i = 0;
+    for (j = 0; j < scans; j++) {
+      if (!tasks[j].done()) cout << "Error.   asynchronous scan " << j << " did not finish" << endl;
+      else if (tasks[j].status() != OK) error.print(tasks[j].status());
+      else i += counts[j];
+      delete parts[j];
+    }
+    cout << scans << " asynchronous scans of dummy.06 saw " << i << " records" << endl;
+    if (i != num)
+      cout << "Error.   should have seen " << num << " records" << endl;
+
+    closeLingering();
+    scan1 = new HeapFileScan("dummy.06", status);
+    if (status != OK) error.print(status);
+    scan1->startScan(0, 0, STRING, NULL, EQ);
+    vector<RID> some;
+    for (i = 0; scan1->scanNext(rec2Rid) == OK; i++)
+      if (i % 97 == 0) some.push_back(rec2Rid);
+    delete scan1;
+    file1 = new HeapFile("dummy.06", status);
+    if (status != OK) error.print(status);
+    int bad = 0;
+    for (size_t k = 0; k < some.size(); k++) {
+      IoTask get = file1->getRecordAsync(io, some[k], dbrec2);
+      if ((status = io.wait(get)) != OK) error.print(status);
+      else if (((RECORD *) dbrec2.data)->i != (int) k * 97) bad++;
+    }
+    delete file1;
+    if (bad) cout << "Error.   " << bad << " records read back wrong by getRecordAsync" << endl;
+
+    File* file;
+    Page* page;
+    Page* again;
+    if ((status = db.openFile("dummy.06", file)) != OK) error.print(status);
+    PageRead read = bufMgr->readPageAsync(file, some[0].pageNo, page, io);
+    if ((status = read.wait()) != OK) error.print(status);
+    else if ((status = bufMgr->readPage(file, some[0].pageNo, again)) != OK)
+      error.print(status);
+    else {
+      if (again != page) cout << "Error.   readPageAsync and readPage gave different pages" << endl;
+      bufMgr->unPinPage(file, some[0].pageNo, false);
+      bufMgr->unPinPage(file, some[0].pageNo, false);
+    }
+    db.closeFile(file);
+  }
+
+  if ((status = destroyHeapFile("dummy.06")) != OK) {
+    cout << endl << "got error status return from destroy file" << endl;
+    error.print(status);
+  }
+
+  // a file with the PAX layout, with i, f and s in columns of their
+  // own.  filters on one column, on bytes across two and on two
+  // columns must find what they find in the records themselves
+  cout << endl << "insert " << num << " records into dummy.07 with the PAX layout"
+       << endl;
+  {
+    AttrRange cols[3] = { { 0, sizeof(int) }, { sizeof(int), sizeof(float) },
+                          { 2 * sizeof(int), sizeof(rec1.s) } };
+    destroyHeapFile("dummy.07");
+    status = createHeapFile("dummy.07", PAGESIZE, cols, 3);
+    if (status != OK) error.print(status);
+    iScan = new InsertFileScan("dummy.07", status);
+    if (status != OK) error.print(status);
+    vector<RECORD> recs(num);
+    vector<Record> dbrecs(num);
+    vector<RID> rids(num);
+    for (i = 0; i < num; i++) {
+      memset(&recs[i], ' ', sizeof(RECORD));
+      sprintf(recs[i].s, "This is record %05d", i);
+      recs[i].i = i;
+      recs[i].f = i;
+      dbrecs[i].data = &recs[i];
+      dbrecs[i].length = sizeof(RECORD);
+    }
+    for (i = 0; i < num / 2 && status == OK; i++)
+      status = iScan->insertRecord(dbrecs[i], rids[i]);
+    if (status == OK)
+      status = iScan->insertRecords(&dbrecs[num / 2], num - num / 2,
+                                    &rids[num / 2]);
+    if (status != OK) error.print(status);
+    dbrec1.data = &rec1;
+    dbrec1.length = sizeof(RECORD) - 1;
+    if (iScan->insertRecord(dbrec1, newRid) != INVALIDRECLEN)
+      cout << "Error.   a record of another length went into dummy.07" << endl;
+    delete iScan;
+
+    scan1 = new HeapFileScan("dummy.07", status);
+    if (status != OK) error.print(status);
+    scan1->startScan(0, 0, STRING, NULL, EQ);
+    i = 0;
+    while ((status = scan1->scanNext(rec2Rid)) == OK) {
+      scan1->getRecord(dbrec2);
+      if (dbrec2.length != sizeof(RECORD) ||
+          memcmp(&recs[i], dbrec2.data, sizeof(RECORD)) != 0)
+        cout << "error reading record " << i << " back" << endl;
+      i++;
+    }
+    delete scan1;
+    cout << "scan of dummy.07 saw " << i << " records" << endl;
+    if (i != num)
+      cout << "Error.   scan should have returned " << num << " records!" << endl;
+
+    int below = 100, under = 5000;
+    float atLeast = 4000;
+    char bytes[4];
+    memcpy(bytes, (char*) &recs[42] + 6, sizeof bytes);
+    Predicate preds[5];
+    preds[0].compile(0, sizeof(int), INTEGER, (char*) &below, LT);
+    preds[1].compile(sizeof(int), sizeof(float), FLOAT, (char*) &atLeast, GTE);
+    preds[2].compile(2 * sizeof(int), 20, STRING, recs[42].s, EQ);
+    preds[3].compile(6, sizeof bytes, STRING, bytes, EQ);
+    preds[4].compile(0, sizeof(int), INTEGER, (char*) &under, LT);
+    const char* names[5] = { "i LT 100", "f GTE 4000", "s EQ record 42",
+                             "bytes 6 to 9 of record 42", "i LT 5000 and f GTE 4000" };
+    for (int t = 0; t < 4; t++) {
+      int want = 0;
+      for (j = 0; j < num; j++)
+        if (preds[t].match(dbrecs[j])) want++;
+      scan1 = new HeapFileScan("dummy.07", status);
+      status = scan1->startScan(&preds[t], 1);
+      if (status != OK) error.print(status);
+      i = 0;
+      while ((status = scan1->scanNext(rec2Rid)) == OK) {
+        scan1->getRecord(dbrec2);
+        if (!preds[t].match(dbrec2)) cout << "error: record does not match" << endl;
+        i++;
+      }
+      delete scan1;
+      cout << "scan of dummy.07 for " << names[t] << " saw " << i << " records" << endl;
+      if (i != want)
+        cout << "Error.   should have seen " << want << " records" << endl;
+    }
+    Predicate both[2] = { preds[4], preds[1] };
+    scan1 = new HeapFileScan("dummy.07", status);
+    status = scan1->startScan(both, 2);
+    if (status != OK) error.print(status);
+    i = 0;
+    while ((status = scan1->scanNext(rec2Rid)) == OK) i++;
+    delete scan1;
+    cout << "scan of dummy.07 for " << names[4] << " saw " << i << " records" << endl;
+    if (i != 1000)
+      cout << "Error.   should have seen 1000 records" << endl;
+    
+    // a record changed in the copy getRecord hands out and passed to
+    // updateRecord is stored.  these records are deleted below
+    vector<RID> changed;
+    scan1 = new HeapFileScan("dummy.07", status);
+    scan1->startScan(0, 0, STRING, NULL, EQ);
+    for (i = 0; i < 100 && (status = scan1->scanNext(rec2Rid)) == OK; i++) {
+      if (i % 2) continue;
+      scan1->getRecord(dbrec2);
+      ((RECORD*) dbrec2.data)->f = -1;
+      if ((status = scan1->updateRecord(rec2Rid, dbrec2)) != OK) break;
+      changed.push_back(rec2Rid);
+    }
+    delete scan1;
+    if (status != OK) error.print(status);
+    file1 = new HeapFile("dummy.07", status);
+    int lost = 0;
+    for (size_t k = 0; k < changed.size(); k++)
+      if (file1->getRecord(changed[k], dbrec2) != OK
+          || ((RECORD*) dbrec2.data)->f != -1)
+        lost++;
+    delete file1;
+    if (changed.size() != 50 || lost)
+      cout << "Error.   " << lost << " updates of dummy.07 through getRecord were lost" << endl;
+    
+    // and so is one changed there and marked dirty
+    changed.clear();
+    scan1 = new HeapFileScan("dummy.07", status);
+    scan1->startScan(0, 0, STRING, NULL, EQ);
+    for (i = 0; i < 200 && (status = scan1->scanNext(rec2Rid)) == OK; i++) {
+      if (i < 100 || i % 2) continue;
+      scan1->getRecord(dbrec2);
+      ((RECORD*) dbrec2.data)->f = -2;
+      if ((status = scan1->markDirty()) != OK) break;
+      changed.push_back(rec2Rid);
+    }
+    delete scan1;
+    if (status != OK) error.print(status);
+    file1 = new HeapFile("dummy.07", status);
+    lost = 0;
+    for (size_t k = 0; k < changed.size(); k++)
+      if (file1->getRecord(changed[k], dbrec2) != OK
+          || ((RECORD*) dbrec2.data)->f != -2)
+        lost++;
+    delete file1;
+    if (changed.size() != 50 || lost)
+      cout << "Error.   " << lost << " records of dummy.07 marked dirty were lost" << endl;
+
+    // deleted records leave room that inserts take again
+    scan1 = new HeapFileScan("dummy.07", status);
+    scan1->startScan(0, 0, STRING, NULL, EQ);
+    deleted = 0;
+    for (i = 0; (status = scan1->scanNext(rec2Rid)) == OK; i++)
+      if (i % 2 == 0 && scan1->deleteRecord() == OK) deleted++;
+    int pages = scan1->getPageCnt();
+    delete scan1;
+    iScan = new InsertFileScan("dummy.07", status);
+    for (i = 0; i < deleted && status == OK; i++)
+      status = iScan->insertRecord(dbrecs[i], newRid);
+    if (status != OK) error.print(status);
+    if (iScan->getPageCnt() != pages)
+      cout << "Error.   inserts after deletes added "
+           << iScan->getPageCnt() - pages << " pages" << endl;
+    delete iScan;
+
+    file1 = new HeapFile("dummy.07", status);
+    if (file1->getRecCnt() != num)
+      cout << "Error.   dummy.07 should hold " << num << " records" << endl;
+    vector<RID> odd;
+    for (i = 1; i < num; i += 2) odd.push_back(rids[i]);
+    int bad = 0;
+    status = file1->getRecords(odd.data(), odd.size(),
+                               [&](const int k, const RID& rid, const Record& rec) {
+      if (memcmp(rec.data, &recs[2 * k + 1], sizeof(RECORD)) != 0) bad++;
+    }, true);
+    delete file1;
+    if (status != OK) error.print(status);
+    if (bad) cout << "Error.   " << bad << " records of dummy.07 read back wrong" << endl;
+  }
+  if ((status = destroyHeapFile("dummy.07")) != OK) error.print(status);
+
+  // updates that grow records past what their pages hold move them,
+  // but their RIDs, the scans and the index keep finding them, and
+  // shrinking them again takes them back home
+  cout << endl << "update the records of dummy.08 in place and by moving them" << endl;
+  destroyHeapFile("dummy.08");
+  status = createHeapFile("dummy.08");
+  if (status != OK) error.print(status);
+  {
+    const int small = 16, large = 400;
+    char buf[large];
+    vector<RID> rids(num);
+    dbrec1.data = buf;
+    memset(buf, 'x', large);
+    iScan = new InsertFileScan("dummy.08", status);
+    for (i = 0; i < num && status == OK; i++) {
+      memcpy(buf, &i, sizeof(int));
+      dbrec1.length = small;
+      status = iScan->insertRecord(dbrec1, rids[i]);
+    }
+    delete iScan;
+    if (status != OK) error.print(status);
+    file1 = new HeapFile("dummy.08", status);
+    if (status == OK) status = file1->createIndex(0, sizeof(int), INTEGER);
+    if (status != OK) error.print(status);
+    int pages = file1->getPageCnt();
+    delete file1;
+    
+    // every tenth record grows, and the others change in place
+    for (int round = 0; round < 2; round++) {
+      scan1 = new HeapFileScan("dummy.08", status);
+      for (i = 0; i < num && status == OK; i++) {
+        memcpy(buf, &i, sizeof(int));
+        buf[sizeof(int)] = 'a' + round;
+        dbrec1.length = (i % 10 == 0) ? large : small;
+        status = scan1->updateRecord(rids[i], dbrec1);
+      }
+      if (status != OK) error.print(status);
+      
+      // the records that grew shrink back; they must fit at home
+      // again and leave room for the next round
+      if (round == 1) {
+        for (i = 0; i < num && status == OK; i += 10) {
+          memcpy(buf, &i, sizeof(int));
+          dbrec1.length = small;
+          status = scan1->updateRecord(rids[i], dbrec1);
+        }
+        if (status != OK) error.print(status);
+      }
+      if (round == 0 && scan1->getPageCnt() == pages)
+        cout << "Error.   no record of dummy.08 moved" << endl;
+      if (round == 0) pages = scan1->getPageCnt();
+      else if (scan1->getPageCnt() != pages)
+        cout << "Error.   growing the records again took "
+             << scan1->getPageCnt() - pages << " more pages" << endl;
+      if (scan1->getRecCnt() != num)
+        cout << "Error.   dummy.08 should hold " << num << " records" << endl;
+      delete scan1;
+      
+      int bad = 0;
+      file1 = new HeapFile("dummy.08", status);
+      for (i = 0; i < num; i++) {
+        status = file1->getRecord(rids[i], dbrec2);
+        int want = (round == 0 && i % 10 == 0) ? large : small;
+        if (status != OK || dbrec2.length != want
+            || memcmp(dbrec2.data, &i, sizeof(int)) != 0
+            || ((char*) dbrec2.data)[sizeof(int)] != 'a' + round)
+          bad++;
+      }
+      delete file1;
+      if (bad) cout << "Error.   " << bad << " updated records read back wrong" << endl;
+      
+      // a scan sees every record once, under the RID it was given
+      scan1 = new HeapFileScan("dummy.08", status);
+      scan1->startScan(0, 0, STRING, NULL, EQ);
+      j = 0;
+      bad = 0;
+      while ((status = scan1->scanNext(rec2Rid)) == OK) {
+        scan1->getRecord(dbrec2);
+        int k;
+        memcpy(&k, dbrec2.data, sizeof(int));
+        if (k < 0 || k >= num || rids[k].pageNo != rec2Rid.pageNo
+            || rids[k].slotNo != rec2Rid.slotNo)
+          bad++;
+        j++;
+      }
+      if (status != FILEEOF) error.print(status);
+      cout << "scan of dummy.08 saw " << j << " records" << endl;
+      if (j != num || bad)
+        cout << "Error.   should have seen " << num << " records under their RIDs" << endl;
+      delete scan1;
+    }
+    
+    // a record that moved is found through the index, and deleting it
+    // takes its stub along
+    int key = 30;
+    scan1 = new HeapFileScan("dummy.08", status);
+    dbrec1.length = large;
+    memcpy(buf, &key, sizeof(int));
+    if (status == OK) status = scan1->updateRecord(rids[key], dbrec1);
+    if (status == OK)
+      status = scan1->startScan(0, sizeof(int), INTEGER, (char *) &key, EQ);
+    if (status != OK) error.print(status);
+    j = 0;
+    while ((status = scan1->scanNext(rec2Rid)) == OK) {
+      scan1->getRecord(dbrec2);
+      if (dbrec2.length != large || rec2Rid.pageNo != rids[key].pageNo
+          || rec2Rid.slotNo != rids[key].slotNo)
+        cout << "Error.   index scan returned the wrong record" << endl;
+      else status = scan1->deleteRecord();
+      if (status != OK) error.print(status);
+      j++;
+    }
+    if (j != 1)
+      cout << "Error.   index scan should have returned the moved record" << endl;
+    if (scan1->getRecCnt() != num - 1)
+      cout << "Error.   dummy.08 should hold " << num - 1 << " records" << endl;
+    delete scan1;
+    file1 = new HeapFile("dummy.08", status);
+    if (status == OK && file1->getRecord(rids[key], dbrec2) == OK)
+      cout << "Error.   the deleted record can still be read" << endl;
+    delete file1;
+    
+    // a scan that grows every record it sees moves many of them on to
+    // pages it has yet to get to, and must not update them again there
+    vector<int> seen(num, 0);
+    scan1 = new HeapFileScan("dummy.08", status);
+    if (status == OK) status = scan1->startScan(0, 0, STRING, NULL, EQ);
+    while (status == OK && (status = scan1->scanNext(rec2Rid)) == OK) {
+      scan1->getRecord(dbrec2);
+      memcpy(&i, dbrec2.data, sizeof(int));
+      if (i >= 0 && i < num) seen[i]++;
+      memcpy(buf, &i, sizeof(int));
+      dbrec1.length = large;
+      status = scan1->updateRecord(rec2Rid, dbrec1);
+    }
+    if (status != FILEEOF) error.print(status);
+    delete scan1;
+    int wrong = 0;
+    for (i = 0; i < num; i++)
+      if (seen[i] != (i == key ? 0 : 1)) wrong++;
+    if (wrong)
+      cout << "Error.   " << wrong << " records were not updated exactly once" << endl;
+    
+    // and a batch scan finds each of them once, at its stub
+    fill(seen.begin(), seen.end(), 0);
+    RID    batchRids[64];
+    Record batchRecs[64];
+    int    n = 0;
+    scan1 = new HeapFileScan("dummy.08", status);
+    if (status == OK) status = scan1->startScan(0, 0, STRING, NULL, EQ);
+    while (status == OK
+           && (status = scan1->scanNextBatch(batchRids, batchRecs, 64, n)) == OK)
+      for (int k = 0; k < n; k++) {
+        memcpy(&i, batchRecs[k].data, sizeof(int));
+        if (batchRecs[k].length == large && i >= 0 && i < num
+            && rids[i].pageNo == batchRids[k].pageNo
+            && rids[i].slotNo == batchRids[k].slotNo)
+          seen[i]++;
+      }
+    if (status != FILEEOF) error.print(status);
+    delete scan1;
+    wrong = 0;
+    for (i = 0; i < num; i++)
+      if (seen[i] != (i == key ? 0 : 1)) wrong++;
+    if (wrong)
+      cout << "Error.   a batch scan saw " << wrong << " grown records wrong" << endl;
+    
+    // the copy getRecord makes of a moved record can be changed and
+    // passed to updateRecord
+    scan1 = new HeapFileScan("dummy.08", status);
+    if (status == OK) status = scan1->startScan(0, 0, STRING, NULL, EQ);
+    while (status == OK && (status = scan1->scanNext(rec2Rid)) == OK) {
+      scan1->getRecord(dbrec2);
+      ((char*) dbrec2.data)[sizeof(int)] = 'u';
+      status = scan1->updateRecord(rec2Rid, dbrec2);
+    }
+    if (status != FILEEOF) error.print(status);
+    delete scan1;
+    wrong = 0;
+    file1 = new HeapFile("dummy.08", status);
+    for (i = 0; i < num; i++)
+      if (i != key && (file1->getRecord(rids[i], dbrec2) != OK
+                       || dbrec2.length != large
+                       || ((char*) dbrec2.data)[sizeof(int)] != 'u'))
+        wrong++;
+    delete file1;
+    if (wrong)
+      cout << "Error.   " << wrong << " updates of dummy.08 through getRecord were lost" << endl;
+    
+    // as can the record itself, when it is marked dirty
+    scan1 = new HeapFileScan("dummy.08", status);
+    if (status == OK) status = scan1->startScan(0, 0, STRING, NULL, EQ);
+    while (status == OK && (status = scan1->scanNext(rec2Rid)) == OK) {
+      scan1->getRecord(dbrec2);
+      ((char*) dbrec2.data)[sizeof(int)] = 'd';
+      status = scan1->markDirty();
+    }
+    if (status != FILEEOF) error.print(status);
+    delete scan1;
+    wrong = 0;
+    file1 = new HeapFile("dummy.08", status);
+    for (i = 0; i < num; i++)
+      if (i != key && (file1->getRecord(rids[i], dbrec2) != OK
+                       || dbrec2.length != large
+                       || ((char*) dbrec2.data)[sizeof(int)] != 'd'))
+        wrong++;
+    delete file1;
+    if (wrong)
+      cout << "Error.   " << wrong << " records of dummy.08 marked dirty were lost" << endl;
+  }
+  if ((status = destroyHeapFile("dummy.08")) != OK) error.print(status);
+
+  // a child process changes dummy.wal with a log attached to its
+  // pool, commits, changes it some more and dies without closing
+  // anything.  recovering the log must bring back exactly the
+  // committed records
+  cout << endl << "recover dummy.wal from its log after a crash" << endl;
+  closeLingering();
+  destroyHeapFile("dummy.wal");
+  unlink("dummy.log");
+  cout.flush();
+  pid_t child = fork();
+  if (child == 0)
+  {
+    bufMgr = new BufMgr(64);
+    LogMgr* log = new LogMgr("dummy.log", status, 1000000);
+    if (status == OK) bufMgr->setLog(log);
+    if (status == OK) status = createHeapFile("dummy.wal");
+    iScan = new InsertFileScan("dummy.wal", status);
+    for (i = 0; i < num && status == OK; i++) {
+      sprintf(rec1.s, "This is record %05d", i);
+      rec1.i = i;
+      rec1.f = i;
+      dbrec1.data = &rec1;
+      dbrec1.length = sizeof(RECORD);
+      status = iScan->insertRecord(dbrec1, newRid);
+      if (i == num / 2 && status == OK) status = log->checkpoint();
+    }
+    delete iScan;
+    scan1 = new HeapFileScan("dummy.wal", status);
+    if (status == OK) status = scan1->startScan(0, 0, STRING, NULL, EQ);
+    for (i = 0; status == OK && (status = scan1->scanNext(rec2Rid)) == OK; i++)
+      if (i % 3 == 0) status = scan1->deleteRecord();
+    delete scan1;
+    if (status == FILEEOF) status = log->commit();
+
+    iScan = new InsertFileScan("dummy.wal", status);
+    for (i = 0; i < 100 && status == OK; i++)
+      status = iScan->insertRecord(dbrec1, newRid);
+    if (status != OK) error.print(status);
+    _exit(status == OK ? 0 : 1);
+  }
+  int childStatus = -1;
+  if (child < 0 || waitpid(child, &childStatus, 0) != child
+      || !WIFEXITED(childStatus) || WEXITSTATUS(childStatus) != 0)
+    cout << "Error.   the process changing dummy.wal failed" << endl;
+  else
+  {
+    LogMgr* log = new LogMgr("dummy.log", status);
+    if (status != OK) error.print(status);
+    else if (log->getRecovered() == 0)
+      cout << "Error.   nothing was recovered from the log" << endl;
+    delete log;
+
+    scan1 = new HeapFileScan("dummy.wal", status);
+    if (status != OK) error.print(status);
+    scan1->startScan(0, 0, STRING, NULL, EQ);
+    i = 0;
+    while ((status = scan1->scanNext(rec2Rid)) == OK) i++;
+    if (status != FILEEOF) error.print(status);
+    delete scan1;
+    cout << "scan of dummy.wal saw " << i << " records" << endl;
+    if (i != num - (num + 2) / 3)
+      cout << "Error.   should have seen " << num - (num + 2) / 3
+           << " committed records" << endl;
+  }
+  closeLingering();
+  if ((status = destroyHeapFile("dummy.wal")) != OK) error.print(status);
+  unlink("dummy.log");
   delete bufMgr;
   
   cout << endl << "Done testing." << endl;